@@ -0,0 +1,79 @@
+#ifndef DISP_APPS_RECONSTRUCTION_SIRT_ART_H
+#define DISP_APPS_RECONSTRUCTION_SIRT_ART_H
+
+#include <math.h>
+#include "trace_data.h"
+#include "trace_utils.h"
+#include "reduction_space_a.h"
+#include "data_region_base.h"
+
+/**
+ * ART (Kaczmarz) reconstruction for the streaming engine.
+ *
+ * Every ray updates the image right after its forward projection, so the
+ * space writes to metadata.recon() directly and its reduction objects are
+ * unused. Rays of a slice only touch that slice; the engine gives all rays
+ * of a slice to one thread (see Owner()), which applies them in projection
+ * order, so the result does not depend on the number of threads. Input
+ * chunks must not span slices, e.g. one projection row per request.
+ *
+ * Unrelaxed (relaxation 1) updates fit each ray exactly and keep
+ * oscillating on noisy measurements; smaller relaxation factors trade the
+ * speed of the first pass for a lower residual.
+ */
+class ARTReconSpace : 
+  public AReductionSpaceBase<ARTReconSpace, float>
+{
+  private:
+    float *coordx = nullptr;
+    float *coordy = nullptr;
+    float *ax = nullptr;
+    float *ay = nullptr;
+    float *bx = nullptr;
+    float *by = nullptr;
+    float *coorx = nullptr;
+    float *coory = nullptr;
+    float *leng = nullptr;
+    float *leng2 = nullptr;
+    int *indi = nullptr;
+
+    int num_grids;
+    float relaxation_ = 1.;
+
+  protected:
+    // Forward projection, update of the ray's pixels
+    void UpdateRay(
+        float *recon,
+        float ray,
+        int const * const indi,
+        float *leng2,
+        float *leng,
+        int len);
+
+  public:
+    /// rows x cols reduction objects are allocated but not used, e.g. 1x1
+    ARTReconSpace(int rows, int cols) : 
+      AReductionSpaceBase<ARTReconSpace, float>(rows, cols) {}
+
+    virtual ~ARTReconSpace(){
+      Finalize();
+    }
+
+    void Reduce(MirroredRegionBareBase<float> &input);
+
+    virtual bool RowAction() const { return true; }
+    /// Slice of the chunk
+    virtual int Owner(MirroredRegionBareBase<float> &input);
+
+    float relaxation() const { return relaxation_; }
+    void relaxation(float r) { relaxation_ = r; }
+
+    void Initialize(int n_grids);
+    virtual void CopyTo(ARTReconSpace &target){
+      target.Initialize(num_grids);
+      target.relaxation(relaxation_);
+    }
+    void Finalize();
+};
+
+#endif    // DISP_APPS_RECONSTRUCTION_SIRT_ART_H
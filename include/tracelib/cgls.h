@@ -0,0 +1,83 @@
+#ifndef DISP_APPS_RECONSTRUCTION_SIRT_CGLS_H
+#define DISP_APPS_RECONSTRUCTION_SIRT_CGLS_H
+
+#include <vector>
+#include "sirt.h"
+
+/**
+ * CGLS (conjugate gradient least squares) reconstruction.
+ *
+ * Every slice is solved as its own least squares problem with SIRT's ray
+ * tracing as the projector. A replica row holds a backprojection A^T v of
+ * a slice followed by the squared norm of v, both summed by the local and
+ * group combinations like SIRT's replicas. Each window restarts the
+ * solver: its first iteration backprojects the residual b-Ax into the
+ * gradient s, and every following iteration forward projects the search
+ * direction p (q = Ap), backprojects q and updates x, s and p with the
+ * step computed from |q|^2, i.e. one projector pair per iteration.
+ *
+ * The solver vectors live in the main space; replicas only read p.
+ */
+class CGLSReconSpace : public SIRTReconSpace
+{
+  public:
+    enum Phase {
+      kGradient = 0,  /// Next reduction backprojects b-Ax
+      kStep           /// Next reduction backprojects Ap
+    };
+
+  private:
+    CGLSReconSpace *main_;      /// Holds the solver state
+    Phase phase_ = kGradient;
+    int num_pixels_;            /// Per slice
+    std::vector<float> p_;      /// Search directions of the own slices
+    std::vector<float> s_;      /// Gradients A^T r
+    std::vector<double> gamma_; /// |s|^2 per slice
+
+  protected:
+    virtual float *ProjectedSlice(TraceMetadata &metadata, int curr_slice);
+
+    virtual void UpdateReconReplica(
+        float simdata,
+        float ray,
+        int curr_slice,
+        int const * const indi,
+        float *leng2,
+        float *leng, 
+        int len);
+
+  public:
+    /// cols is the number of pixels of a slice plus one
+    CGLSReconSpace(int rows, int cols) 
+      : SIRTReconSpace(rows, cols)
+      , main_{this}
+      , num_pixels_{cols-1} {}
+
+    /// Starts over with the gradient, e.g. for a new window
+    void Restart() { phase_ = kGradient; }
+    Phase phase() const { return phase_; }
+
+    /// Applies the combined replica of the current phase to recon and the
+    /// solver state; recon is left unchanged in the gradient phase
+    virtual void UpdateRecon(
+        ADataRegion<float> &recon,
+        DataRegion2DBareBase<float> &comb_replica,
+        size_t recon_offset=0);
+    /// Not supported, the step needs the norms of whole slices
+    virtual void UpdateReconStripe(
+        ADataRegion<float> &recon,
+        float const *stripe,
+        size_t beg, size_t end,
+        size_t recon_offset=0);
+
+    virtual CGLSReconSpace *Clone(){
+      auto &red_objs = reduction_objects();
+      auto cloned_obj = new CGLSReconSpace(red_objs.rows(), red_objs.cols());
+      cloned_obj->reduction_objects() = red_objs;
+      CopyTo(*cloned_obj);
+      cloned_obj->main_ = main_;
+      return cloned_obj;
+    }
+};
+
+#endif    // DISP_APPS_RECONSTRUCTION_SIRT_CGLS_H
@@ -3,6 +3,10 @@
 
 #include "data_region_2d_bare_base.h"
 
+/// Identifies a global combination started with 
+/// GlobalInPlaceCombinationStart
+typedef int DISPCommHandle;
+
 template <typename DT>
 class DISPCommBase{
   protected:
@@ -12,6 +16,13 @@ class DISPCommBase{
   public:
     virtual void GlobalInPlaceCombination(DataRegion2DBareBase<DT> &dr) = 0;
 
+    /// Starts combining rows [beg_row, beg_row+num_rows) of dr. These rows
+    /// must not be accessed until GlobalInPlaceCombinationWait returns.
+    /// Combinations must be started in the same order on all processes.
+    virtual DISPCommHandle GlobalInPlaceCombinationStart(
+        DataRegion2DBareBase<DT> &dr, size_t beg_row, size_t num_rows) = 0;
+    virtual void GlobalInPlaceCombinationWait(DISPCommHandle handle) = 0;
+
     /// Accessors
     int rank() const { return rank_; }
     int size() const { return size_; }
@@ -0,0 +1,27 @@
+#ifndef DISP_SRC_DISP_COMM_LOCAL_H
+#define DISP_SRC_DISP_COMM_LOCAL_H
+
+#include "disp_comm_base.h"
+
+/// Single-process communication layer. The local combination already leaves
+/// the complete replica in the main reduction space, so global combinations
+/// do nothing.
+template <typename DT>
+class DISPCommLocal : public DISPCommBase<DT> {
+  public:
+    DISPCommLocal(){
+      this->rank_ = 0;
+      this->size_ = 1;
+    }
+
+    virtual void GlobalInPlaceCombination(DataRegion2DBareBase<DT> &){}
+
+    virtual DISPCommHandle GlobalInPlaceCombinationStart(
+        DataRegion2DBareBase<DT> &, size_t, size_t){
+      return 0;
+    }
+
+    virtual void GlobalInPlaceCombinationWait(DISPCommHandle){}
+};
+
+#endif    // DISP_SRC_DISP_COMM_LOCAL_H
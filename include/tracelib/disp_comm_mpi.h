@@ -2,12 +2,296 @@
 #define DISP_SRC_DISP_COMM_MPI_H
 
 #include <iostream>
+#include <vector>
+#include <climits>
+#include <algorithm>
 #include "disp_comm_base.h"
+#include "trace_half.h"
 #include "mpi.h"
 
+/// Wire format of the values in the blocking global combination
+enum DISPCommPrecision {
+  kDISPCommFP32 = 0,
+  kDISPCommBF16,
+  kDISPCommFP16
+};
+
 template <typename DT>
 class DISPCommMPI : public DISPCommBase<DT> {
   private:
+    int thread_level_ = MPI_THREAD_SINGLE;
+
+    /// Communicator of the global combinations
+    MPI_Comm reduce_comm_ = MPI_COMM_WORLD;
+
+    /// Number of elements per MPI_Iallreduce of a non-blocking combination
+    size_t chunk_count_ = (1<<20)/sizeof(DT);
+
+    /// Contiguous staging buffer of the blocking combination
+    std::vector<DT> staging_;
+
+    /// Request of a non-blocking combination over data[0, n), sent as
+    /// half[0, n) if the precision is reduced
+    struct Part {
+      DT *data;
+      uint16_t *half;
+      size_t n;
+    };
+
+    /// State of a non-blocking combination. Slots (and their staging
+    /// buffers) are reused once waited on.
+    struct Pending {
+      std::vector<DT> buf;          /// Packed rows, or their values only
+      std::vector<uint16_t> half;   /// Reduced-precision copy of buf
+      std::vector<MPI_Request> reqs;
+      std::vector<Part> parts;      /// One per request
+      DataRegion2DBareBase<DT> *dr = nullptr;
+      size_t beg_row = 0;
+      size_t num_rows = 0;
+      DT *sum = nullptr;            /// Node sum of the rows (node-aware path)
+      bool values = false;          /// buf holds the values of the pairs
+      bool lengths = false;         /// Lengths of the rows combined too
+      bool active = false;
+    };
+    std::vector<Pending> pending_;
+    size_t lengths_rows_ = 0;       /// Rows of lengths_ combined so far
+
+    /// Node-aware blocking combination. Ranks of reduce_comm_ that share a
+    /// node stage their replicas in one MPI-3 shared window and sum them
+    /// there; only the node leaders take part in the inter-node allreduce.
+    bool shm_enabled_ = false;
+    MPI_Comm node_comm_ = MPI_COMM_NULL;
+    MPI_Comm leader_comm_ = MPI_COMM_NULL;
+    MPI_Win shm_win_ = MPI_WIN_NULL;
+    size_t shm_count_ = 0;        /// Elements per rank segment
+    std::vector<DT*> shm_segs_;   /// Segments of the node ranks
+
+    /// Reduced-precision blocking combination, see CombinationPrecision()
+    /// and CacheLengths()
+    DISPCommPrecision precision_ = kDISPCommFP32;
+    MPI_Op half_op_ = MPI_OP_NULL;
+    std::vector<uint16_t> half_buf_;
+    bool cache_lengths_ = false;
+    bool lengths_valid_ = false;
+    std::vector<DT> values_;
+    std::vector<DT> lengths_;     /// Combined length plane of the window
+
+    /// MPI_Op summing 16-bit floats; every partial sum is rounded back to
+    /// 16 bits
+    static void SumBF16(void *in, void *inout, int *len, MPI_Datatype *){
+      trace_half::SumBF16(static_cast<uint16_t const*>(in),
+          static_cast<uint16_t*>(inout), *len);
+    }
+    static void SumFP16(void *in, void *inout, int *len, MPI_Datatype *){
+      trace_half::SumFP16(static_cast<uint16_t const*>(in),
+          static_cast<uint16_t*>(inout), *len);
+    }
+
+    /// Sums buf[0, n) over comm, at precision_ if it is reduced
+    void AllreduceInPlace(DT *buf, size_t n, bool reduced, MPI_Comm comm){
+      if(!reduced || precision_==kDISPCommFP32){
+        for(size_t b=0; b<n; b+=INT_MAX){
+          int c = static_cast<int>(std::min<size_t>(INT_MAX, n-b));
+          MPI_Allreduce(MPI_IN_PLACE, buf+b, c, MPIType(), MPI_SUM, comm);
+        }
+        return;
+      }
+      bool bf16 = (precision_==kDISPCommBF16);
+      half_buf_.resize(n);
+      for(size_t i=0; i<n; ++i)
+        half_buf_[i] = (bf16) ? trace_half::FloatToBF16(buf[i]) :
+                                trace_half::FloatToFP16(buf[i]);
+      for(size_t b=0; b<n; b+=INT_MAX){
+        int c = static_cast<int>(std::min<size_t>(INT_MAX, n-b));
+        MPI_Allreduce(MPI_IN_PLACE, half_buf_.data()+b, c, MPI_UINT16_T,
+            half_op_, comm);
+      }
+      for(size_t i=0; i<n; ++i)
+        buf[i] = (bf16) ? trace_half::BF16ToFloat(half_buf_[i]) :
+                          trace_half::FP16ToFloat(half_buf_[i]);
+    }
+
+    void FromHalf(uint16_t const *half, DT *data, size_t n){
+      bool bf16 = (precision_==kDISPCommBF16);
+      for(size_t i=0; i<n; ++i)
+        data[i] = (bf16) ? trace_half::BF16ToFloat(half[i]) :
+                           trace_half::FP16ToFloat(half[i]);
+    }
+
+    /// Issues the MPI_Iallreduce requests of data[0, n) of p over comm, one
+    /// per chunk_count_ elements, at precision_ if reduced
+    void IssueChunks(Pending &p, DT *data, size_t n, bool reduced,
+        MPI_Comm comm)
+    {
+      uint16_t *half = nullptr;
+      if(reduced && precision_!=kDISPCommFP32){
+        /// A combination has at most one reduced-precision part
+        p.half.resize(n);
+        half = p.half.data();
+        bool bf16 = (precision_==kDISPCommBF16);
+        for(size_t i=0; i<n; ++i)
+          half[i] = (bf16) ? trace_half::FloatToBF16(data[i]) :
+                             trace_half::FloatToFP16(data[i]);
+      }
+      for(size_t beg=0; beg<n; beg+=chunk_count_){
+        size_t c = std::min(chunk_count_, n-beg);
+        MPI_Request req;
+        if(half!=nullptr)
+          MPI_Iallreduce(MPI_IN_PLACE, half+beg, static_cast<int>(c),
+              MPI_UINT16_T, half_op_, comm, &req);
+        else
+          MPI_Iallreduce(MPI_IN_PLACE, data+beg, static_cast<int>(c),
+              MPIType(), MPI_SUM, comm, &req);
+        p.reqs.push_back(req);
+        p.parts.push_back(Part{data+beg, (half!=nullptr) ? half+beg : nullptr, c});
+      }
+    }
+
+    /// Combination of interleaved (value, length) pairs with the lengths
+    /// taken from lengths_ once they are combined for the window
+    void CompressedInPlaceCombination(DataRegion2DBareBase<DT> &dr){
+      size_t n = dr.count();
+      staging_.resize(n);
+      Pack(dr, 0, dr.num_rows(), staging_.data());
+      if(!cache_lengths_){
+        AllreduceInPlace(staging_.data(), n, true, reduce_comm_);
+        Unpack(dr, 0, staging_.data(), 0, n);
+        return;
+      }
+
+      if(n%2!=0)
+        throw std::invalid_argument("Replica does not hold (value, length) pairs");
+      size_t n_pairs = n/2;
+      if(!lengths_valid_ || lengths_.size()!=n_pairs){
+        lengths_.resize(n_pairs);
+        for(size_t i=0; i<n_pairs; ++i) lengths_[i] = staging_[2*i+1];
+        AllreduceInPlace(lengths_.data(), n_pairs, false, reduce_comm_);
+        lengths_valid_ = true;
+      }
+      values_.resize(n_pairs);
+      for(size_t i=0; i<n_pairs; ++i) values_[i] = staging_[2*i];
+      AllreduceInPlace(values_.data(), n_pairs, true, reduce_comm_);
+      for(size_t i=0; i<n_pairs; ++i){
+        staging_[2*i] = values_[i];
+        staging_[2*i+1] = lengths_[i];
+      }
+      Unpack(dr, 0, staging_.data(), 0, n);
+    }
+
+    /// Orders the stores of the node ranks to the shared window
+    void NodeSync(){
+      MPI_Win_sync(shm_win_);
+      MPI_Barrier(node_comm_);
+      MPI_Win_sync(shm_win_);
+    }
+
+    void FreeSharedWindow(){
+      if(shm_win_!=MPI_WIN_NULL){
+        MPI_Win_unlock_all(shm_win_);
+        MPI_Win_free(&shm_win_);
+      }
+      shm_count_ = 0;
+      shm_segs_.clear();
+    }
+
+    void FreeNodeComms(){
+      FreeSharedWindow();
+      if(leader_comm_!=MPI_COMM_NULL) MPI_Comm_free(&leader_comm_);
+      if(node_comm_!=MPI_COMM_NULL) MPI_Comm_free(&node_comm_);
+    }
+
+    /// Creates the node communicators of reduce_comm_ and a shared window of
+    /// count elements per rank. Collective over reduce_comm_.
+    void SetupSharedWindow(size_t count){
+      if(node_comm_==MPI_COMM_NULL){
+        int rank; MPI_Comm_rank(reduce_comm_, &rank);
+        MPI_Comm_split_type(reduce_comm_, MPI_COMM_TYPE_SHARED, rank,
+            MPI_INFO_NULL, &node_comm_);
+        int node_rank; MPI_Comm_rank(node_comm_, &node_rank);
+        MPI_Comm_split(reduce_comm_, (node_rank==0) ? 0 : MPI_UNDEFINED,
+            rank, &leader_comm_);
+      }
+      if(count<=shm_count_) return;
+
+      FreeSharedWindow();
+      DT *base;
+      MPI_Win_allocate_shared(count*sizeof(DT), sizeof(DT), MPI_INFO_NULL,
+          node_comm_, &base, &shm_win_);
+      MPI_Win_lock_all(MPI_MODE_NOCHECK, shm_win_);
+      int node_size; MPI_Comm_size(node_comm_, &node_size);
+      shm_segs_.resize(node_size);
+      for(int i=0; i<node_size; ++i){
+        MPI_Aint size; int disp_unit;
+        MPI_Win_shared_query(shm_win_, i, &size, &disp_unit, &shm_segs_[i]);
+      }
+      shm_count_ = count;
+    }
+
+    /// Sums the replicas of the node in shared memory (every node rank sums
+    /// one stripe), allreduces the node sums among the node leaders and
+    /// copies the result back to dr.
+    void SharedInPlaceCombination(DataRegion2DBareBase<DT> &dr){
+      size_t n = dr.count();
+      SetupSharedWindow(n);
+      int node_rank, node_size;
+      MPI_Comm_rank(node_comm_, &node_rank);
+      MPI_Comm_size(node_comm_, &node_size);
+
+      Pack(dr, 0, dr.num_rows(), shm_segs_[node_rank]);
+      NodeSync();
+
+      size_t stripe = (n+node_size-1)/node_size;
+      size_t beg = std::min(n, node_rank*stripe);
+      size_t end = std::min(n, beg+stripe);
+      DT *sum = shm_segs_[0];
+      for(int i=1; i<node_size; ++i){
+        DT const *seg = shm_segs_[i];
+        for(size_t j=beg; j<end; ++j) sum[j] += seg[j];
+      }
+      NodeSync();
+
+      if(leader_comm_!=MPI_COMM_NULL)
+        AllreduceInPlace(sum, n, true, leader_comm_);
+      NodeSync();
+
+      Unpack(dr, 0, sum, 0, n);
+      /// Segment 0 is overwritten by the next combination
+      NodeSync();
+    }
+
+    static MPI_Datatype MPIType(){
+      if(std::is_same<float, DT>::value) return MPI_FLOAT;
+      else if(std::is_same<double, DT>::value) return MPI_DOUBLE;
+      else if(std::is_same<int, DT>::value) return MPI_INT;
+      else if(std::is_same<int64_t, DT>::value) return MPI_INT64_T;
+      else
+        throw std::runtime_error("Unknown data type for MPI collective call");
+    }
+
+    /// Rows are separate allocations; pack them into a contiguous buffer
+    static void Pack(DataRegion2DBareBase<DT> &dr, size_t beg_row,
+        size_t num_rows, DT *buf)
+    {
+      size_t cols = dr.num_cols();
+      for(size_t i=0; i<num_rows; ++i)
+        std::copy(&dr[beg_row+i][0], &dr[beg_row+i][0]+cols, buf+i*cols);
+    }
+
+    /// Unpacks elements [beg, end) of buf
+    static void Unpack(DataRegion2DBareBase<DT> &dr, size_t beg_row,
+        DT const *buf, size_t beg, size_t end)
+    {
+      size_t cols = dr.num_cols();
+      while(beg<end){
+        size_t row = beg/cols, col = beg%cols;
+        size_t n = std::min(cols-col, end-beg);
+        std::copy(buf+beg, buf+beg+n, &dr[beg_row+row][col]);
+        beg += n;
+      }
+    }
+
+    /// One allreduce over the packed replica (split only if it exceeds the
+    /// int count limit of MPI)
     void MPI_AllreduceInPlaceWithType(
         DataRegion2DBareBase<DT> &dr,
         MPI_Datatype input_type,
@@ -15,36 +299,286 @@ class DISPCommMPI : public DISPCommBase<DT> {
         MPI_Comm comm
         )
     {
-      for(size_t i=0; i<dr.num_rows(); i++)
-        MPI_Allreduce(MPI_IN_PLACE, &dr[i][0], dr.num_cols(), input_type,
+      staging_.resize(dr.count());
+      Pack(dr, 0, dr.num_rows(), staging_.data());
+      for(size_t beg=0; beg<staging_.size(); beg+=INT_MAX){
+        int n = static_cast<int>(std::min<size_t>(INT_MAX, staging_.size()-beg));
+        MPI_Allreduce(MPI_IN_PLACE, staging_.data()+beg, n, input_type,
             op_type, comm);
+      }
+      Unpack(dr, 0, staging_.data(), 0, staging_.size());
     }
 
   public:
     DISPCommMPI(int *argc, char ***argv){
-      MPI_Init(argc, argv);
+      /// Helper threads (e.g. asynchronous I/O) may issue MPI calls
+      /// concurrently with the main thread
+      MPI_Init_thread(argc, argv, MPI_THREAD_MULTIPLE, &thread_level_);
       MPI_Comm_rank(MPI_COMM_WORLD, &(this->rank_));
       MPI_Comm_size(MPI_COMM_WORLD, &(this->size_));
     }
 
     ~DISPCommMPI(){
-      MPI_Finalize(); 
+      for(size_t i=0; i<pending_.size(); ++i)
+        if(pending_[i].active) GlobalInPlaceCombinationWait(i);
+      FreeNodeComms();
+      if(half_op_!=MPI_OP_NULL) MPI_Op_free(&half_op_);
+      MPI_Finalize();
     }
 
     void Finalize(){}
 
+    /// Thread support level provided by the MPI library
+    int thread_level() const { return thread_level_; }
+
+    /// Restricts the global combinations to comm, e.g. to the ranks that
+    /// share the same slices. The communicator is not owned.
+    void reduce_comm(MPI_Comm comm) {
+      if(comm!=reduce_comm_) FreeNodeComms();
+      reduce_comm_ = comm;
+      NewWindow();
+    }
+    MPI_Comm reduce_comm() const { return reduce_comm_; }
+
+    /// Enables the shared-memory (node-aware) path of the global
+    /// combinations. The node communicators and the window are created by
+    /// the first combination.
+    void SharedMemoryCombination(bool enable) {
+      shm_enabled_ = enable;
+      if(!enable) FreeNodeComms();
+    }
+
+    /// Sends the values of the global combinations as bf16 or fp16
+    /// (DT=float only). Partial sums are rounded at every reduction step;
+    /// the node-aware path reduces only the inter-node allreduce.
+    void CombinationPrecision(DISPCommPrecision precision){
+      if(precision!=kDISPCommFP32 && !std::is_same<float, DT>::value)
+        throw std::invalid_argument("Reduced precision requires float replicas");
+      if(half_op_!=MPI_OP_NULL) MPI_Op_free(&half_op_);
+      precision_ = precision;
+      if(precision_==kDISPCommBF16) MPI_Op_create(&SumBF16, 1, &half_op_);
+      else if(precision_==kDISPCommFP16) MPI_Op_create(&SumFP16, 1, &half_op_);
+    }
+    DISPCommPrecision CombinationPrecision() const { return precision_; }
+
+    /// The replica holds interleaved (value, length) pairs, e.g. of SIRT,
+    /// and the lengths only depend on the projections of the window. They
+    /// are then combined (at full precision) by the first combination of
+    /// every row after NewWindow() and reused by the following ones.
+    /// The node-aware path (SharedMemoryCombination) combines them every
+    /// time.
+    void CacheLengths(bool enable){
+      cache_lengths_ = enable;
+      NewWindow();
+    }
+
+    /// The projections changed; lengths must be combined again
+    void NewWindow(){
+      lengths_valid_ = false;
+      lengths_rows_ = 0;
+    }
+
+    /// Stripe [beg, end) of n elements that is owned by member of
+    /// reduce_comm. Stripes are align*ceil(n/(align*size)) elements; the last
+    /// ones may be short or empty.
+    void StripeBounds(size_t n, size_t align, int member,
+        size_t &beg, size_t &end) const
+    {
+      int size; MPI_Comm_size(reduce_comm_, &size);
+      size_t block = align*((n+align*size-1)/(align*size));
+      beg = std::min(n, member*block);
+      end = std::min(n, beg+block);
+    }
+
+    /// Sums the replicas of reduce_comm, but every member only receives its
+    /// own stripe of the (row-major) summed replica in stripe. Returns the
+    /// first element of the stripe, see StripeBounds.
+    size_t GlobalReduceScatter(DataRegion2DBareBase<DT> &dr, size_t align,
+        std::vector<DT> &stripe)
+    {
+      int size, member;
+      MPI_Comm_size(reduce_comm_, &size);
+      MPI_Comm_rank(reduce_comm_, &member);
+      size_t n = dr.count();
+      size_t block = align*((n+align*size-1)/(align*size));
+      if(block>INT_MAX)
+        throw std::overflow_error("Reduce-scatter stripe exceeds int count");
+
+      /// Zero padded to size equal blocks
+      staging_.assign(block*size, 0);
+      Pack(dr, 0, dr.num_rows(), staging_.data());
+      stripe.resize(block);
+      MPI_Reduce_scatter_block(staging_.data(), stripe.data(),
+          static_cast<int>(block), MPIType(), MPI_SUM, reduce_comm_);
+
+      size_t beg, end;
+      StripeBounds(n, align, member, beg, end);
+      stripe.resize(end-beg);
+      return beg;
+    }
+
+    /// In-place allgather of the stripes (StripeBounds) of data[0, n)
+    void GlobalAllgather(DT *data, size_t n, size_t align){
+      int size; MPI_Comm_size(reduce_comm_, &size);
+      std::vector<int> counts(size), displs(size);
+      for(int i=0; i<size; ++i){
+        size_t beg, end;
+        StripeBounds(n, align, i, beg, end);
+        if(end>INT_MAX)
+          throw std::overflow_error("Allgather exceeds int displacement");
+        counts[i] = static_cast<int>(end-beg);
+        displs[i] = static_cast<int>(beg);
+      }
+      MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, data, counts.data(),
+          displs.data(), MPIType(), reduce_comm_);
+    }
+
+    /// Pipeline granularity of the non-blocking combination, in bytes
+    void ChunkSize(size_t bytes) {
+      chunk_count_ = std::max<size_t>(1, std::min<size_t>(bytes/sizeof(DT), INT_MAX));
+    }
+
     void GlobalInPlaceCombination(DataRegion2DBareBase<DT> &dr){
-      if(std::is_same<float, DT>::value)
-        MPI_AllreduceInPlaceWithType(dr, MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD);
-      else if(std::is_same<double, DT>::value)
-        MPI_AllreduceInPlaceWithType(dr, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-      else if(std::is_same<int, DT>::value)
-        MPI_AllreduceInPlaceWithType(dr, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
-      else if(std::is_same<int64_t, DT>::value)
-        MPI_AllreduceInPlaceWithType(dr, MPI_INT64_T, MPI_SUM, MPI_COMM_WORLD);
-      else 
-        throw std::runtime_error("Unknown data type for MPI collective call");
+      if(shm_enabled_){
+        SharedInPlaceCombination(dr);
+        return;
+      }
+      if(precision_!=kDISPCommFP32 || cache_lengths_){
+        CompressedInPlaceCombination(dr);
+        return;
+      }
+      MPI_AllreduceInPlaceWithType(dr, MPIType(), MPI_SUM, reduce_comm_);
+    }
+
+    /**
+     * Packs the rows and issues one MPI_Iallreduce per chunk, so the
+     * combination of early chunks is pipelined with the unpacking in
+     * GlobalInPlaceCombinationWait. The shared-memory path, the precision
+     * and the cached lengths are the ones of GlobalInPlaceCombination; the
+     * node sum is done here, only the inter-node allreduce is pipelined.
+     */
+    DISPCommHandle GlobalInPlaceCombinationStart(
+        DataRegion2DBareBase<DT> &dr, size_t beg_row, size_t num_rows)
+    {
+      if(beg_row+num_rows > dr.num_rows())
+        throw std::out_of_range("Combined rows are out of range!");
+
+      size_t id = 0;
+      while(id<pending_.size() && pending_[id].active) ++id;
+      if(id==pending_.size()) pending_.emplace_back();
+
+      Pending &p = pending_[id];
+      p.dr = &dr;
+      p.beg_row = beg_row;
+      p.num_rows = num_rows;
+      p.sum = nullptr;
+      p.values = false;
+      p.lengths = false;
+      p.active = true;
+      p.reqs.clear();
+      p.parts.clear();
+      size_t cols = dr.num_cols();
+      size_t n = num_rows*cols;
+      size_t off = beg_row*cols;
+
+      if(shm_enabled_){
+        /// Rows keep their offsets in the window, so that the node sums of
+        /// pending combinations do not overlap
+        SetupSharedWindow(dr.count());
+        int node_rank, node_size;
+        MPI_Comm_rank(node_comm_, &node_rank);
+        MPI_Comm_size(node_comm_, &node_size);
+        Pack(dr, beg_row, num_rows, shm_segs_[node_rank]+off);
+        NodeSync();
+        size_t stripe = (n+node_size-1)/node_size;
+        size_t beg = std::min(n, node_rank*stripe);
+        size_t end = std::min(n, beg+stripe);
+        p.sum = shm_segs_[0]+off;
+        for(int i=1; i<node_size; ++i){
+          DT const *seg = shm_segs_[i]+off;
+          for(size_t j=beg; j<end; ++j) p.sum[j] += seg[j];
+        }
+        NodeSync();
+        if(leader_comm_!=MPI_COMM_NULL)
+          IssueChunks(p, p.sum, n, true, leader_comm_);
+      }
+      else if(cache_lengths_){
+        if(cols%2!=0)
+          throw std::invalid_argument("Replica does not hold (value, length) pairs");
+        p.buf.resize(n);
+        Pack(dr, beg_row, num_rows, p.buf.data());
+        p.values = true;
+        p.lengths = !lengths_valid_;
+        if(p.lengths){
+          lengths_.resize(dr.count()/2);
+          for(size_t i=0; i<n/2; ++i) lengths_[off/2+i] = p.buf[2*i+1];
+        }
+        for(size_t i=0; i<n/2; ++i) p.buf[i] = p.buf[2*i];
+        p.buf.resize(n/2);
+        IssueChunks(p, p.buf.data(), n/2, true, reduce_comm_);
+        if(p.lengths)
+          IssueChunks(p, lengths_.data()+off/2, n/2, false, reduce_comm_);
+      }
+      else{
+        p.buf.resize(n);
+        Pack(dr, beg_row, num_rows, p.buf.data());
+        IssueChunks(p, p.buf.data(), n, true, reduce_comm_);
+      }
+
+      /// Give outstanding combinations a chance to progress
+      for(auto &q : pending_){
+        int flag;
+        if(q.active && &q!=&p && !q.reqs.empty())
+          MPI_Testall(q.reqs.size(), q.reqs.data(), &flag, MPI_STATUSES_IGNORE);
+      }
+
+      return static_cast<DISPCommHandle>(id);
+    }
+
+    void GlobalInPlaceCombinationWait(DISPCommHandle handle){
+      if(handle<0 || static_cast<size_t>(handle)>=pending_.size() ||
+         !pending_[handle].active)
+        throw std::invalid_argument("Invalid global combination handle!");
+
+      Pending &p = pending_[handle];
+      DataRegion2DBareBase<DT> &dr = *p.dr;
+      size_t cols = dr.num_cols();
+      size_t n = p.num_rows*cols;
+      bool plain = (p.sum==nullptr && !p.values);
+      /// Parts complete in order; completed requests are MPI_REQUEST_NULL
+      /// and return immediately. Plain rows are unpacked chunk by chunk.
+      for(size_t i=0; i<p.reqs.size(); ++i){
+        MPI_Wait(&p.reqs[i], MPI_STATUS_IGNORE);
+        Part const &part = p.parts[i];
+        if(part.half!=nullptr) FromHalf(part.half, part.data, part.n);
+        if(plain){
+          size_t beg = part.data-p.buf.data();
+          Unpack(dr, p.beg_row, p.buf.data(), beg, beg+part.n);
+        }
+      }
 
+      if(p.sum!=nullptr){
+        NodeSync();
+        Unpack(dr, p.beg_row, p.sum, 0, n);
+        /// The node sum is overwritten by the next combination of the rows
+        NodeSync();
+      }
+      else if(p.values){
+        size_t off = p.beg_row*cols/2;
+        std::vector<DT> &pairs = staging_;
+        pairs.resize(n);
+        for(size_t i=0; i<n/2; ++i){
+          pairs[2*i] = p.buf[i];
+          pairs[2*i+1] = lengths_[off+i];
+        }
+        Unpack(dr, p.beg_row, pairs.data(), 0, n);
+        if(p.lengths){
+          lengths_rows_ += p.num_rows;
+          if(lengths_rows_>=dr.num_rows()) lengths_valid_ = true;
+        }
+      }
+      p.active = false;
+      p.dr = nullptr;
     }
 };
 
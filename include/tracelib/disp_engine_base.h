@@ -62,6 +62,7 @@ class DISPEngineBase{
     virtual void SeqInPlaceLocalSynchWrapper() = 0;
     virtual void ParInPlaceLocalSynchWrapper() = 0;
     virtual void DistInPlaceGlobalSynchWrapper() = 0;
+    virtual void ParInPlaceLocalGlobalSynchWrapper(int num_blocks) = 0;
     virtual void ResetReductionSpaces(DT &val) = 0;
 
     int num_procs() const {return num_procs_;};
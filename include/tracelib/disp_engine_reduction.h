@@ -4,7 +4,9 @@
 #include "disp_engine_base.h"
 #include "mirrored_region_bare_base.h"
 #include "reduction_space_a.h"
+#include "trace_span.h"
 #include <deque>
+#include <algorithm>
 
 template <typename RST, typename DT>
 class DISPEngineReduction : public DISPEngineBase<RST, DT>{
@@ -20,6 +22,7 @@ class DISPEngineReduction : public DISPEngineBase<RST, DT>{
     virtual MirroredRegionBareBase<DT>* PartitionWrapper(
         ADataRegion<DT> &input_data, int req_units)
     {
+      TRACE_SPAN_DETAIL("partition");   /// Includes waiting for the lock
       std::lock_guard<std::mutex> lock(this->partitioner_mutex_);
       return Partitioner(input_data, req_units);
     }
@@ -37,9 +40,14 @@ class DISPEngineReduction : public DISPEngineBase<RST, DT>{
         ADataRegion<DT> &input_data, 
         int &req_units)
     {
+      trace_span::ThreadName("reduction");
+      TRACE_SPAN("reduction thread");
       auto output_data = PartitionWrapper(input_data, req_units);
       while(output_data != nullptr){
-        reduction_space.Process(*output_data);
+        {
+          TRACE_SPAN_DETAIL("process");
+          reduction_space.Process(*output_data);
+        }
         output_data = PartitionWrapper(input_data, req_units);
       }
     }
@@ -75,9 +83,67 @@ class DISPEngineReduction : public DISPEngineBase<RST, DT>{
     virtual void DistInPlaceGlobalSynchWrapper(){
      AReductionSpaceBase<RST, DT> &head_rs = *(this->reduction_spaces_)[0];
      DataRegion2DBareBase<DT> &dr = head_rs.reduction_objects();
+     TRACE_SPAN("global combine");
      GlobalInPlaceSynch(dr, *(this->comm_)); 
     };
 
+    /// Non-blocking global combination of rows [beg_row, beg_row+num_rows)
+    /// of the head reduction space
+    virtual DISPCommHandle DistInPlaceGlobalSynchStart(
+        size_t beg_row, size_t num_rows)
+    {
+      AReductionSpaceBase<RST, DT> &head_rs = *(this->reduction_spaces_)[0];
+      return this->comm_->GlobalInPlaceCombinationStart(
+          head_rs.reduction_objects(), beg_row, num_rows);
+    }
+
+    virtual void DistInPlaceGlobalSynchWait(DISPCommHandle handle){
+      this->comm_->GlobalInPlaceCombinationWait(handle);
+    }
+
+    /// Combines rows [beg_row, beg_row+num_rows) of all reduction spaces
+    /// into the head reduction space; rows are split among threads
+    void ParInPlaceLocalSynchRows(size_t beg_row, size_t num_rows,
+        int num_threads)
+    {
+      auto &spaces = this->reduction_spaces_;
+      RST &head = *static_cast<RST *>(spaces[0]);
+      size_t per_thread = (num_rows+num_threads-1)/num_threads;
+
+      std::vector<std::thread> worker_threads;
+      for(size_t beg=beg_row; beg<beg_row+num_rows; beg+=per_thread){
+        size_t n = std::min(per_thread, beg_row+num_rows-beg);
+        worker_threads.push_back(std::thread([&spaces, &head, beg, n]{
+          trace_span::ThreadName("combination");
+          TRACE_SPAN("local combine thread");
+          for(size_t i=1; i<spaces.size(); i++)
+            head.LocalSynchWith(*static_cast<RST *>(spaces[i]), beg, n);
+        }));
+      }
+      for(auto &worker_thread : worker_threads)
+        worker_thread.join();
+    }
+
+    /// Local and global combination pipelined over num_blocks row blocks:
+    /// the global combination of a block overlaps with the local
+    /// combination of the following blocks.
+    virtual void ParInPlaceLocalGlobalSynchWrapper(int num_blocks){
+      auto &dr = this->reduction_spaces_[0]->reduction_objects();
+      size_t rows = dr.num_rows();
+      if(rows==0) return;
+      num_blocks = std::max(1, std::min(num_blocks, static_cast<int>(rows)));
+      size_t block_rows = (rows+num_blocks-1)/num_blocks;
+
+      std::vector<DISPCommHandle> handles;
+      for(size_t beg=0; beg<rows; beg+=block_rows){
+        size_t n = std::min(block_rows, rows-beg);
+        ParInPlaceLocalSynchRows(beg, n, this->num_reduction_threads_);
+        handles.push_back(DistInPlaceGlobalSynchStart(beg, n));
+      }
+      for(auto handle : handles)
+        DistInPlaceGlobalSynchWait(handle);
+    }
+
     virtual void SeqInPlaceLocalSynchWrapper(){
       SeqInPlaceLocalSynch(this->reduction_spaces_);
     };
@@ -85,6 +151,8 @@ class DISPEngineReduction : public DISPEngineBase<RST, DT>{
     void ParInPlaceLocalSynchHelper(
         std::deque<std::vector<AReductionSpaceBase<RST, DT> *>*> &work_queue)
     {
+      trace_span::ThreadName("combination");
+      TRACE_SPAN("local combine thread");
       while(1){
         work_queue_mutex.lock();
         if(work_queue.size()>0){
@@ -166,8 +234,45 @@ class DISPEngineReduction : public DISPEngineBase<RST, DT>{
       ParInPlaceLocalSynch(this->reduction_spaces_, 2, this->num_reduction_threads_);
     }
 
+    /// Row-action reduction: the chunks are partitioned up front and every
+    /// thread processes the chunks it owns, in input order
+    virtual void RunOwnedReduction(ADataRegion<DT> &input_data, int req_units)
+    {
+      int num_threads = this->num_reduction_threads_;
+      auto &head = *(this->reduction_spaces_)[0];
+      std::vector<std::vector<MirroredRegionBareBase<DT>*>> owned(num_threads);
+      {
+        TRACE_SPAN_DETAIL("partition");
+        for(auto chunk = Partitioner(input_data, req_units); chunk != nullptr;
+            chunk = Partitioner(input_data, req_units))
+          owned[head.Owner(*chunk)%num_threads].push_back(chunk);
+      }
+
+      std::vector<std::thread> reduction_threads;
+      for(int i=0; i<num_threads; i++){
+        auto &reduction_space = *(this->reduction_spaces_)[i];
+        auto &chunks = owned[i];
+        reduction_threads.push_back(std::thread([&reduction_space, &chunks]{
+          trace_span::ThreadName("reduction");
+          TRACE_SPAN("reduction thread");
+          for(auto chunk : chunks){
+            TRACE_SPAN_DETAIL("process");
+            reduction_space.Process(*chunk);
+          }
+        }));
+      }
+
+      for(auto &reduction_thread : reduction_threads)
+        reduction_thread.join();
+    }
+
     virtual void RunParallelReduction(ADataRegion<DT> &input_data, int req_units)
     {
+      if((this->reduction_spaces_)[0]->RowAction()){
+        RunOwnedReduction(input_data, req_units);
+        return;
+      }
+
       // Create threads
       std::vector<std::thread> reduction_threads;
       for(int i=0; i<this->num_reduction_threads_; i++){
@@ -0,0 +1,76 @@
+#ifndef DISP_APPS_RECONSTRUCTION_SIRT_FBP_H
+#define DISP_APPS_RECONSTRUCTION_SIRT_FBP_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include "trace_data.h"
+#include "trace_fft.h"
+#include "reduction_space_a.h"
+#include "data_region_base.h"
+
+/**
+ * Filtered backprojection for previews and warm starts.
+ *
+ * Every projection row is filtered with a ramp filter through a
+ * zero-padded real FFT and backprojected pixel by pixel, with linear
+ * interpolation, into its slice of metadata.recon(), in the geometry of
+ * the ray-driven spaces (same center and pixel grid). Like ARTReconSpace
+ * the space is row-action: the engine gives all rows of a slice to one
+ * thread and no replicas are combined. The own slices must be zeroed
+ * before a window is backprojected.
+ *
+ * The rows are weighted with pi/num_projs, i.e. the window's angles are
+ * assumed to cover 180 degrees evenly. If the projections of a window are
+ * split among several ranks, WindowProjections() gives their total, so
+ * that the partial images of the ranks add up to the window's image.
+ */
+class FBPReconSpace : 
+  public AReductionSpaceBase<FBPReconSpace, float>
+{
+  public:
+    enum Filter {
+      kRamp = 0,      /// Ram-Lak
+      kSheppLogan,    /// Ramp * sinc
+      kCosine,
+      kHamming,
+      kHann
+    };
+
+    static Filter ParseFilter(std::string const &name);
+
+  private:
+    FBPReconSpace *main_ = this;    /// Holds the window's projection count
+    int window_projs_ = 0;
+    int num_cols_ = 0;
+    Filter filter_ = kRamp;
+    std::unique_ptr<trace_utils::RealFFT> fft_;
+    std::vector<float> response_;   /// Real filter, n/2+1 coefficients
+    std::vector<float> filtered_;   /// Filtered row
+
+    void FilterRow(float const *row);
+    void Backproject(float *slice, float theta, float center, float weight);
+
+  public:
+    /// rows x cols reduction objects are allocated but not used, e.g. 1x1
+    FBPReconSpace(int rows, int cols) : 
+      AReductionSpaceBase<FBPReconSpace, float>(rows, cols) {}
+
+    void Reduce(MirroredRegionBareBase<float> &input);
+
+    virtual bool RowAction() const { return true; }
+    /// Slice of the chunk
+    virtual int Owner(MirroredRegionBareBase<float> &input);
+
+    /// Sets up the FFT and the filter for rows of num_cols rays
+    void Initialize(int num_cols, Filter filter);
+    /// Projections of the whole window; 0 uses the projections of the
+    /// input. Must be set on the space the engine was created with.
+    void WindowProjections(int num_projs) { window_projs_ = num_projs; }
+    virtual void CopyTo(FBPReconSpace &target){
+      target.Initialize(num_cols_, filter_);
+      target.main_ = main_;
+    }
+};
+
+#endif    // DISP_APPS_RECONSTRUCTION_SIRT_FBP_H
@@ -0,0 +1,48 @@
+#ifndef DISP_APPS_RECONSTRUCTION_SIRT_MLEM_H
+#define DISP_APPS_RECONSTRUCTION_SIRT_MLEM_H
+
+#include "sirt.h"
+
+/**
+ * MLEM reconstruction; OSEM with ordered subsets.
+ *
+ * Shares the ray tracing and the (value, length) replica layout of
+ * SIRTReconSpace: a ray adds ratio*leng and leng to the pairs of its
+ * pixels, where ratio is the measured over the simulated ray sum, so a
+ * combined pair holds the backprojected ratios and the sensitivity of the
+ * pixel. The update multiplies every pixel with value/length. The image
+ * must start positive; pixels at zero stay at zero.
+ */
+class MLEMReconSpace : public SIRTReconSpace
+{
+  protected:
+    virtual void UpdateReconReplica(
+        float simdata,
+        float ray,
+        int curr_slice,
+        int const * const indi,
+        float *leng2,
+        float *leng, 
+        int len);
+
+  public:
+    MLEMReconSpace(int rows, int cols) : SIRTReconSpace(rows, cols) {}
+
+    /// SIRTReconSpace::UpdateRecon applies this to every replica row
+    virtual void UpdateReconStripe(
+        ADataRegion<float> &recon,
+        float const *stripe,
+        size_t beg, size_t end,
+        size_t recon_offset=0);
+
+    /// Replicas of the engine threads must be MLEM spaces too
+    virtual MLEMReconSpace *Clone(){
+      auto &red_objs = reduction_objects();
+      auto cloned_obj = new MLEMReconSpace(red_objs.rows(), red_objs.cols());
+      cloned_obj->reduction_objects() = red_objs;
+      CopyTo(*cloned_obj);
+      return cloned_obj;
+    }
+};
+
+#endif    // DISP_APPS_RECONSTRUCTION_SIRT_MLEM_H
@@ -18,18 +18,31 @@ class AReductionSpaceBase{
 
     // Default operation is sum
     virtual void LocalSynchWith(CT &input_reduction_space) {
+      LocalSynchWith(input_reduction_space, 0, reduction_objects_->num_rows());
+    };
+
+    // Combines only rows [beg_row, beg_row+num_rows)
+    virtual void LocalSynchWith(CT &input_reduction_space, 
+        size_t beg_row, size_t num_rows) {
       auto &ri = input_reduction_space.reduction_objects();
       auto &ro = *reduction_objects_;
 
       if(ri.num_rows()!=ro.num_rows() || ri.num_cols()!=ro.num_cols())
         throw std::range_error("Local and destination reduction objects have different dimension sizes!");
 
-      for(size_t i=0; i<ro.num_rows(); i++)
+      for(size_t i=beg_row; i<beg_row+num_rows; i++)
         for(size_t j=0; j<ro.num_cols(); j++)
           ro[i][j] += ri[i][j];
     };
 
 
+    // Row-action spaces update the shared image in Reduce instead of their
+    // reduction objects. The engine then gives every input chunk to the
+    // thread of its Owner() key, so chunks with the same key are processed
+    // in input order by a single thread and no replicas are combined.
+    virtual bool RowAction() const { return false; };
+    virtual int Owner(MirroredRegionBareBase<DT> &) { return 0; };
+
     // Derived class can use this function to perform
     // deep copies
     virtual void CopyTo(CT &target)=0;
@@ -39,7 +39,13 @@ class SIRTReconSpace :
         int *indi,
         float *leng);
 
-    void UpdateReconReplica(
+    // Image slice that the rays of curr_slice are forward projected through;
+    // the reconstruction by default
+    virtual float *ProjectedSlice(TraceMetadata &metadata, int curr_slice);
+
+    // Accumulates the ray into the replica of curr_slice; overridden by
+    // algorithms that share the (value, length) replica layout
+    virtual void UpdateReconReplica(
         float simdata,
         float ray,
         int curr_slice,
@@ -58,9 +64,21 @@ class SIRTReconSpace :
 
     void Reduce(MirroredRegionBareBase<float> &input);
     // Backward Projection
-    void UpdateRecon(
+    // recon_offset: first own pixel of recon, i.e. after the halo slices
+    virtual void UpdateRecon(
         ADataRegion<float> &recon,                  // Reconstruction object
-        DataRegion2DBareBase<float> &comb_replica); // Locally combined replica
+        DataRegion2DBareBase<float> &comb_replica,  // Locally combined replica
+        size_t recon_offset=0);
+    /* Same as UpdateRecon, but only for elements [beg, end) of the row-major
+     * combined replica, e.g. the stripe owned after a reduce-scatter. beg
+     * and end must be even, i.e. not split (value, length) pairs.
+     * @param stripe  Combined replica elements [beg, end)
+     */
+    virtual void UpdateReconStripe(
+        ADataRegion<float> &recon,
+        float const *stripe,
+        size_t beg, size_t end,
+        size_t recon_offset=0);
 
 
     void Initialize(int n_grids);
@@ -0,0 +1,95 @@
+#ifndef DISP_APPS_RECONSTRUCTION_COMMON_TRACE_CHECKPOINT_H
+#define DISP_APPS_RECONSTRUCTION_COMMON_TRACE_CHECKPOINT_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <cstdint>
+#include "trace_mq.h"
+
+namespace trace_io {
+
+  /// Streaming reconstruction state of a rank
+  struct CheckpointState {
+    int32_t rank = 0;
+    int32_t size = 1;
+    uint32_t beg_sinogram = 0;    /// Sinograms of the rank
+    uint32_t n_sinograms = 0;
+    uint32_t n_rays = 0;          /// Rays per projection row
+    int64_t passes = 0;           /// Next window (pass) to reconstruct
+    uint64_t counter = 0;         /// Received projections
+    std::vector<float> image;     /// Own slices, without halo slices
+    std::vector<float> proj;      /// Window projections, see TraceStream
+    std::vector<float> theta;
+    std::vector<tomo_msg_data_t> meta;
+  };
+
+  /**
+   * File layout: a fixed CheckpointHeader followed by the image, proj,
+   * theta and meta arrays at 64-byte aligned offsets, so that a file can be
+   * mapped and its arrays used in place. Native byte order.
+   */
+  struct CheckpointHeader {
+    char magic[8];                /// "TRCCKPT\0"
+    uint32_t version;
+    int32_t rank;
+    int32_t size;
+    uint32_t beg_sinogram;
+    uint32_t n_sinograms;
+    uint32_t n_rays;
+    int64_t passes;
+    uint64_t counter;
+    uint64_t meta_size;           /// sizeof(tomo_msg_data_t) of the writer
+    uint64_t offsets[4];          /// Byte offsets of image, proj, theta, meta
+    uint64_t counts[4];           /// Element counts of the arrays
+    uint64_t file_size;
+  };
+
+  /// <dir>/ckpt-<rank>.bin
+  std::string CheckpointPath(std::string const &dir, int rank);
+
+  /// Writes state to path through a temporary file that is renamed over
+  /// path, so path always holds a complete checkpoint.
+  void WriteCheckpoint(std::string const &path, CheckpointState const &state);
+
+  /// Maps the checkpoint at path and copies it into state. Throws
+  /// std::runtime_error if the file is missing, truncated, corrupt or
+  /// incompatible.
+  void ReadCheckpoint(std::string const &path, CheckpointState &state);
+
+  /**
+   * Writes checkpoints of a rank from a background thread.
+   *
+   * Submit() hands over a snapshot and returns. If the previous checkpoint
+   * is still being written, the new snapshot waits for it; a snapshot that
+   * is still waiting is replaced by a newer one, i.e. only the latest state
+   * is ever written.
+   */
+  class AsyncCheckpointer {
+    private:
+      std::string path_;
+      std::unique_ptr<CheckpointState> pending_;
+      bool stop_ = false;
+      uint64_t written_ = 0;
+      std::mutex mutex_;
+      std::condition_variable cv_;
+      std::thread io_thread_;
+
+      void IOLoop();
+
+    public:
+      AsyncCheckpointer(std::string const &dir, int rank);
+      ~AsyncCheckpointer();   /// Writes the pending snapshot
+
+      AsyncCheckpointer(const AsyncCheckpointer&) = delete;
+      AsyncCheckpointer& operator=(const AsyncCheckpointer&) = delete;
+
+      void Submit(std::unique_ptr<CheckpointState> state);
+      uint64_t written();
+  };
+}
+
+#endif /// DISP_APPS_RECONSTRUCTION_COMMON_TRACE_CHECKPOINT_H
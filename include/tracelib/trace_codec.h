@@ -0,0 +1,85 @@
+#ifndef TRACE_COMMONS_STREAM_TRACE_CODEC_H
+#define TRACE_COMMONS_STREAM_TRACE_CODEC_H
+
+/*
+ * Projection payload codecs shared by the distributor (C) and the
+ * reconstruction workers (C++).
+ *
+ * LZ4 and Zstd support is compiled in with TRACE_HAVE_LZ4/TRACE_HAVE_ZSTD.
+ * Bitshuffle is implemented here: it transposes the bits of every 4-byte
+ * element so that the (mostly constant) sign/exponent/high mantissa bits of
+ * detector counts stored as float32 form long runs that LZ4 compresses well.
+ * Trailing bytes of a partial element are stored as they are.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TRACE_CODEC_NONE       0
+#define TRACE_CODEC_LZ4        1
+#define TRACE_CODEC_ZSTD       2
+#define TRACE_CODEC_BSHUF_LZ4  3
+#define TRACE_CODEC_COUNT      4
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bit mask of the codecs built into this library, (1u<<TRACE_CODEC_*) */
+uint32_t trace_codec_supported(void);
+
+/* Returns the codec name, e.g. "bshuf-lz4", or "unknown" */
+const char* trace_codec_name(uint32_t codec);
+
+/* Returns TRACE_CODEC_* for name, or -1 if name is not a known codec */
+int trace_codec_from_name(const char *name);
+
+/* Upper bound of the compressed size of raw_size bytes */
+size_t trace_codec_bound(uint32_t codec, size_t raw_size);
+
+/*
+ * Compresses raw_size bytes of src into dst (dst_cap bytes).
+ * level: LZ4 acceleration factor, or Zstd compression level; <=0 selects
+ * the default. Allocates its state on every call, see trace_codec_ctx_t.
+ *
+ * Returns the compressed size, or 0 on failure.
+ */
+size_t trace_codec_compress(uint32_t codec, const void *src, size_t raw_size,
+                            void *dst, size_t dst_cap, int level);
+
+/*
+ * Decompresses comp_size bytes of src into dst, which must hold exactly
+ * raw_size bytes.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int trace_codec_decompress(uint32_t codec, const void *src, size_t comp_size,
+                           void *dst, size_t raw_size);
+
+/*
+ * Reusable state of the calls of one thread: the bitshuffle scratch buffer
+ * and the Zstd contexts. It grows to the largest message it has seen, so a
+ * thread that keeps its context does not allocate per message.
+ */
+typedef struct trace_codec_ctx trace_codec_ctx_t;
+
+trace_codec_ctx_t* trace_codec_ctx_create(void);
+void trace_codec_ctx_free(trace_codec_ctx_t *ctx);
+
+/* trace_codec_compress and trace_codec_decompress with the state of ctx */
+size_t trace_codec_compress_ctx(trace_codec_ctx_t *ctx, uint32_t codec,
+                                const void *src, size_t raw_size,
+                                void *dst, size_t dst_cap, int level);
+int trace_codec_decompress_ctx(trace_codec_ctx_t *ctx, uint32_t codec,
+                               const void *src, size_t comp_size,
+                               void *dst, size_t raw_size);
+
+/* Out-of-place bit (un)shuffle of n 4-byte elements; exposed for testing */
+void trace_bitshuffle4(const void *src, void *dst, size_t n);
+void trace_bitunshuffle4(const void *src, void *dst, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TRACE_COMMONS_STREAM_TRACE_CODEC_H
@@ -1,13 +1,96 @@
 #ifndef DISP_APPS_RECONSTRUCTION_COMMON_TRACE_COMM_H_
 #define DISP_APPS_RECONSTRUCTION_COMMON_TRACE_COMM_H_
 
+#include <vector>
+#include <cstdint>
+#include "mpi.h"
 #include "data_region_a.h"
 
 namespace trace_comm {
   void GlobalNeighborUpdate(
       ADataRegion<float> &recon_a,
       int num_slices,
-      size_t slice_size);
+      size_t slice_size,
+      MPI_Comm comm);
+
+  /**
+   * Moves rows between ranks after the row (e.g. sinogram or slice) ranges
+   * of the ranks change.
+   *
+   * Ranges are (beg, n) pairs of every rank of comm. src holds num_blocks
+   * blocks of the n old rows of this rank, dst receives num_blocks blocks
+   * of its n new rows, e.g. the projections of a window (num_blocks
+   * projections) or an image (1 block). Rows are row_size floats.
+   */
+  void MigrateRows(
+      float const *src,
+      float *dst,
+      size_t row_size,
+      int num_blocks,
+      std::vector<uint32_t> const &old_ranges,
+      std::vector<uint32_t> const &new_ranges,
+      MPI_Comm comm);
+
+  /**
+   * Exchange of the neighboring (halo) reconstruction slices between ranks
+   * that reconstruct consecutive slabs.
+   *
+   * The image is laid out as [depth halo slices][num_slices own slices]
+   * [depth halo slices], i.e. TraceMetadata::num_neighbor_recon_slices() is
+   * depth. Rank i-1 of comm holds the slab above and rank i+1 the slab
+   * below; the first and last ranks have a single neighbor.
+   *
+   * The requests are persistent (MPI_Send_init/MPI_Recv_init): Start()
+   * initiates the exchange, e.g. after the image is updated, and Wait()
+   * completes it right before the halo is read or the own boundary slices
+   * are modified again.
+   */
+  class HaloExchange {
+    private:
+      MPI_Comm comm_;
+      int depth_;
+      bool has_top_ = false;      /// Top halo is received from rank-1
+      bool has_bottom_ = false;   /// Bottom halo is received from rank+1
+      MPI_Request requests_[4];
+      int num_requests_ = 0;
+      bool active_ = false;
+
+    public:
+      HaloExchange(
+          float *recon,
+          int num_slices,
+          size_t slice_size,
+          int depth,
+          MPI_Comm comm);
+      ~HaloExchange();
+
+      HaloExchange(HaloExchange const &) = delete;
+      HaloExchange& operator=(HaloExchange const &) = delete;
+
+      void Start();
+      void Wait();
+      /// Returns true if the started exchange completed
+      bool Test();
+
+      int depth() const { return depth_; }
+      bool has_top() const { return has_top_; }
+      bool has_bottom() const { return has_bottom_; }
+  };
+
+  /**
+   * Smoothing step along the slice axis, which couples the otherwise
+   * independent slices: every own slice moves by beta*(above-2*own+below),
+   * with the old values of its neighbors. The first and last own slices
+   * read the nearest halo slices; at the ends of the volume, where halo
+   * has no neighbor, the slice itself is used instead. The exchange of
+   * halo must be completed. beta<=0.5 keeps the step stable.
+   */
+  void SmoothSlices(
+      float *recon,
+      int num_slices,
+      size_t slice_size,
+      HaloExchange const &halo,
+      float beta);
 }
 
 #endif /// DISP_APPS_RECONSTRUCTION_COMMON_TRACE_COMM_H_
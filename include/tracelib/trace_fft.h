@@ -0,0 +1,59 @@
+#ifndef DISP_APPS_RECONSTRUCTION_COMMON_TRACE_FFT_H
+#define DISP_APPS_RECONSTRUCTION_COMMON_TRACE_FFT_H
+
+#include <cstddef>
+#include <complex>
+#include <vector>
+
+namespace trace_utils {
+
+  /**
+   * Real-to-complex FFT of a fixed power-of-two length n.
+   *
+   * Transforms the n reals of real() into the n/2+1 coefficients of
+   * spectrum() and back. Uses FFTW (single precision) if the build found it
+   * (TRACE_HAVE_FFTW), otherwise a radix-2 transform: the n reals are
+   * packed into n/2 complex values, transformed and split into the
+   * spectrum of the real sequence.
+   *
+   * An instance is not thread safe; use one per thread.
+   */
+  class RealFFT {
+    private:
+      size_t n_;
+      float *real_ = nullptr;
+      std::complex<float> *spectrum_ = nullptr;
+#ifdef TRACE_HAVE_FFTW
+      void *forward_plan_ = nullptr;
+      void *inverse_plan_ = nullptr;
+#else
+      std::vector<std::complex<float>> work_;     /// n/2 points
+      std::vector<std::complex<float>> twiddles_; /// exp(-2 pi i k/n), k<n/2
+      std::vector<size_t> bitrev_;                /// Of the n/2 points
+
+      void Radix2(bool inverse);
+#endif
+
+    public:
+      /// Throws std::invalid_argument if n is not a power of two >= 4
+      explicit RealFFT(size_t n);
+      ~RealFFT();
+
+      RealFFT(const RealFFT&) = delete;
+      RealFFT& operator=(const RealFFT&) = delete;
+
+      size_t size() const { return n_; }
+      float *real() { return real_; }
+      std::complex<float> *spectrum() { return spectrum_; }
+
+      /// real() -> spectrum()
+      void Forward();
+      /// spectrum() -> real(), scaled by 1/n, i.e. Forward() is inverted
+      void Inverse();
+  };
+
+  /// Smallest power of two >= n
+  size_t NextPowerOfTwo(size_t n);
+}
+
+#endif /// DISP_APPS_RECONSTRUCTION_COMMON_TRACE_FFT_H
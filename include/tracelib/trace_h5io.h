@@ -2,7 +2,7 @@
 #define DISP_APPS_RECONSTRUCTION_COMMON_H5IO_H 
 
 #include "hdf5.h"
-#include "mpi.h"
+#include "trace_mpi.h"
 #include "trace_data.h"
 
 namespace trace_io {
@@ -23,6 +23,16 @@ namespace trace_io {
     H5Metadata *metadata;
   } H5Data;
 
+  /// Open time-series output, see CreateSeries()
+  typedef struct {
+    hid_t file_id;
+    hid_t dset_id;        /// [time, slices, rows, cols] image dataset
+    hid_t steps_id;       /// [time] iteration number of each time step
+    hsize_t n_steps;      /// Number of appended time steps
+    hsize_t dims[3];      /// Dimensions of a single time step
+    int rank;             /// Rank in the writer communicator
+  } H5Series;
+
   void DistributeSlices(
       int mpi_rank, int mpi_size,
       int n_dblocks, int &beg_index, int &n_assigned_blocks);
@@ -39,6 +49,27 @@ namespace trace_io {
   H5Data* ReadProjections(H5Metadata *metadata_p,
       int beg_projection, int count, int filter_id);
 
+  /// Reads slices [beg_slice, beg_slice+count) of all projections of a
+  /// [projection, slice, column] dataset as float directly in sinogram
+  /// order [slice, projection, column] into sinograms, which must hold
+  /// count*dims[0]*dims[2] floats. Each slice is a separate strided read
+  /// into its place in memory, so no transposed copy is made.
+  void ReadSinograms(
+      H5Metadata *metadata_p,
+      int beg_slice, int count,
+      float *sinograms);
+
+  /// Collectively reads slices [beg_slice, beg_slice+count) of all
+  /// projections of a [projection, slice, column] dataset as float into
+  /// slices, in [projection, slice, column] order; slices must hold
+  /// dims[0]*count*dims[2] floats. All ranks of comm must call it, count may
+  /// be 0. Projections are read in blocks of whole chunks.
+  void ReadSlicesCollective(
+      H5Metadata *metadata_p,
+      int beg_slice, int count,
+      MPI_Comm comm, MPI_Info info,
+      float *slices);
+
   void WriteData(
       float *recon, /* Data values */
       hsize_t ndims, hsize_t *dims, /* This process' dimension values */
@@ -48,6 +79,30 @@ namespace trace_io {
       char const *file_name, char const *dataset_name,
       MPI_Comm comm, MPI_Info info, H5FD_mpio_xfer_t mpio_xfer_flag);
 
+  /// Collectively creates file_name with an extendable dataset of
+  /// dimensions [H5S_UNLIMITED, dataset_dims[0..2]]. Chunks hold one slice
+  /// of one time step, so every rank writes whole chunks. filter_id=0 stores
+  /// raw data, 1 uses deflate with filter_level, any other value is passed
+  /// to H5Pset_filter. An iteration number is kept per time step in
+  /// dataset_name + "_steps".
+  H5Series* CreateSeries(
+      char const *file_name, char const *dataset_name,
+      hsize_t *dataset_dims,
+      int filter_id, unsigned int filter_level,
+      MPI_Comm comm, MPI_Info info);
+
+  /// Collectively extends the series by one time step and writes this
+  /// process' slices [slice_id, slice_id+dims[0]) into it.
+  void AppendSeries(
+      H5Series *series,
+      float *recon, hsize_t *dims, /* This process' data and dimensions */
+      int slice_id,
+      int64_t step,                /* Iteration number of this time step */
+      H5FD_mpio_xfer_t mpio_xfer_flag);
+
+  /// Collectively closes the file and frees series.
+  void CloseSeries(H5Series *series);
+
   /// Calls WriteRecon with mpio_xfer_flag=H5FD_MPIO_COLLECTIVE, i.e. default
   /// transfer type is collectie io.
   void WriteRecon(
@@ -0,0 +1,88 @@
+#ifndef DISP_APPS_RECONSTRUCTION_COMMON_TRACE_HALF_H
+#define DISP_APPS_RECONSTRUCTION_COMMON_TRACE_HALF_H
+
+#include <cstdint>
+#include <cstring>
+
+/*
+ * 16-bit floating point storage formats for reduced-precision
+ * communication. Conversions from float round to nearest even.
+ *
+ * bf16 keeps the float exponent (8 bits) and 7 mantissa bits, so it has the
+ * range of float. fp16 (IEEE binary16) has 10 mantissa bits but overflows
+ * to infinity above 65504.
+ */
+namespace trace_half {
+  inline uint16_t FloatToBF16(float f){
+    uint32_t x; std::memcpy(&x, &f, sizeof(x));
+    if((x & 0x7fffffffu) > 0x7f800000u)   /// NaN, keep it quiet
+      return static_cast<uint16_t>((x>>16) | 0x40);
+    x += 0x7fffu + ((x>>16) & 1);
+    return static_cast<uint16_t>(x>>16);
+  }
+
+  inline float BF16ToFloat(uint16_t h){
+    uint32_t x = static_cast<uint32_t>(h)<<16;
+    float f; std::memcpy(&f, &x, sizeof(f));
+    return f;
+  }
+
+  inline uint16_t FloatToFP16(float f){
+    uint32_t x; std::memcpy(&x, &f, sizeof(x));
+    uint32_t sign = (x>>16) & 0x8000u;
+    uint32_t exp = (x>>23) & 0xffu;
+    uint32_t mant = x & 0x7fffffu;
+
+    if(exp==0xffu)    /// Inf or NaN
+      return static_cast<uint16_t>(sign | 0x7c00u | ((mant) ? 0x200u : 0));
+    int e = static_cast<int>(exp)-127+15;
+    if(e>=31) return static_cast<uint16_t>(sign | 0x7c00u);   /// Overflow
+    if(e<=0){         /// Subnormal or zero
+      if(e<-10) return static_cast<uint16_t>(sign);
+      mant |= 0x800000u;
+      int shift = 14-e;
+      uint32_t h = mant>>shift;
+      uint32_t rem = mant & ((1u<<shift)-1);
+      uint32_t half = 1u<<(shift-1);
+      if(rem>half || (rem==half && (h&1))) ++h;
+      return static_cast<uint16_t>(sign | h);
+    }
+    uint32_t h = (static_cast<uint32_t>(e)<<10) | (mant>>13);
+    uint32_t rem = mant & 0x1fffu;
+    if(rem>0x1000u || (rem==0x1000u && (h&1))) ++h;  /// May carry to Inf
+    return static_cast<uint16_t>(sign | h);
+  }
+
+  inline float FP16ToFloat(uint16_t h){
+    uint32_t sign = static_cast<uint32_t>(h & 0x8000u)<<16;
+    uint32_t exp = (h>>10) & 0x1fu;
+    uint32_t mant = h & 0x3ffu;
+    uint32_t x;
+    if(exp==0){
+      if(mant==0) x = sign;
+      else{           /// Subnormal, normalize
+        exp = 127-15+1;
+        while(!(mant & 0x400u)){ mant <<= 1; --exp; }
+        x = sign | (exp<<23) | ((mant & 0x3ffu)<<13);
+      }
+    }
+    else if(exp==31) x = sign | 0x7f800000u | (mant<<13);
+    else x = sign | ((exp+127-15)<<23) | (mant<<13);
+    float f; std::memcpy(&f, &x, sizeof(f));
+    return f;
+  }
+
+  /// inout[i] += in[i] for i in [0, n); every sum is rounded back to 16
+  /// bits. These are the element kernels of the 16-bit MPI_Op sums.
+  inline void SumBF16(uint16_t const *in, uint16_t *inout, int n){
+    for(int i=0; i<n; ++i)
+      inout[i] = FloatToBF16(BF16ToFloat(in[i])+BF16ToFloat(inout[i]));
+  }
+
+  inline void SumFP16(uint16_t const *in, uint16_t *inout, int n){
+    for(int i=0; i<n; ++i)
+      inout[i] = FloatToFP16(FP16ToFloat(in[i])+FP16ToFloat(inout[i]));
+  }
+}
+
+#endif /// DISP_APPS_RECONSTRUCTION_COMMON_TRACE_HALF_H
@@ -0,0 +1,22 @@
+#ifndef DISP_APPS_RECONSTRUCTION_COMMON_TRACE_MPI_H
+#define DISP_APPS_RECONSTRUCTION_COMMON_TRACE_MPI_H
+
+/*
+ * MPI is optional (CMake option TRACE_USE_MPI, which defines the macro of
+ * the same name). Without it the I/O and stream interfaces keep their
+ * signatures: MPI_Comm and MPI_Info name a single-process communicator and
+ * an empty info object. Serial HDF5 still defines H5FD_mpio_xfer_t; the
+ * transfer flag is ignored.
+ */
+
+#ifdef TRACE_USE_MPI
+#include "mpi.h"
+#else
+typedef int MPI_Comm;
+typedef int MPI_Info;
+#define MPI_COMM_NULL   (-1)
+#define MPI_COMM_WORLD  0
+#define MPI_INFO_NULL   0
+#endif
+
+#endif /// DISP_APPS_RECONSTRUCTION_COMMON_TRACE_MPI_H
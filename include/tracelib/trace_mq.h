@@ -4,8 +4,10 @@
 #include <string>
 #include <iostream>
 #include <vector>
+#include <atomic>
 #include "trace_prot_generated.h"
 #include "zmq.h"
+#include "trace_codec.h"
 
 #define TRACEMQ_MSG_FIN_REP       0x00000000
 #define TRACEMQ_MSG_DATAINFO_REQ  0x00000001
@@ -13,6 +15,9 @@
 
 #define TRACEMQ_MSG_DATA_REQ      0x00000010
 #define TRACEMQ_MSG_DATA_REP      0x00000020
+#define TRACEMQ_MSG_CDATA_REP     0x00000021
+
+#define TRACEMQ_MSG_REASSIGN_REP  0x00000030
 
 #define ANY_ARRAY_SIZE 1
 
@@ -29,11 +34,14 @@ struct _tomo_msg_data_info_rep_str {
 	uint32_t beg_sinogram;
   uint32_t n_sinograms;
   uint32_t n_rays_per_proj_row;
+  uint32_t codec;           // TRACE_CODEC_* the distributor will use
 };
 
 struct _tomo_msg_data_info_req_str {
   uint32_t comm_rank; 
   uint32_t comm_size;
+  uint32_t codecs;          // Mask of codecs this worker can decompress
+  uint32_t group_size;      // Number of consecutive ranks sharing sinograms
 };
 
 /* Center, tn_sinogram, n_rays_per_proj_row are all global and can be sent only once.
@@ -42,12 +50,44 @@ struct _tomo_msg_data_str {
 	int projection_id;        // projection id
 	float theta;              // theta value of this projection
 	float center;             // center of the projecion
+	int owner;                // group member that reconstructs this projection
 	float data[ANY_ARRAY_SIZE];             // real projection data
 	// number of rays in data=n_sinogram*n_rays_per_proj_row (n_sinogram*n_rays_per_proj_row were given in req msg.)
 };
 
+/* Compressed projection, TRACEMQ_MSG_CDATA_REP. data holds comp_size bytes
+ * that decompress to raw_size bytes, i.e. the float data of
+ * _tomo_msg_data_str.
+ */
+struct _tomo_msg_cdata_str {
+	int projection_id;        // projection id
+	float theta;              // theta value of this projection
+	float center;             // center of the projecion
+	int owner;                // group member that reconstructs this projection
+	uint32_t codec;           // TRACE_CODEC_* used for this message
+	uint64_t raw_size;        // size of the decompressed data in bytes
+	uint64_t comp_size;       // size of data in bytes
+	char data[ANY_ARRAY_SIZE];
+};
+
+/* Body of TRACEMQ_MSG_DATA_REQ (projection acknowledgement) */
+struct _tomo_msg_data_req_str {
+  double throughput;        // Latest measured sinogram rows*projections/sec, 0 if unknown
+};
+
+/* TRACEMQ_MSG_REASSIGN_REP: new sinogram ranges, in effect for the following
+ * projections. ranges holds (beg_sinogram, n_sinograms) of every rank, first
+ * the current then the new ones, i.e. 4*n_ranks values. */
+struct _tomo_msg_reassign_str {
+  uint32_t n_ranks;
+  uint32_t ranges[ANY_ARRAY_SIZE];
+};
+
 typedef struct _tomo_msg_h_str tomo_msg_t;
+typedef struct _tomo_msg_data_req_str tomo_msg_data_req_t;
+typedef struct _tomo_msg_reassign_str tomo_msg_reassign_t;
 typedef struct _tomo_msg_data_str tomo_msg_data_t;
+typedef struct _tomo_msg_cdata_str tomo_msg_cdata_t;
 typedef struct _tomo_msg_data_info_req_str tomo_msg_data_info_req_t;
 typedef struct _tomo_msg_data_info_rep_str tomo_msg_data_info_rep_t;
 typedef struct _tomo_msg_data_info_rep_str tomo_msg_metadata_t;
@@ -61,6 +101,7 @@ class TraceMQ
     int dest_port_;
     int comm_rank_;
     int comm_size_;
+    int group_size_;
     std::string pub_info_;
 
 
@@ -81,6 +122,10 @@ class TraceMQ
 
     tomo_msg_metadata_t metadata_;
 
+    /// Reported with every acknowledgement; set by the reconstruction
+    /// thread, read by the receiving thread
+    std::atomic<double> throughput_;
+
     //tomo_msg_t* prepare_data_req_msg(uint64_t seq_n);
     //tomo_msg_t* prepare_data_rep_msg(uint64_t seq_n, int projection_id,
     //                                 float theta, float center,
@@ -127,7 +172,8 @@ class TraceMQ
     tomo_msg_t* prepare_data_info_rep_msg(uint64_t seq_n, int beg_sinogram, 
                                           int n_sinograms, 
                                           int n_rays_per_proj_row,
-                                          uint64_t tn_sinograms);
+                                          uint64_t tn_sinograms,
+                                          uint32_t codec);
     tomo_msg_t* prepare_data_info_req_msg(uint64_t seq_n, uint32_t comm_rank, 
                                           uint32_t comm_size);
 
@@ -172,6 +218,19 @@ class TraceMQ
             int comm_rank,
             int comm_size,
             std::string pub_info);
+    /**
+     * @param group_size Number of consecutive ranks that receive the same
+     *                   sinograms and split the projections among them.
+     *
+     * An empty dest_ip only sets up the publisher, e.g. for offline input;
+     * Initialize() and ReceiveMsg() must not be called then.
+     */
+    TraceMQ(std::string dest_ip,
+            int dest_port,
+            int comm_rank,
+            int comm_size,
+            std::string pub_info,
+            int group_size);
     ~TraceMQ();
 
     /**
@@ -188,6 +247,11 @@ class TraceMQ
     /// Waits for tomo_msg_t and returns it
     tomo_msg_t* ReceiveMsg();
     tomo_msg_data_t* read_data(tomo_msg_t *msg);
+    /// For TRACEMQ_MSG_CDATA_REP messages; nullptr if the compressed data
+    /// does not fit in msg
+    tomo_msg_cdata_t* read_cdata(tomo_msg_t *msg);
+    /// For TRACEMQ_MSG_REASSIGN_REP messages
+    tomo_msg_reassign_t* read_reassign(tomo_msg_t *msg);
 
     void PublishMsg(float *msg, std::vector<int> dims);
     void PublishMsg(const float *msg, std::vector<int> dims, int sliceID);
@@ -206,6 +270,10 @@ class TraceMQ
     tomo_msg_metadata_t metadata() const { return metadata_; }
     void metadata(tomo_msg_metadata_t metadata) { metadata_ = metadata; }
 
+    /// Reconstruction throughput (sinogram rows*projections/sec) that is
+    /// reported to the distributor for load balancing
+    void throughput(double tput) { throughput_.store(tput); }
+
 };
 
 #endif // TRACE_COMMONS_STREAM_TRACE_MQ_H
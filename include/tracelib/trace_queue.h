@@ -0,0 +1,72 @@
+#ifndef TRACE_COMMONS_STREAM_TRACE_QUEUE_H
+#define TRACE_COMMONS_STREAM_TRACE_QUEUE_H
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+/**
+ * Bounded single-producer/single-consumer ring buffer.
+ *
+ * Only one thread may call Push() and only one (other) thread may call Pop().
+ * Neither side takes a lock; the head/tail indices are the only shared state
+ * and they live on separate cache lines so the producer and consumer do not
+ * bounce the same line while the queue is neither full nor empty.
+ */
+template <typename T>
+class SPSCQueue
+{
+  private:
+    static constexpr size_t kCacheLine = 64;
+
+    std::vector<T> slots_;
+    size_t const capacity_;
+
+    /// Padding keeps head_ and tail_ on different cache lines without
+    /// over-aligning the class (C++11 operator new ignores alignas).
+    char pad0_[kCacheLine];
+    std::atomic<size_t> head_;  /// Next slot to pop
+    char pad1_[kCacheLine - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail_;  /// Next slot to push
+
+  public:
+    explicit SPSCQueue(size_t capacity)
+      : slots_(capacity+1)
+      , capacity_{capacity+1}   /// One slot is kept empty to tell full/empty apart
+      , pad0_{}
+      , head_{0}
+      , pad1_{}
+      , tail_{0}
+    {}
+
+    SPSCQueue(const SPSCQueue&) = delete;
+    SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+    /// Returns false if the queue is full.
+    bool Push(const T &item) {
+      size_t tail = tail_.load(std::memory_order_relaxed);
+      size_t next = (tail+1 == capacity_) ? 0 : tail+1;
+      if(next == head_.load(std::memory_order_acquire)) return false;
+      slots_[tail] = item;
+      tail_.store(next, std::memory_order_release);
+      return true;
+    }
+
+    /// Returns false if the queue is empty.
+    bool Pop(T &item) {
+      size_t head = head_.load(std::memory_order_relaxed);
+      if(head == tail_.load(std::memory_order_acquire)) return false;
+      item = slots_[head];
+      head_.store((head+1 == capacity_) ? 0 : head+1, std::memory_order_release);
+      return true;
+    }
+
+    bool Empty() const {
+      return head_.load(std::memory_order_acquire) ==
+             tail_.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const { return capacity_-1; }
+};
+
+#endif // TRACE_COMMONS_STREAM_TRACE_QUEUE_H
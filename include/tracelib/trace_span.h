@@ -0,0 +1,143 @@
+#ifndef DISP_APPS_RECONSTRUCTION_COMMON_TRACE_SPAN_H
+#define DISP_APPS_RECONSTRUCTION_COMMON_TRACE_SPAN_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <atomic>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * Span tracing of the hot paths.
+ *
+ * A span is a named [begin, end) interval of a thread, tagged with the
+ * current window. Spans are appended to a buffer of the recording thread
+ * without locks; a thread takes a buffer from the registry on its first
+ * span and hands it back when it exits, so the short-lived engine threads
+ * reuse the buffers (and their trace ids) of earlier threads of the same
+ * name. A buffer stops recording after its capacity and counts the dropped
+ * spans.
+ *
+ * Timestamps are TSC ticks on x86 and steady_clock nanoseconds elsewhere;
+ * writing a trace calibrates the ticks against steady_clock.
+ *
+ * Tracing is off until Enable(). A disabled TRACE_SPAN costs one relaxed
+ * load and a branch; defining TRACE_SPANS_DISABLED compiles the macros
+ * out. The totals and the writers see the spans completed so far, threads
+ * may keep recording meanwhile.
+ */
+namespace trace_span {
+
+  enum Level {
+    kOff = 0,
+    kPhases,      /// Receive, reduce, combine, update, publish, write, ...
+    kDetail       /// Also per chunk and per partition request
+  };
+
+  namespace detail {
+    extern std::atomic<int> level;
+    extern std::atomic<int64_t> window;
+  }
+
+  inline uint64_t Now(){
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+  }
+
+  inline bool Enabled(int level){
+    return detail::level.load(std::memory_order_relaxed)>=level;
+  }
+
+  /// Starts recording spans up to level; capacity is per thread buffer
+  void Enable(int level, size_t capacity=size_t(1)<<20);
+
+  /// Window of the spans recorded from now on
+  inline void Window(int64_t w){
+    detail::window.store(w, std::memory_order_relaxed);
+  }
+
+  /// Names the buffer of the calling thread, e.g. "reduction"; call it
+  /// before the first span of the thread
+  void ThreadName(char const *name);
+
+  /// name must outlive the trace, e.g. a string literal
+  void Record(char const *name, uint64_t beg, uint64_t end);
+
+  class Scope {
+    private:
+      char const *name_;
+      uint64_t beg_ = 0;
+
+    public:
+      Scope(char const *name, int level)
+        : name_{(Enabled(level)) ? name : nullptr}
+      {
+        if(name_!=nullptr) beg_ = Now();
+      }
+      ~Scope(){
+        if(name_!=nullptr) Record(name_, beg_, Now());
+      }
+
+      Scope(const Scope&) = delete;
+      Scope& operator=(const Scope&) = delete;
+  };
+
+  /// Sum of the durations of the spans named name, in seconds
+  double TotalSeconds(char const *name);
+
+  /// Chrome trace event JSON (chrome://tracing, Perfetto); pid tells the
+  /// ranks apart when the files are merged
+  void WriteChromeTrace(std::string const &path, int pid);
+
+  /**
+   * Compact binary log: a SpanLogHeader, the names and the threads as
+   * (uint32 id, uint32 length, chars) entries, then n_spans SpanLogRecords.
+   * Native byte order.
+   */
+  struct SpanLogHeader {
+    char magic[8];              /// "TRCSPAN\0"
+    uint32_t version;
+    int32_t pid;
+    double ticks_per_us;
+    uint64_t base;              /// Ticks at the first Enable()
+    uint32_t n_names;
+    uint32_t n_threads;
+    uint64_t n_spans;
+    uint64_t dropped;
+  };
+
+  struct SpanLogRecord {
+    uint64_t beg;               /// Ticks
+    uint64_t end;
+    int64_t window;
+    uint32_t name;
+    uint32_t thread;
+  };
+
+  void WriteBinaryLog(std::string const &path, int pid);
+}
+
+#define TRACE_SPAN_CONCAT_(a, b) a##b
+#define TRACE_SPAN_CONCAT(a, b) TRACE_SPAN_CONCAT_(a, b)
+#ifdef TRACE_SPANS_DISABLED
+#define TRACE_SPAN(name) static_cast<void>(0)
+#define TRACE_SPAN_DETAIL(name) static_cast<void>(0)
+#else
+/// Span from here to the end of the enclosing scope
+#define TRACE_SPAN(name) \
+  trace_span::Scope TRACE_SPAN_CONCAT(trace_span_, __LINE__)( \
+      name, trace_span::kPhases)
+#define TRACE_SPAN_DETAIL(name) \
+  trace_span::Scope TRACE_SPAN_CONCAT(trace_span_, __LINE__)( \
+      name, trace_span::kDetail)
+#endif
+
+#endif /// DISP_APPS_RECONSTRUCTION_COMMON_TRACE_SPAN_H
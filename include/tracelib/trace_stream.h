@@ -5,7 +5,14 @@
 #include "data_region_base.h"
 #include "disp_engine_reduction.h"
 #include "trace_mq.h"
+#include "trace_queue.h"
+#include "trace_checkpoint.h"
+#include "trace_mpi.h"
 #include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 class TraceStream
 {
@@ -18,8 +25,60 @@ class TraceStream
     std::vector<float> vtheta;
     std::vector<tomo_msg_data_t> vmeta;
 
-    /// Add streaming message to vectors
-    void AddTomoMsg(tomo_msg_data_t &msg);
+    /// Projection-parallel group mode. All members of a group receive the
+    /// same projections (vtheta/vmeta), but a member only keeps the data
+    /// of the projections it owns in vproj.
+    int group_size_ = 1;
+    int group_member_ = 0;
+    std::vector<float> vtheta_owned_;
+
+    /// Halo slices on each side of the reconstructed image
+    int num_neighbor_slices_ = 0;
+
+    /// Sinogram reassignment received from the distributor; the projections
+    /// after it use the new ranges, so reading stops until Reassign()
+    tomo_msg_t *pending_reassign_ = nullptr;
+
+    bool Owns(tomo_msg_data_t const &meta) const {
+      return meta.owner == group_member_;
+    }
+
+    /// Background receiver. When enabled, a dedicated thread drains the
+    /// distributor socket into recv_queue_ while the window is being
+    /// reconstructed, decompressing the projections of this member, and
+    /// ReadSlidingWindow only pops from the queue. Each side sleeps on
+    /// recv_cv_ while the queue is empty (consumer) or full (receiver).
+    SPSCQueue<tomo_msg_t*> *recv_queue_ = nullptr;
+    std::thread receiver_;
+    std::atomic<bool> recv_done_;
+    std::atomic<bool> recv_stop_;
+    std::mutex recv_mutex_;
+    std::condition_variable recv_cv_;
+
+    /// Codec state of the reconstruction thread, for synchronous receiving
+    trace_codec_ctx_t *codec_ctx_ = nullptr;
+
+    /// Offline source, see the file constructor. Projections are copied
+    /// straight into the window, with the metadata the distributor would
+    /// have sent.
+    bool file_mode_ = false;
+    std::vector<float> file_projs_;
+    std::vector<float> file_theta_;
+    float file_center_ = 0.;
+    size_t file_next_ = 0;
+    void AddFileProj(size_t proj);
+
+    /// Receiver thread body: pulls messages until fin message is received
+    void ReceiverLoop();
+    /// Returns the uncompressed TRACEMQ_MSG_DATA_REP of a compressed
+    /// projection of this member and frees msg; other messages, or ones that
+    /// fail the size check or to decompress, are returned as they are
+    tomo_msg_t* DecodeMsg(tomo_msg_t *msg, trace_codec_ctx_t *ctx);
+    /// Returns the next data message, or nullptr at the end of the stream
+    tomo_msg_t* NextMsg();
+
+    /// Add streaming message (raw or compressed) to vectors
+    void AddTomoMsg(tomo_msg_t &msg);
     /// Erase first message
     void EraseBegTraceMsg();
     /// Generates a data region that can be processed by Trace
@@ -36,11 +95,52 @@ class TraceStream
                 int comm_rank,
                 int comm_size, 
                 std::string pub_info);
+    /* @param recv_queue_len  Capacity of the background receive queue (in
+     *                        projections). 0 keeps receiving synchronous,
+     *                        i.e. in ReadSlidingWindow.
+     */
+    TraceStream(std::string dest_ip,
+                int dest_port,
+                uint32_t window_len, 
+                int comm_rank,
+                int comm_size, 
+                std::string pub_info,
+                uint32_t recv_queue_len);
+    /* @param group_size  Number of consecutive ranks that share the same
+     *                    sinograms and split the projections of the window.
+     *                    The member index of a rank is comm_rank%group_size.
+     */
+    TraceStream(std::string dest_ip,
+                int dest_port,
+                uint32_t window_len, 
+                int comm_rank,
+                int comm_size, 
+                std::string pub_info,
+                uint32_t recv_queue_len,
+                int group_size);
     TraceStream(std::string dest_ip,
                 int dest_port,
                 uint32_t window_len, 
                 int comm_rank,
                 int comm_size);
+    /* Offline mode: projections are taken from memory, e.g. a dataset read
+     * with trace_io::ReadSlicesCollective, instead of the distributor.
+     * Publishing works as in streaming mode.
+     * @param md      Sinograms of this rank, as the distributor assigns them
+     * @param projs   [projection][md.n_sinograms][md.n_rays_per_proj_row]
+     * @param theta   Projection angles, in radians
+     * @param center  Rotation center of all projections
+     */
+    TraceStream(tomo_msg_metadata_t md,
+                std::vector<float> projs,
+                std::vector<float> theta,
+                float center,
+                uint32_t window_len,
+                int comm_rank,
+                int comm_size,
+                std::string pub_info,
+                int group_size);
+    ~TraceStream();
 
     /* Create a data region from sliding window
      * @param recon_image Initial values of reconstructed image
@@ -59,11 +159,47 @@ class TraceStream
     uint32_t counter() const { return counter_; }
 
     void WindowLength(int wlen);
+    /// Image passed to ReadSlidingWindow has nslices halo slices on both
+    /// sides of the own slices, see trace_comm::HaloExchange
+    void NeighborSlices(int nslices);
 
     /* Publish reconstructed slices.
      * @param slice Slice and its metadata information.
      */
     void PublishImage(DataRegionBase<float, TraceMetadata> &slice);
+
+    /// Reconstruction throughput that is reported to the distributor, in
+    /// sinogram rows*projections/sec
+    void ReportThroughput(double tput) { traceMQ().throughput(tput); }
+
+    /// True if the distributor reassigned the sinograms; Reassign() must be
+    /// called before the next ReadSlidingWindow
+    bool ReassignmentPending() const { return pending_reassign_ != nullptr; }
+
+    /* Applies the pending reassignment: migrates the rows of the window
+     * between the ranks of comm and updates the metadata.
+     * @param old_ranges, new_ranges  (beg, n) sinograms of every rank before
+     *                                and after, e.g. for migrating the image
+     *                                with trace_comm::MigrateRows
+     */
+    void Reassign(MPI_Comm comm,
+                  std::vector<uint32_t> &old_ranges,
+                  std::vector<uint32_t> &new_ranges);
+
+    /// Copies the window, the sinogram range and the counter to state
+    void Checkpoint(trace_io::CheckpointState &state);
+    /* Replaces the window and the counter with the ones of state. The
+     * window rows are migrated from the sinograms of the checkpoints, e.g.
+     * after a reassignment, to the ones assigned by the distributor.
+     * Collective over comm.
+     * @param old_ranges, new_ranges  (beg, n) sinograms of every rank in
+     *                                the checkpoints and now, e.g. for
+     *                                migrating the image
+     */
+    void Restore(trace_io::CheckpointState const &state,
+                 MPI_Comm comm,
+                 std::vector<uint32_t> &old_ranges,
+                 std::vector<uint32_t> &new_ranges);
 };
 
 #endif // TRACE_COMMONS_STREAM_TRACE_STREAM_H
@@ -0,0 +1,144 @@
+#ifndef DISP_APPS_RECONSTRUCTION_COMMON_TRACE_SUBSETS_H
+#define DISP_APPS_RECONSTRUCTION_COMMON_TRACE_SUBSETS_H
+
+#include <vector>
+#include <string>
+#include <numeric>
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include "trace_data.h"
+#include "data_region_base.h"
+
+/**
+ * Ordered subsets of a projection window (OS-SIRT).
+ *
+ * The projections of a window are ranked by angle and projection r goes to
+ * subset r%n_subsets, so every subset covers the whole angular range. The
+ * reconstruction runs reduce, combine and update once per subset, giving
+ * n_subsets updates per pass over the window.
+ *
+ * Every rank gets n_subsets subsets, even if some of them are empty, so that
+ * the collective combinations stay matched across a projection group.
+ */
+class OrderedSubsets
+{
+  public:
+    enum Order {
+      kSequential = 0,  /// 0, 1, 2, ...
+      kBitReverse,      /// Bit-reversed indices, e.g. 0, 4, 2, 6, 1, 5, ...
+      kRandom           /// New permutation for every pass
+    };
+
+    static Order ParseOrder(std::string const &name){
+      if(name=="sequential") return kSequential;
+      if(name=="bit-reverse") return kBitReverse;
+      if(name=="random") return kRandom;
+      throw std::invalid_argument("Unknown subset order: " + name);
+    }
+
+  private:
+    int n_subsets_;
+    Order order_;
+    std::mt19937 gen_;
+    std::vector<int> perm_;
+    std::vector<std::vector<float>> theta_;   /// Angles of each subset
+    std::vector<DataRegionBase<float, TraceMetadata>*> regions_;
+
+    void Clear(){
+      for(auto region : regions_){
+        delete &region->metadata();
+        delete region;
+      }
+      regions_.clear();
+    }
+
+  public:
+    OrderedSubsets(int n_subsets, Order order, unsigned seed=0)
+      : n_subsets_{n_subsets}
+      , order_{order}
+      , gen_{seed}
+    {
+      if(n_subsets<1)
+        throw std::invalid_argument("Number of subsets must be positive");
+
+      perm_.resize(n_subsets);
+      std::iota(perm_.begin(), perm_.end(), 0);
+      if(order==kBitReverse){
+        int bits = 0;
+        while((1<<bits)<n_subsets) ++bits;
+        perm_.clear();
+        for(int i=0; i<(1<<bits); ++i){
+          int r = 0;
+          for(int b=0; b<bits; ++b)
+            if(i & (1<<b)) r |= 1<<(bits-1-b);
+          if(r<n_subsets) perm_.push_back(r);
+        }
+      }
+    }
+
+    ~OrderedSubsets(){ Clear(); }
+
+    OrderedSubsets(const OrderedSubsets&) = delete;
+    OrderedSubsets& operator=(const OrderedSubsets&) = delete;
+
+    /// Replaces the subsets with the ones of window. The subsets copy the
+    /// rays, window can be deleted afterwards.
+    void Split(DataRegionBase<float, TraceMetadata> &window){
+      Clear();
+      auto &md = window.metadata();
+      int n_projs = md.num_projs();
+      size_t n_rays_proj = static_cast<size_t>(md.num_slices())*md.num_cols();
+
+      std::vector<int> ranked(n_projs);
+      std::iota(ranked.begin(), ranked.end(), 0);
+      std::stable_sort(ranked.begin(), ranked.end(),
+          [&md](int a, int b){ return md.theta()[a]<md.theta()[b]; });
+
+      std::vector<std::vector<int>> members(n_subsets_);
+      for(int r=0; r<n_projs; ++r)
+        members[r%n_subsets_].push_back(ranked[r]);
+
+      theta_.assign(n_subsets_, std::vector<float>());
+      for(int k=0; k<n_subsets_; ++k){
+        /// Keep the window order inside a subset
+        std::sort(members[k].begin(), members[k].end());
+        for(int p : members[k]) theta_[k].push_back(md.theta()[p]);
+
+        TraceMetadata *smd = new TraceMetadata(
+            (theta_[k].empty()) ? md.theta() : theta_[k].data(),
+            md.proj_id(), md.slice_id(), md.col_id(),
+            md.num_total_slices(),
+            static_cast<int>(members[k].size()),
+            md.num_slices(), md.num_cols(), md.num_grids(),
+            md.center(),
+            md.num_neighbor_recon_slices());
+        smd->recon(md.recon());
+
+        float *data = new float[smd->count()];
+        for(size_t i=0; i<members[k].size(); ++i)
+          std::copy(&window[members[k][i]*n_rays_proj],
+                    &window[members[k][i]*n_rays_proj]+n_rays_proj,
+                    data+i*n_rays_proj);
+        auto region = new DataRegionBase<float, TraceMetadata>(
+            data, smd->count(), smd);
+        region->ResetMirroredRegionIter();
+        regions_.push_back(region);
+      }
+    }
+
+    int size() const { return n_subsets_; }
+
+    /// Subset k of the last Split()
+    DataRegionBase<float, TraceMetadata>& operator[](int k){
+      return *regions_.at(k);
+    }
+
+    /// Processing order of the subsets for the next pass over the window
+    std::vector<int> const& NextOrder(){
+      if(order_==kRandom) std::shuffle(perm_.begin(), perm_.end(), gen_);
+      return perm_;
+    }
+};
+
+#endif /// DISP_APPS_RECONSTRUCTION_COMMON_TRACE_SUBSETS_H
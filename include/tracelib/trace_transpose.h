@@ -0,0 +1,112 @@
+#ifndef DISP_APPS_RECONSTRUCTION_COMMON_TRACE_TRANSPOSE_H
+#define DISP_APPS_RECONSTRUCTION_COMMON_TRACE_TRANSPOSE_H
+
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <stdexcept>
+
+/*
+ * Out-of-place axis swaps of 3D row-major arrays.
+ *
+ * Swapping the two outer axes moves whole rows, which are copied with
+ * memcpy. Swaps involving the innermost axis are 2D transposes of
+ * [rows, cols] planes, done in kTile x kTile tiles so that both the rows
+ * read and the rows written stay in cache; the fixed-size inner loops of a
+ * full tile are vectorized by the compiler.
+ */
+namespace trace_utils {
+  namespace transpose_detail {
+    const size_t kTile = 16;
+    const size_t kRowTile = 16;     /// Outer indices per memcpy tile
+
+    /// out[c*out_stride + r] = in[r*in_stride + c] for a rows x cols plane
+    template <typename T>
+    void TransposePlane(T const *in, size_t in_stride,
+                        T *out, size_t out_stride,
+                        size_t rows, size_t cols)
+    {
+      for(size_t r0=0; r0<rows; r0+=kTile){
+        size_t r1 = std::min(r0+kTile, rows);
+        for(size_t c0=0; c0<cols; c0+=kTile){
+          size_t c1 = std::min(c0+kTile, cols);
+          if(r1-r0==kTile && c1-c0==kTile){
+            for(size_t c=0; c<kTile; ++c){
+              T *o = out + (c0+c)*out_stride + r0;
+              T const *i = in + r0*in_stride + c0+c;
+              for(size_t r=0; r<kTile; ++r)
+                o[r] = i[r*in_stride];
+            }
+          }
+          else{
+            for(size_t c=c0; c<c1; ++c)
+              for(size_t r=r0; r<r1; ++r)
+                out[c*out_stride+r] = in[r*in_stride+c];
+          }
+        }
+      }
+    }
+
+    /// Runs f(beg, end) over [0, n) split into n_threads contiguous ranges
+    template <typename F>
+    void ParallelRanges(size_t n, int n_threads, F f)
+    {
+      size_t nt = std::min(static_cast<size_t>(std::max(n_threads, 1)), n);
+      if(nt<=1){
+        f(static_cast<size_t>(0), n);
+        return;
+      }
+      std::vector<std::thread> threads;
+      for(size_t t=1; t<nt; ++t)
+        threads.emplace_back(f, n*t/nt, n*(t+1)/nt);
+      f(static_cast<size_t>(0), n/nt);
+      for(auto &th : threads) th.join();
+    }
+  }
+
+  /**
+   * Copies in, a [n0, n1, n2] array, to out with axes axis_a and axis_b
+   * (0, 1 or 2) swapped, e.g. axes 0 and 1 give a [n1, n0, n2] array.
+   * in and out must not overlap. Work is split among n_threads threads.
+   */
+  template <typename T>
+  void SwapAxes(T const *in, T *out,
+                size_t n0, size_t n1, size_t n2,
+                int axis_a, int axis_b, int n_threads=1)
+  {
+    using namespace transpose_detail;
+    if(axis_a>axis_b) std::swap(axis_a, axis_b);
+    if(axis_a<0 || axis_b>2 || axis_a==axis_b)
+      throw std::invalid_argument("SwapAxes: invalid axis pair");
+
+    if(axis_a==0 && axis_b==1){
+      /// out[j][i][:] = in[i][j][:]
+      ParallelRanges(n1, n_threads, [=](size_t beg, size_t end){
+        for(size_t i0=0; i0<n0; i0+=kRowTile){
+          size_t i1 = std::min(i0+kRowTile, n0);
+          for(size_t j=beg; j<end; ++j)
+            for(size_t i=i0; i<i1; ++i)
+              std::memcpy(out+(j*n0+i)*n2, in+(i*n1+j)*n2, n2*sizeof(T));
+        }
+      });
+    }
+    else if(axis_a==1){
+      /// out[i][k][j] = in[i][j][k], a [n1, n2] plane per i
+      ParallelRanges(n0, n_threads, [=](size_t beg, size_t end){
+        for(size_t i=beg; i<end; ++i)
+          TransposePlane(in+i*n1*n2, n2, out+i*n2*n1, n1, n1, n2);
+      });
+    }
+    else{
+      /// out[k][j][i] = in[i][j][k], a [n0, n2] plane per j
+      ParallelRanges(n1, n_threads, [=](size_t beg, size_t end){
+        for(size_t j=beg; j<end; ++j)
+          TransposePlane(in+j*n2, n1*n2, out+j*n0, n1*n0, n0, n2);
+      });
+    }
+  }
+}
+
+#endif /// DISP_APPS_RECONSTRUCTION_COMMON_TRACE_TRANSPOSE_H
@@ -0,0 +1,122 @@
+#ifndef DISP_APPS_RECONSTRUCTION_COMMON_TRACE_WRITER_H
+#define DISP_APPS_RECONSTRUCTION_COMMON_TRACE_WRITER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include "trace_mpi.h"
+#include "trace_h5io.h"
+
+namespace trace_io {
+
+  /**
+   * Asynchronous output stage for the reconstructed image.
+   *
+   * WriteRecon() copies the rank's reconstruction into one of a fixed set of
+   * snapshot buffers and returns; a dedicated I/O thread performs the
+   * collective HDF5 write from the snapshot while the reconstruction
+   * continues. WriteRecon() only blocks if all buffers are still waiting to
+   * be written (back-pressure).
+   *
+   * Every rank must issue the same sequence of WriteRecon() calls, since the
+   * I/O threads of all ranks perform the writes collectively and in order.
+   * The writes use a duplicate of the given communicator, so they do not
+   * interfere with collectives issued by the compute threads. This requires
+   * MPI_THREAD_MULTIPLE; otherwise (or with 0 buffers) writes are performed
+   * synchronously in the calling thread.
+   */
+  class AsyncReconWriter {
+    private:
+      struct WriteJob {
+        std::vector<float> data;    /// Snapshot of this rank's slices
+        hsize_t rank_dims[3];       /// This rank's dimensions
+        hsize_t app_dims[3];        /// Whole dataset dimensions
+        int slice_id;               /// First slice of this rank
+        bool append;                /// Append to the series instead of a file
+        int64_t step;               /// Iteration number, if appended
+        std::string output_path;
+        std::string dataset_path;
+      };
+
+      MPI_Comm comm_ = MPI_COMM_NULL;
+      bool async_ = false;
+
+      std::vector<WriteJob> buffers_;
+      std::deque<int> free_buffers_;    /// Buffer ids that can be filled
+      std::deque<int> pending_buffers_; /// Buffer ids waiting for the I/O thread
+
+      std::mutex mutex_;
+      std::condition_variable free_cv_;
+      std::condition_variable pending_cv_;
+      bool stop_ = false;
+      std::thread io_thread_;
+
+      uint64_t submitted_ = 0;
+      uint64_t completed_ = 0;
+
+      /// Time-series output; created by the first appended job
+      bool series_enabled_ = false;
+      std::string series_path_;
+      std::string series_dataset_;
+      int series_filter_id_ = 0;
+      unsigned int series_filter_level_ = 0;
+      H5Series *series_ = nullptr;
+
+      void IOLoop();
+      void Write(WriteJob &job, MPI_Comm comm);
+      void Submit(
+          TraceMetadata &rank_metadata,
+          H5Metadata &dataset_metadata,
+          bool append, int64_t step,
+          std::string const output_path,
+          std::string const dataset_path);
+
+    public:
+      /**
+       * @param comm Communicator of the ranks that write the dataset.
+       * @param num_buffers Number of snapshot buffers. 2 gives double
+       *                    buffering; 0 disables the I/O thread.
+       */
+      AsyncReconWriter(MPI_Comm comm, int num_buffers);
+      ~AsyncReconWriter();
+
+      AsyncReconWriter(const AsyncReconWriter&) = delete;
+      AsyncReconWriter& operator=(const AsyncReconWriter&) = delete;
+
+      /// Snapshots rank_metadata.recon() and queues it to be written to
+      /// output_path. Same arguments as trace_io::WriteRecon.
+      void WriteRecon(
+          TraceMetadata &rank_metadata,
+          H5Metadata &dataset_metadata,
+          std::string const output_path,
+          std::string const dataset_path);
+
+      /// Switches AppendRecon() to a single time-series file; see
+      /// trace_io::CreateSeries for the filter arguments. Must be called by
+      /// all ranks before the first AppendRecon().
+      void EnableSeries(
+          std::string const output_path,
+          std::string const dataset_path,
+          int filter_id, unsigned int filter_level);
+
+      /// Snapshots rank_metadata.recon() and queues it to be appended to the
+      /// time series as a new time step, labeled with step.
+      void AppendRecon(
+          TraceMetadata &rank_metadata,
+          H5Metadata &dataset_metadata,
+          int64_t step);
+
+      /// Blocks until all queued writes are on disk.
+      void Flush();
+
+      bool async() const { return async_; }
+      uint64_t submitted();
+      uint64_t completed();
+  };
+}
+
+#endif /// DISP_APPS_RECONSTRUCTION_COMMON_TRACE_WRITER_H
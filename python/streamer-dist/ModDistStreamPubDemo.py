@@ -36,6 +36,17 @@ def parse_arguments():
                           help='Number of sinograms to reconstruct (rows)')
   parser.add_argument('--num_columns', type=int,
                           help='Number of columns (cols)')
+  parser.add_argument('--codec', default='none',
+              choices=['none', 'lz4', 'zstd', 'bshuf-lz4'],
+              help='Compresses projections sent to the reconstruction processes. Default is none.')
+  parser.add_argument('--codec_level', type=int, default=0,
+              help='LZ4 acceleration or Zstd compression level. Default is 0, i.e. codec default.')
+  parser.add_argument('--codec_threads', type=int, default=1,
+              help='Number of threads that compress projections. Default is 1.')
+  parser.add_argument('--rebalance_freq', type=int, default=0,
+              help='Reassigns sinograms to the reconstruction processes according to their throughput every given number of projections. Default is 0, i.e. disabled.')
+  parser.add_argument('--rebalance_threshold', type=float, default=0.1,
+              help='Minimum relative change in the number of sinograms of a process that triggers rebalancing. Default is 0.1.')
 
   # Available pre-processing options 
   parser.add_argument('--degree_to_radian', action='store_true', default=False,
@@ -86,6 +97,10 @@ def main():
   if args.my_distributor_addr is not None:
     addr_split = re.split("://|:", args.my_distributor_addr)
     tmq.init_tmq()
+    if args.codec != 'none':
+      tmq.set_compression(args.codec, args.codec_level, args.codec_threads)
+    if args.rebalance_freq > 0:
+      tmq.set_rebalance(args.rebalance_freq, args.rebalance_threshold)
     # Handshake w. remote processes
     print(addr_split)
     tmq.handshake(addr_split[1], int(addr_split[2]), args.num_sinograms, args.num_columns)
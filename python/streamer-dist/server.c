@@ -46,8 +46,28 @@ int *worker_ids;
 void **workers;
 int n_workers;
 
+/// Workers are split into groups of group_size consecutive ranks. Members of
+/// a group share the same rows, and each projection is reconstructed by one
+/// member, in round-robin order (n_projs_pushed % group_size).
+int group_size = 1;
+uint64_t n_projs_pushed = 0;
+
+/// Sinogram ranges of the workers, (beg, n) pairs, and their last reported
+/// throughput. Rebalanced every rebalance_freq projections, see
+/// set_rebalance().
+uint32_t *worker_ranges = NULL;
+double *worker_tput = NULL;
+int tot_rows = 0;
+int rebalance_freq = 0;
+double rebalance_threshold = 0.1;
+
 uint64_t seq;
 
+/// Projection compression, see set_compression()
+uint32_t codec = TRACE_CODEC_NONE;
+int codec_level = 0;
+int codec_threads = 1;
+
 /// Mock data file
 /// Being set at setup_mock_data()
 dacq_file_t *dacq_file;
@@ -75,6 +95,90 @@ int setup_mock_data(char *fp, int nsubsets)
   return 0;
 }
 
+/// Must be called before handshake(). The codec is only used if all workers
+/// report that they support it.
+int set_compression(char *name, int level, int nthreads)
+{
+  int c = trace_codec_from_name(name);
+  if(c<0 || !(trace_codec_supported() & (1u<<c))){
+    printf("Codec %s is not available\n", name);
+    return -1;
+  }
+  codec = (uint32_t)c;
+  codec_level = level;
+  codec_threads = (nthreads<1) ? 1 : nthreads;
+  printf("Compression codec=%s; level=%d; threads=%d\n", 
+      trace_codec_name(codec), codec_level, codec_threads);
+  return 0;
+}
+
+/// Must be called before handshake(). Every freq projections, the sinograms
+/// are reassigned proportionally to the throughput reported by the workers,
+/// if the number of rows of a worker changes by more than threshold
+/// (relative). freq=0 disables rebalancing.
+int set_rebalance(int freq, double threshold)
+{
+  rebalance_freq = (freq<0) ? 0 : freq;
+  rebalance_threshold = threshold;
+  printf("Rebalance frequency=%d; threshold=%f\n", rebalance_freq,
+      rebalance_threshold);
+  return 0;
+}
+
+/// Reads the throughput of worker i from its acknowledgement
+static void read_worker_ack(int i, tomo_msg_t *msg)
+{
+  tomo_msg_data_req_t *req = tracemq_read_data_req(msg);
+  if(req!=NULL) worker_tput[i] = req->throughput;
+}
+
+static int rebalance()
+{
+  for(int i=0; i<n_workers; ++i)
+    if(worker_tput[i]<=0.) return 0;  /// Not measured yet
+
+  uint32_t *new_ranges = (uint32_t *) malloc(2*n_workers*sizeof(uint32_t));
+  balance_data(n_workers, tot_rows, worker_tput, new_ranges);
+  double max_change = 0.;
+  for(int i=0; i<n_workers; ++i){
+    double change = ((double)new_ranges[2*i+1]-worker_ranges[2*i+1]) /
+                    worker_ranges[2*i+1];
+    if(change<0.) change = -change;
+    if(change>max_change) max_change = change;
+  }
+  if(max_change<=rebalance_threshold){
+    free(new_ranges);
+    return 0;
+  }
+
+  printf("Rebalancing sinograms:");
+  for(int i=0; i<n_workers; ++i)
+    printf(" [%d] %u->%u (%.1f)", i, worker_ranges[2*i+1], new_ranges[2*i+1],
+        worker_tput[i]);
+  printf("\n");
+
+  tomo_msg_t *msg = tracemq_prepare_reassign_msg(seq, n_workers,
+                                                 worker_ranges, new_ranges);
+  for(int i=0; i<n_workers; ++i) tracemq_send_msg(workers[i], msg);
+  tracemq_free_msg(msg);
+  ++seq;
+
+  for(int i=0; i<n_workers; ++i){
+    msg = tracemq_recv_msg(workers[i]);
+    assert(msg->type==TRACEMQ_MSG_DATA_REQ);
+    assert(msg->seq_n==seq);
+    tracemq_free_msg(msg);
+  }
+  ++seq;
+
+  /// Measurements were taken with the previous assignment
+  for(int i=0; i<n_workers; ++i) worker_tput[i] = 0.;
+  free(worker_ranges);
+  worker_ranges = new_ranges;
+
+  return 1;
+}
+
 int handshake(char *bindip, int port, int row, int col)
 {
   /// Figure out how many ranks there is at the remote location
@@ -92,7 +196,15 @@ int handshake(char *bindip, int port, int row, int col)
   worker_ids = (int*)malloc(n_workers*sizeof(int));
   workers = (void**)malloc(n_workers*sizeof(void*)); assert(workers!=NULL);
   worker_ids[0] = info->comm_rank;
+  uint32_t worker_codecs = info->codecs;
+  group_size = (info->group_size>0) ? (int)info->group_size : 1;
   tracemq_free_msg(msg);
+  if(n_workers%group_size != 0){
+    printf("Number of workers (%d) is not a multiple of the group size (%d)\n",
+        n_workers, group_size);
+    return -1;
+  }
+  printf("group_size=%d\n", group_size);
 
   /// Setup remaining workers' sockets 
   workers[0] = main_worker; /// We already know main worker
@@ -112,21 +224,40 @@ int handshake(char *bindip, int port, int row, int col)
    printf("Received worker %d message\n", i);
    tomo_msg_data_info_req_t* info = tracemq_read_data_info_req(msg);
    worker_ids[i]=info->comm_rank;
+   worker_codecs &= info->codecs;
+   assert((int)info->group_size==group_size);
    tracemq_free_msg(msg);
   }
   ++seq;
 
+  /// Every worker has to be able to decompress
+  if(!(worker_codecs & (1u<<codec))){
+    printf("Codec %s is not supported by all workers, sending raw data\n",
+        trace_codec_name(codec));
+    codec = TRACE_CODEC_NONE;
+  }
+
+  if(rebalance_freq>0 && group_size>1){
+    printf("Rebalancing is not supported with projection groups\n");
+    rebalance_freq = 0;
+  }
+  tot_rows = row;
+  worker_ranges = (uint32_t *) malloc(2*n_workers*sizeof(uint32_t));
+  worker_tput = (double *) calloc(n_workers, sizeof(double));
+
   /// Distribute data info
   for(int i=0; i<n_workers; ++i){
-   tomo_msg_data_info_rep_t info = assign_data(worker_ids[i], n_workers, 
-                                      row, col);
+   tomo_msg_data_info_rep_t info = assign_data(worker_ids[i]/group_size, 
+                                      n_workers/group_size, row, col);
+   worker_ranges[2*i] = info.beg_sinogram;
+   worker_ranges[2*i+1] = info.n_sinograms;
    printf("Sending data infor to worker (%ds); Total # sinograms=%u; Beginning sinogram id=%u;"
            "# assigned sinograms=%u; # rays per projection row=%u\n", 
            i, info.tn_sinograms, info.beg_sinogram, info.n_sinograms, 
            info.n_rays_per_proj_row);
    tomo_msg_t *msg = tracemq_prepare_data_info_rep_msg(seq, 
                          info.beg_sinogram, info.n_sinograms, 
-                         info.n_rays_per_proj_row, info.tn_sinograms);
+                         info.n_rays_per_proj_row, info.tn_sinograms, codec);
    tracemq_send_msg(workers[i], msg);
    tracemq_free_msg(msg);
   }
@@ -160,9 +291,17 @@ int push_image(float *data, int n, int row, int col, float theta, int id, float
       proj.id, center, dims[0], dims[1], theta);
 
   /// Default center is middle of columns
-  tomo_msg_t **worker_msgs = generate_tracemq_worker_msgs(
+  int owner = (int)(n_projs_pushed++ % group_size);
+  tomo_msg_t **worker_msgs = (codec==TRACE_CODEC_NONE) ?
+    generate_tracemq_worker_msgs(
       proj.data, proj.dims, proj.id, 
-      proj.theta, n_workers, center, seq);
+      proj.theta, n_workers, center, seq, group_size, owner,
+      (group_size==1) ? worker_ranges : NULL) :
+    generate_tracemq_worker_cmsgs(
+      proj.data, proj.dims, proj.id, 
+      proj.theta, n_workers, center, seq, group_size, owner,
+      (group_size==1) ? worker_ranges : NULL,
+      codec, codec_level, codec_threads);
 
   /// Send data to workers
   for(int i=0; i<n_workers; ++i){
@@ -182,10 +321,14 @@ int push_image(float *data, int n, int row, int col, float theta, int id, float
     tomo_msg_t *msg = tracemq_recv_msg(workers[i]);
     assert(msg->type==TRACEMQ_MSG_DATA_REQ);
     assert(msg->seq_n==seq);
+    read_worker_ack(i, msg);
     tracemq_free_msg(msg);
   }
   ++seq;
 
+  if(rebalance_freq>0 && n_projs_pushed%rebalance_freq==0)
+    rebalance();
+
   /// Clean-up data chunks
   for(int i=0; i<n_workers; ++i)
     free(worker_msgs[i]);
@@ -222,11 +365,16 @@ int done_image()
 int finalize_tmq()
 {
   /// Cleanup resources
+  tracemq_free_compression_pool();
   for(int i=0; i<n_workers; ++i){
     zmq_close (workers[i]);
   }
   zmq_ctx_destroy (context);
   free(workers);
+  free(worker_ranges);
+  free(worker_tput);
+  worker_ranges = NULL;
+  worker_tput = NULL;
 
   return 0;
 }
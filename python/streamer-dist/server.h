@@ -7,6 +7,8 @@ int finalize_tmq();
 int done_image();
 int push_image(float *data, int n, int row, int col, float theta, int id, float center);
 int handshake(char *bindip, int port, int row, int col);
+int set_compression(char *name, int level, int nthreads);
+int set_rebalance(int freq, double threshold);
 int setup_mock_data(char *fp, int nsubsets);
 int get_num_workers();
 int whatsup();
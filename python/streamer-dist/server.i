@@ -19,6 +19,8 @@ extern int done_image();
 %apply (float* IN_ARRAY1, int DIM1) {(float* data, int n)};
 extern int push_image(float *data, int n, int row, int col, float theta, int id, float center);
 extern int handshake(char *bindip, int port, int row, int col);
+extern int set_compression(char *name, int level, int nthreads);
+extern int set_rebalance(int freq, double threshold);
 extern int setup_mock_data(char *fp, int nsubsets);
 extern int get_num_workers();
 extern int whatsup();
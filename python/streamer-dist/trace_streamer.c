@@ -2,6 +2,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <assert.h>
+#include <pthread.h>
 #include "zmq.h"
 #include "trace_streamer.h"
 
@@ -28,6 +29,33 @@ tomo_msg_t* tracemq_prepare_data_req_msg(uint64_t seq_n)
   return msg;
 }
 
+tomo_msg_data_req_t* tracemq_read_data_req(tomo_msg_t *msg){
+  if(msg->size < sizeof(tomo_msg_t)+sizeof(tomo_msg_data_req_t)) return NULL;
+  return (tomo_msg_data_req_t *) msg->data;
+}
+
+tomo_msg_t* tracemq_prepare_reassign_msg(uint64_t seq_n, uint32_t n_ranks,
+                                         const uint32_t *old_ranges,
+                                         const uint32_t *new_ranges)
+{
+  size_t ranges_size = 2*n_ranks*sizeof(uint32_t);
+  uint64_t tot_msg_size = sizeof(tomo_msg_t)+sizeof(tomo_msg_reassign_t)+
+                          2*ranges_size;
+  tomo_msg_t *msg_h = (tomo_msg_t *)malloc(tot_msg_size);
+  tracemq_setup_msg_header(msg_h, seq_n, TRACEMQ_MSG_REASSIGN_REP, tot_msg_size);
+
+  tomo_msg_reassign_t *msg = (tomo_msg_reassign_t *) msg_h->data;
+  msg->n_ranks = n_ranks;
+  memcpy(msg->ranges, old_ranges, ranges_size);
+  memcpy(msg->ranges+2*n_ranks, new_ranges, ranges_size);
+
+  return msg_h;
+}
+
+tomo_msg_reassign_t* tracemq_read_reassign(tomo_msg_t *msg){
+  return (tomo_msg_reassign_t *) msg->data;
+}
+
 tomo_msg_t* tracemq_prepare_data_rep_msg( uint64_t seq_n, int projection_id, 
                                           float theta, float center, 
                                           uint64_t data_size, float *data)
@@ -40,6 +68,7 @@ tomo_msg_t* tracemq_prepare_data_rep_msg( uint64_t seq_n, int projection_id,
   msg->projection_id = projection_id;
   msg->theta = theta;
   msg->center = center;
+  msg->owner = 0;
   memcpy(msg->data, data, data_size);
   
   printf("theta=%f\n", theta);
@@ -47,10 +76,51 @@ tomo_msg_t* tracemq_prepare_data_rep_msg( uint64_t seq_n, int projection_id,
   return msg_h;
 }
 
+/* Compresses data into a message allocated for the worst case; size is set
+ * to the actual message size. Falls back to TRACE_CODEC_NONE if data does
+ * not compress. ctx may be NULL, at the cost of allocating the codec state
+ * for this message. */
+tomo_msg_t* tracemq_prepare_cdata_rep_msg(trace_codec_ctx_t *ctx,
+                                          uint64_t seq_n, int projection_id,
+                                          float theta, float center,
+                                          uint32_t codec, int level,
+                                          uint64_t data_size, float *data)
+{
+  size_t bound = trace_codec_bound(codec, data_size);
+  if(bound<data_size) bound = data_size;
+  uint64_t max_msg_size=sizeof(tomo_msg_t)+sizeof(tomo_msg_cdata_t)+bound;
+  tomo_msg_t *msg_h = (tomo_msg_t *)malloc(max_msg_size);
+  tomo_msg_cdata_t *msg = (tomo_msg_cdata_t *) msg_h->data;
+
+  msg->projection_id = projection_id;
+  msg->theta = theta;
+  msg->center = center;
+  msg->owner = 0;
+  msg->raw_size = data_size;
+  msg->codec = codec;
+  msg->comp_size = (ctx!=NULL) ?
+    trace_codec_compress_ctx(ctx, codec, data, data_size, msg->data, bound,
+                             level) :
+    trace_codec_compress(codec, data, data_size, msg->data, bound, level);
+  if(msg->comp_size==0 || msg->comp_size>=data_size){
+    msg->codec = TRACE_CODEC_NONE;
+    msg->comp_size = data_size;
+    memcpy(msg->data, data, data_size);
+  }
+  tracemq_setup_msg_header(msg_h, seq_n, TRACEMQ_MSG_CDATA_REP, 
+      sizeof(tomo_msg_t)+sizeof(tomo_msg_cdata_t)+msg->comp_size);
+
+  return msg_h;
+}
+
 tomo_msg_data_t* tracemq_read_data(tomo_msg_t *msg){
   return (tomo_msg_data_t *) msg->data;
 }
 
+tomo_msg_cdata_t* tracemq_read_cdata(tomo_msg_t *msg){
+  return (tomo_msg_cdata_t *) msg->data;
+}
+
 void tracemq_print_data(tomo_msg_data_t *msg, size_t data_count){
   printf("projection_id=%u; theta=%f; center=%f\n", 
     msg->projection_id, msg->theta, msg->center);
@@ -62,7 +132,8 @@ void tracemq_print_data(tomo_msg_data_t *msg, size_t data_count){
 tomo_msg_t* tracemq_prepare_data_info_rep_msg(uint64_t seq_n, 
                                               int beg_sinogram, int n_sinograms,
                                               int n_rays_per_proj_row,
-                                              uint64_t tn_sinograms)
+                                              uint64_t tn_sinograms,
+                                              uint32_t codec)
 {
   uint64_t tot_msg_size = sizeof(tomo_msg_t)+sizeof(tomo_msg_data_info_rep_t);
   tomo_msg_t *msg = (tomo_msg_t *)malloc(tot_msg_size);
@@ -73,6 +144,7 @@ tomo_msg_t* tracemq_prepare_data_info_rep_msg(uint64_t seq_n,
   info->beg_sinogram = beg_sinogram;
   info->n_sinograms = n_sinograms;
   info->n_rays_per_proj_row = n_rays_per_proj_row;
+  info->codec = codec;
 
   return msg;
 }
@@ -81,8 +153,9 @@ tomo_msg_data_info_rep_t* tracemq_read_data_info_rep(tomo_msg_t *msg){
 }
 void tracemq_print_data_info_rep_msg(tomo_msg_data_info_rep_t *msg){
   printf("Total # sinograms=%u; Beginning sinogram id=%u;"
-          "# assigned sinograms=%u; # rays per projection row=%u\n", 
-          msg->tn_sinograms, msg->beg_sinogram, msg->n_sinograms, msg->n_rays_per_proj_row);
+          "# assigned sinograms=%u; # rays per projection row=%u; codec=%s\n", 
+          msg->tn_sinograms, msg->beg_sinogram, msg->n_sinograms, msg->n_rays_per_proj_row,
+          trace_codec_name(msg->codec));
 }
 
 tomo_msg_t* tracemq_prepare_data_info_req_msg(uint64_t seq_n, uint32_t comm_rank, uint32_t comm_size){
@@ -94,6 +167,8 @@ tomo_msg_t* tracemq_prepare_data_info_req_msg(uint64_t seq_n, uint32_t comm_rank
   tomo_msg_data_info_req_t *info = (tomo_msg_data_info_req_t *) msg->data;
   info->comm_rank = comm_rank;
   info->comm_size = comm_size;
+  info->codecs = trace_codec_supported();
+  info->group_size = 1;
 
   return msg;
 }
@@ -156,24 +231,257 @@ tomo_msg_data_info_rep_t assign_data( uint32_t comm_rank, int comm_size,
 }
 
 
+void balance_data(int n_ranks, int tot_sino, const double *throughput,
+                  uint32_t *ranges)
+{
+  double tot_tput = 0.;
+  for(int i=0; i<n_ranks; ++i) tot_tput += throughput[i];
+
+  /* Every rank keeps at least one row; the remaining rows are split
+   * proportionally, leftovers go to the largest fractional parts. */
+  int spare = tot_sino - n_ranks;
+  double *frac = (double *) malloc(n_ranks*sizeof(double));
+  int assigned = 0;
+  for(int i=0; i<n_ranks; ++i){
+    double share = (tot_tput>0.) ? spare*throughput[i]/tot_tput : 
+                                   (double)spare/n_ranks;
+    int n = (int)share;
+    ranges[2*i+1] = 1+n;
+    frac[i] = share-n;
+    assigned += n;
+  }
+  for(; assigned<spare; ++assigned){
+    int best = 0;
+    for(int i=1; i<n_ranks; ++i) if(frac[i]>frac[best]) best = i;
+    ranges[2*best+1]++;
+    frac[best] = -1.;
+  }
+  free(frac);
+
+  uint32_t beg = 0;
+  for(int i=0; i<n_ranks; ++i){
+    ranges[2*i] = beg;
+    beg += ranges[2*i+1];
+  }
+}
+
+/* First row and number of rows of each group; ranges (beg, n pairs) or an
+ * even split if NULL */
+static void group_rows(int tot_rows, int n_groups, const uint32_t *ranges,
+                       int *beg, int *n)
+{
+  int nsin = tot_rows/n_groups;
+  int remaining = tot_rows%n_groups;
+
+  int curr_sinogram_id = 0;
+  for(int i=0; i<n_groups; ++i){
+    int r = ((remaining--) > 0) ? 1 : 0;
+    beg[i] = (ranges!=NULL) ? (int)ranges[2*i] : curr_sinogram_id;
+    n[i] = (ranges!=NULL) ? (int)ranges[2*i+1] : nsin+r;
+    curr_sinogram_id += (nsin+r);
+  }
+}
+
+/* Workers i*group_size..(i+1)*group_size-1 receive the same rows. The
+ * message of the first member of each group is copied to the others. */
+static void replicate_group_msgs(tomo_msg_t **msgs, int n_ranks, int group_size,
+                                 int owner)
+{
+  for(int i=0; i<n_ranks; i+=group_size){
+    tomo_msg_t *msg = msgs[i];
+    if(msg->type == TRACEMQ_MSG_CDATA_REP) tracemq_read_cdata(msg)->owner = owner;
+    else tracemq_read_data(msg)->owner = owner;
+    for(int j=1; j<group_size; ++j){
+      msgs[i+j] = (tomo_msg_t *) malloc(msg->size);
+      memcpy(msgs[i+j], msg, msg->size);
+    }
+  }
+}
+
 tomo_msg_t** generate_tracemq_worker_msgs(float *data, int dims[], int data_id,
                                           float theta, int n_ranks, float center,
-                                          uint64_t seq)
+                                          uint64_t seq, int group_size, 
+                                          int owner, const uint32_t *ranges)
 {
-  int nsin = dims[0]/n_ranks;
-  int remaining = dims[0]%n_ranks;
+  int n_groups = n_ranks/group_size;
+  int *beg = (int *) malloc(n_groups*sizeof(int));
+  int *n = (int *) malloc(n_groups*sizeof(int));
+  group_rows(dims[0], n_groups, ranges, beg, n);
 
   tomo_msg_t **msgs = (tomo_msg_t **) malloc(n_ranks*sizeof(tomo_msg_t*));
 
-  int curr_sinogram_id = 0;
-  for(int i=0; i<n_ranks; ++i){
-    int r = ((remaining--) > 0) ? 1 : 0;
-    size_t data_size = sizeof(*data)*(nsin+r)*dims[1];
+  for(int i=0; i<n_groups; ++i){
+    size_t data_size = sizeof(*data)*n[i]*dims[1];
     tomo_msg_t *msg = tracemq_prepare_data_rep_msg(seq, 
                               data_id, theta, center, data_size, 
-                              data+curr_sinogram_id*dims[1]);
-    msgs[i] = msg;
-    curr_sinogram_id += (nsin+r);
+                              data+beg[i]*dims[1]);
+    msgs[i*group_size] = msg;
   }
+  replicate_group_msgs(msgs, n_ranks, group_size, owner);
+  free(beg);
+  free(n);
   return msgs;
 }
+
+
+/* Work description for the compression threads */
+typedef struct {
+  tomo_msg_t **msgs;
+  float *data;
+  int *beg_sinogram;          /* First row of each group */
+  int *n_sinograms;           /* Number of rows of each group */
+  int n_cols;
+  int data_id;
+  float theta;
+  float center;
+  uint64_t seq;
+  uint32_t codec;
+  int level;
+  int n_groups;
+  int group_size;
+  int n_threads;
+} cmsgs_work_t;
+
+/* Compression threads; they are kept across projections, together with
+ * their codec state, and are woken up for every projection. The calling
+ * thread compresses its share as task 0, with ctxs[0]. */
+static struct {
+  int n_threads;
+  pthread_t *threads;
+  int *tids;
+  trace_codec_ctx_t **ctxs;
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  uint64_t generation;        /* Incremented for every projection */
+  int pending;                /* Workers still compressing */
+  int quit;
+  cmsgs_work_t *work;
+} cpool = { 0, NULL, NULL, NULL, PTHREAD_MUTEX_INITIALIZER,
+            PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, 0,
+            NULL };
+
+static void compress_msgs(cmsgs_work_t *w, int tid)
+{
+  for(int i=tid; i<w->n_groups; i+=w->n_threads){
+    size_t data_size = sizeof(*w->data)*w->n_sinograms[i]*w->n_cols;
+    w->msgs[i*w->group_size] = tracemq_prepare_cdata_rep_msg(cpool.ctxs[tid],
+                    w->seq, w->data_id, w->theta, w->center, w->codec,
+                    w->level, data_size, w->data+w->beg_sinogram[i]*w->n_cols);
+  }
+}
+
+static void* compress_worker_msgs(void *arg)
+{
+  int tid = *(int *)arg;
+  uint64_t seen = 0;
+  for(;;){
+    pthread_mutex_lock(&cpool.lock);
+    while(cpool.generation==seen && !cpool.quit)
+      pthread_cond_wait(&cpool.start, &cpool.lock);
+    if(cpool.quit){
+      pthread_mutex_unlock(&cpool.lock);
+      return NULL;
+    }
+    seen = cpool.generation;
+    cmsgs_work_t *w = cpool.work;
+    pthread_mutex_unlock(&cpool.lock);
+
+    compress_msgs(w, tid);
+
+    pthread_mutex_lock(&cpool.lock);
+    if(--cpool.pending==0) pthread_cond_signal(&cpool.done);
+    pthread_mutex_unlock(&cpool.lock);
+  }
+}
+
+void tracemq_free_compression_pool()
+{
+  pthread_mutex_lock(&cpool.lock);
+  cpool.quit = 1;
+  pthread_cond_broadcast(&cpool.start);
+  pthread_mutex_unlock(&cpool.lock);
+  for(int t=1; t<cpool.n_threads; ++t)
+    pthread_join(cpool.threads[t], NULL);
+  for(int t=0; t<cpool.n_threads; ++t)
+    trace_codec_ctx_free(cpool.ctxs[t]);
+  free(cpool.threads);
+  free(cpool.tids);
+  free(cpool.ctxs);
+  cpool.threads = NULL;
+  cpool.tids = NULL;
+  cpool.ctxs = NULL;
+  cpool.n_threads = 0;
+  cpool.quit = 0;
+}
+
+/* (Re)creates the pool if it does not have n_threads threads */
+static void setup_compression_pool(int n_threads)
+{
+  if(cpool.n_threads==n_threads) return;
+  tracemq_free_compression_pool();
+  cpool.threads = (pthread_t *) malloc(n_threads*sizeof(pthread_t));
+  cpool.tids = (int *) malloc(n_threads*sizeof(int));
+  cpool.ctxs = (trace_codec_ctx_t **) malloc(n_threads*sizeof(trace_codec_ctx_t*));
+  cpool.generation = 0;
+  for(int t=0; t<n_threads; ++t){
+    cpool.tids[t] = t;
+    cpool.ctxs[t] = trace_codec_ctx_create();
+  }
+  for(int t=1; t<n_threads; ++t){
+    int rc = pthread_create(&cpool.threads[t], NULL, compress_worker_msgs,
+                            &cpool.tids[t]);
+    assert(rc==0);
+  }
+  cpool.n_threads = n_threads;
+}
+
+tomo_msg_t** generate_tracemq_worker_cmsgs(float *data, int dims[], int data_id,
+                                           float theta, int n_ranks,
+                                           float center, uint64_t seq,
+                                           int group_size, int owner,
+                                           const uint32_t *ranges,
+                                           uint32_t codec, int level,
+                                           int n_threads)
+{
+  int n_groups = n_ranks/group_size;
+
+  cmsgs_work_t work;
+  work.msgs = (tomo_msg_t **) malloc(n_ranks*sizeof(tomo_msg_t*));
+  work.beg_sinogram = (int *) malloc(n_groups*sizeof(int));
+  work.n_sinograms = (int *) malloc(n_groups*sizeof(int));
+  work.data = data;
+  work.n_cols = dims[1];
+  work.data_id = data_id;
+  work.theta = theta;
+  work.center = center;
+  work.seq = seq;
+  work.codec = codec;
+  work.level = level;
+  work.n_groups = n_groups;
+  work.group_size = group_size;
+  work.n_threads = (n_threads<1) ? 1 : ((n_threads>n_groups) ? n_groups : n_threads);
+
+  /* Same row partitioning as generate_tracemq_worker_msgs */
+  group_rows(dims[0], n_groups, ranges, work.beg_sinogram, work.n_sinograms);
+
+  setup_compression_pool(work.n_threads);
+  pthread_mutex_lock(&cpool.lock);
+  cpool.work = &work;
+  cpool.pending = work.n_threads-1;
+  ++cpool.generation;
+  pthread_cond_broadcast(&cpool.start);
+  pthread_mutex_unlock(&cpool.lock);
+
+  compress_msgs(&work, 0);
+
+  pthread_mutex_lock(&cpool.lock);
+  while(cpool.pending>0)
+    pthread_cond_wait(&cpool.done, &cpool.lock);
+  pthread_mutex_unlock(&cpool.lock);
+  replicate_group_msgs(work.msgs, n_ranks, group_size, owner);
+
+  free(work.beg_sinogram);
+  free(work.n_sinograms);
+  return work.msgs;
+}
@@ -7,9 +7,13 @@
 
 #define TRACEMQ_MSG_DATA_REQ      0x00000010
 #define TRACEMQ_MSG_DATA_REP      0x00000020
+#define TRACEMQ_MSG_CDATA_REP     0x00000021
+
+#define TRACEMQ_MSG_REASSIGN_REP  0x00000030
 
 #include <stdint.h>
 #include <stddef.h>
+#include "trace_codec.h"
 
 struct _tomo_msg_h_str {
   uint64_t seq_n;
@@ -23,11 +27,14 @@ struct _tomo_msg_data_info_rep_str {
 	uint32_t beg_sinogram;
   uint32_t n_sinograms;
   uint32_t n_rays_per_proj_row;
+  uint32_t codec;           // TRACE_CODEC_* the distributor will use
 };
 
 struct _tomo_msg_data_info_req_str {
   uint32_t comm_rank; 
   uint32_t comm_size;
+  uint32_t codecs;          // Mask of codecs this worker can decompress
+  uint32_t group_size;      // Number of consecutive ranks sharing sinograms
 };
 
 /* Center, tn_sinogram, n_rays_per_proj_row are all global and can be sent only once.
@@ -36,12 +43,44 @@ struct _tomo_msg_data_str {
 	int projection_id;        // projection id
 	float theta;              // theta value of this projection
 	float center;               // center of the projecion
+	int owner;                // group member that reconstructs this projection
 	float data[];             // real projection data
 	// number of rays in data=n_sinogram*n_rays_per_proj_row (n_sinogram*n_rays_per_proj_row were given in req msg.)
 };
 
+/* Compressed projection, TRACEMQ_MSG_CDATA_REP. data holds comp_size bytes
+ * that decompress to raw_size bytes, i.e. the float data of
+ * _tomo_msg_data_str.
+ */
+struct _tomo_msg_cdata_str {
+	int projection_id;        // projection id
+	float theta;              // theta value of this projection
+	float center;             // center of the projecion
+	int owner;                // group member that reconstructs this projection
+	uint32_t codec;           // TRACE_CODEC_* used for this message
+	uint64_t raw_size;        // size of the decompressed data in bytes
+	uint64_t comp_size;       // size of data in bytes
+	char data[];
+};
+
+/* Optional body of TRACEMQ_MSG_DATA_REQ (projection acknowledgement) */
+struct _tomo_msg_data_req_str {
+  double throughput;        // Latest measured sinogram rows*projections/sec, 0 if unknown
+};
+
+/* TRACEMQ_MSG_REASSIGN_REP: new sinogram ranges, in effect for the following
+ * projections. ranges holds (beg_sinogram, n_sinograms) of every rank, first
+ * the current then the new ones, i.e. 4*n_ranks values. */
+struct _tomo_msg_reassign_str {
+  uint32_t n_ranks;
+  uint32_t ranges[];
+};
+
 typedef struct _tomo_msg_h_str tomo_msg_t;
+typedef struct _tomo_msg_data_req_str tomo_msg_data_req_t;
+typedef struct _tomo_msg_reassign_str tomo_msg_reassign_t;
 typedef struct _tomo_msg_data_str tomo_msg_data_t;
+typedef struct _tomo_msg_cdata_str tomo_msg_cdata_t;
 typedef struct _tomo_msg_data_info_req_str tomo_msg_data_info_req_t;
 typedef struct _tomo_msg_data_info_rep_str tomo_msg_data_info_rep_t;
 
@@ -49,15 +88,28 @@ void tracemq_free_msg(tomo_msg_t *msg);
 void tracemq_setup_msg_header(tomo_msg_t *msg_h, uint64_t seq_n, uint64_t type,
                               uint64_t size);
 tomo_msg_t* tracemq_prepare_data_req_msg(uint64_t seq_n);
+/* Returns NULL if the worker did not report its throughput */
+tomo_msg_data_req_t* tracemq_read_data_req(tomo_msg_t *msg);
+tomo_msg_t* tracemq_prepare_reassign_msg(uint64_t seq_n, uint32_t n_ranks,
+                                         const uint32_t *old_ranges,
+                                         const uint32_t *new_ranges);
+tomo_msg_reassign_t* tracemq_read_reassign(tomo_msg_t *msg);
 tomo_msg_t* tracemq_prepare_data_rep_msg(uint64_t seq_n, int projection_id,
                                          float theta, float center,
                                          uint64_t data_size, float *data);
+tomo_msg_t* tracemq_prepare_cdata_rep_msg(trace_codec_ctx_t *ctx,
+                                          uint64_t seq_n, int projection_id,
+                                          float theta, float center,
+                                          uint32_t codec, int level,
+                                          uint64_t data_size, float *data);
 tomo_msg_data_t* tracemq_read_data(tomo_msg_t *msg);
+tomo_msg_cdata_t* tracemq_read_cdata(tomo_msg_t *msg);
 void tracemq_print_data(tomo_msg_data_t *msg, size_t data_count);
 tomo_msg_t* tracemq_prepare_data_info_rep_msg(uint64_t seq_n, 
                                               int beg_sinogram, int n_sinograms,
                                               int n_rays_per_proj_row,
-                                              uint64_t tn_sinograms);
+                                              uint64_t tn_sinograms,
+                                              uint32_t codec);
 tomo_msg_data_info_rep_t* tracemq_read_data_info_rep(tomo_msg_t *msg);
 void tracemq_print_data_info_rep_msg(tomo_msg_data_info_rep_t *msg);
 tomo_msg_t* tracemq_prepare_data_info_req_msg(uint64_t seq_n, 
@@ -72,8 +124,29 @@ tomo_msg_t* tracemq_recv_msg(void *server);
 
 tomo_msg_data_info_rep_t assign_data( uint32_t comm_rank, int comm_size, 
                                       int tot_sino, int tot_cols);
+/* Splits tot_sino rows among n_ranks proportionally to their throughput;
+ * every rank gets at least one row. ranges: (beg, n) pairs of the ranks. */
+void balance_data(int n_ranks, int tot_sino, const double *throughput,
+                  uint32_t *ranges);
+/* Splits the rows of a projection among groups of group_size consecutive
+ * workers; all members of a group receive the same rows, and owner tells
+ * which member reconstructs this projection. ranges gives the (beg, n) rows
+ * of every group; NULL splits the rows evenly, like assign_data. */
 tomo_msg_t** generate_tracemq_worker_msgs(float *data, int dims[], int data_id,
                                           float theta, int n_ranks, 
-                                          float center, uint64_t seq);
+                                          float center, uint64_t seq,
+                                          int group_size, int owner,
+                                          const uint32_t *ranges);
+/* Same as generate_tracemq_worker_msgs, but each group's rows are
+ * compressed with codec, using n_threads threads. The threads and their
+ * codec state persist across calls until tracemq_free_compression_pool(). */
+tomo_msg_t** generate_tracemq_worker_cmsgs(float *data, int dims[], int data_id,
+                                           float theta, int n_ranks,
+                                           float center, uint64_t seq,
+                                           int group_size, int owner,
+                                           const uint32_t *ranges,
+                                           uint32_t codec, int level,
+                                           int n_threads);
+void tracemq_free_compression_pool();
 
 #endif  // _TRACE_STREAMER_H
@@ -3,6 +3,9 @@
 #include <cstring>  // For memset
 #include <cstdlib>  // For malloc, free
 #include <iostream> // For std::cout, std::cerr, std::endl
+#ifdef _OPENMP
+#include <omp.h>    // For omp_get_thread_num, omp_get_num_threads
+#endif
 
 void
 preprocessing(int ry, int rz, int num_pixels, float center, float* mov, float* gridx,
@@ -197,9 +200,59 @@ sort_intersections(int ind_condition, int asize, const float* ax, const float* a
 
 //======================================================================================//
 
+// Scratch arrays of an ART thread, carved out of a single allocation made
+// once per art() call. Every array holds at least ngridx + ngridy + 1 elements.
+struct art_scratch
+{
+    float* coordx;
+    float* coordy;
+    float* ax;
+    float* ay;
+    float* bx;
+    float* by;
+    float* coorx;
+    float* coory;
+    float* diffx;
+    float* diffy;
+    int*   indx;
+    int*   indy;
+    void*  block;
+};
+
+//======================================================================================//
+
+void
+alloc_scratch(int ngridx, int ngridy, art_scratch* scratch)
+{
+    const size_t len = ngridx + ngridy + 1;
+    char*        p   = (char*) malloc(12 * len * sizeof(float));
+    assert(p != NULL && sizeof(int) == sizeof(float));
+
+    float** arrays[10] = { &scratch->coordx, &scratch->coordy, &scratch->ax,
+                           &scratch->ay,     &scratch->bx,     &scratch->by,
+                           &scratch->coorx,  &scratch->coory,  &scratch->diffx,
+                           &scratch->diffy };
+    for(int i = 0; i < 10; ++i)
+        *arrays[i] = (float*) (p + i * len * sizeof(float));
+    scratch->indx  = (int*) (p + 10 * len * sizeof(float));
+    scratch->indy  = (int*) (p + 11 * len * sizeof(float));
+    scratch->block = p;
+}
+
+//======================================================================================//
+
+void
+free_scratch(art_scratch* scratch)
+{
+    free(scratch->block);
+    scratch->block = NULL;
+}
+
+//======================================================================================//
+
 void
 calc_dist(int ry, int rz, int csize, const float* coorx, const float* coory, int* indi,
-          float* dist)
+          float* dist, art_scratch* scratch)
 {
     if(csize < 2)
         return;
@@ -209,8 +262,8 @@ calc_dist(int ry, int rz, int csize, const float* coorx, const float* coory, int
     //              calculate dist
     //------------------------------------------------------------------------//
     {
-        float* _diffx = (float*)malloc(_size * sizeof(float));
-        float* _diffy = (float*)malloc(_size * sizeof(float));
+        float* _diffx = scratch->diffx;
+        float* _diffy = scratch->diffy;
 
 #pragma omp simd
         for(int n = 0; n < _size; ++n)
@@ -230,16 +283,14 @@ calc_dist(int ry, int rz, int csize, const float* coorx, const float* coory, int
             dist[n] = sqrtf(_diffx[n] + _diffy[n]);
         }
 
-        free(_diffx);
-        free(_diffy);
     }
 
     //------------------------------------------------------------------------//
     //              calculate indi
     //------------------------------------------------------------------------//
 
-    int* _indx = (int*)malloc(_size * sizeof(int));
-    int* _indy = (int*)malloc(_size * sizeof(int));
+    int* _indx = scratch->indx;
+    int* _indy = scratch->indy;
 
 #pragma omp simd
     for(int n = 0; n < _size; ++n)
@@ -262,9 +313,6 @@ calc_dist(int ry, int rz, int csize, const float* coorx, const float* coory, int
     {
         indi[n] = _indy[n] + (_indx[n] * rz);
     }
-
-    free(_indx);
-    free(_indy);
 }
 
 //======================================================================================//
@@ -371,128 +419,299 @@ calc_simdata3(int s, int p, int d, int ry, int rz, int dt, int dx, int csize,
 
 //======================================================================================//
 
+// Forward projection and update of one ray for the W slices of block b of
+// the slice-interleaved reconstruction (pixel-major, W slices innermost).
+// Every pixel address serves all lanes; each lane performs the operations
+// of the per-slice update in the same order. Lanes past dy are padding and
+// stay zero.
+template <int W>
+void
+update_interleaved(int b, int p, int d, int dy, int dt, int dx, int npixels, int csize,
+                   const int* indi, const float* dist, float sum_dist2,
+                   const float* data, float* recon_il)
+{
+    float* block = recon_il + (size_t) b * npixels * W;
+    float  simdata[W];
+    float  upd[W];
+
+    for(int l = 0; l < W; ++l)
+    {
+        simdata[l] = 0.0f;
+    }
+    for(int n = 0; n < csize - 1; n++)
+    {
+        const float* pixel = block + (size_t) indi[n] * W;
+        const float  w     = dist[n];
+#pragma omp simd
+        for(int l = 0; l < W; ++l)
+        {
+            simdata[l] += pixel[l] * w;
+        }
+    }
+
+    for(int l = 0; l < W; ++l)
+    {
+        int s  = b * W + l;
+        upd[l] = (s < dy) ? (data[d + p * dx + s * dt * dx] - simdata[l]) / sum_dist2
+                          : 0.0f;
+    }
+    for(int n = 0; n < csize - 1; n++)
+    {
+        float*      pixel = block + (size_t) indi[n] * W;
+        const float w     = dist[n];
+#pragma omp simd
+        for(int l = 0; l < W; ++l)
+        {
+            pixel[l] += upd[l] * w;
+        }
+    }
+}
+
+//======================================================================================//
+
+void
+interleave_slices(int dy, int npixels, int lanes, const float* recon, float* recon_il)
+{
+    int nblocks = (dy + lanes - 1) / lanes;
+    memset(recon_il, 0, (size_t) nblocks * npixels * lanes * sizeof(float));
+    for(int s = 0; s < dy; ++s)
+    {
+        float* block = recon_il + (size_t) (s / lanes) * npixels * lanes + s % lanes;
+        for(int i = 0; i < npixels; ++i)
+        {
+            block[(size_t) i * lanes] = recon[(size_t) s * npixels + i];
+        }
+    }
+}
+
+//======================================================================================//
+
+void
+deinterleave_slices(int dy, int npixels, int lanes, const float* recon_il, float* recon)
+{
+    for(int s = 0; s < dy; ++s)
+    {
+        const float* block =
+            recon_il + (size_t) (s / lanes) * npixels * lanes + s % lanes;
+        for(int i = 0; i < npixels; ++i)
+        {
+            recon[(size_t) s * npixels + i] = block[(size_t) i * lanes];
+        }
+    }
+}
+
+//======================================================================================//
+
 void
 art(const float* data, int dy, int dt, int dx, const float* center, const float* theta,
-    float* recon, int ngridx, int ngridy, int num_iter)
+    float* recon, int ngridx, int ngridy, int num_iter, int num_threads, int interleave)
 {
     if(dy == 0 || dt == 0 || dx == 0)
         return;
-
-    float* gridx   = (float*) malloc((ngridx + 1) * sizeof(float));
-    float* gridy   = (float*) malloc((ngridy + 1) * sizeof(float));
-    float* coordx  = (float*) malloc((ngridy + 1) * sizeof(float));
-    float* coordy  = (float*) malloc((ngridx + 1) * sizeof(float));
-    float* ax      = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* ay      = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* bx      = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* by      = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* coorx   = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* coory   = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* dist    = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    int*   indi    = (int*) malloc((ngridx + ngridy) * sizeof(int));
-    float* simdata = (float*) malloc((dy * dt * dx) * sizeof(float));
-
-    assert(coordx != NULL && coordy != NULL && ax != NULL && ay != NULL && by != NULL &&
-           bx != NULL && coorx != NULL && coory != NULL && dist != NULL && indi != NULL &&
-           simdata != NULL);
-
-    int   s, p, d, i, n;
-    int   quadrant;
-    float theta_p, sin_p, cos_p;
-    float mov, xi, yi;
-    int   asize, bsize, csize;
-    float upd;
-    int   ind_data, ind_recon;
-
-    for(i = 0; i < num_iter; i++)
+    if(num_threads < 1)
+        num_threads = 1;
+    if(interleave != 0 && interleave != 4 && interleave != 8 && interleave != 16)
     {
+        std::cerr << "art: unsupported interleave " << interleave
+                  << ", using per-slice updates" << std::endl;
+        interleave = 0;
+    }
 
-        std::cout << "Iteration: " << i << std::endl;
-
-        // initialize simdata to zero
-        memset(simdata, 0, dy * dt * dx * sizeof(float));
+    // The ray geometry does not depend on the slice, so the intersections of
+    // all rays of a projection are computed once and shared by the threads,
+    // which then update disjoint ranges of slices.
+    const int ray_len = ngridx + ngridy;
+    float* gridx     = (float*) malloc((ngridx + 1) * sizeof(float));
+    float* gridy     = (float*) malloc((ngridy + 1) * sizeof(float));
+    int*   ray_csize = (int*) malloc(dx * sizeof(int));
+    float* ray_dist2 = (float*) malloc(dx * sizeof(float));
+    float* ray_dist  = (float*) malloc((size_t) dx * ray_len * sizeof(float));
+    int*   ray_indi  = (int*) malloc((size_t) dx * ray_len * sizeof(int));
+
+    assert(gridx != NULL && gridy != NULL && ray_csize != NULL && ray_dist2 != NULL &&
+           ray_dist != NULL && ray_indi != NULL);
+
+    // With interleaving, threads own blocks of interleave slices
+    const int npixels  = ngridx * ngridy;
+    const int nblocks  = (interleave) ? (dy + interleave - 1) / interleave : 0;
+    float*    recon_il = NULL;
+    if(interleave)
+    {
+        recon_il = (float*) malloc((size_t) nblocks * npixels * interleave * sizeof(float));
+        assert(recon_il != NULL);
+        interleave_slices(dy, npixels, interleave, recon, recon_il);
+    }
 
-        preprocessing(ngridx, ngridy, dx, center[0], &mov, gridx,
-                      gridy);  // Outputs: mov, gridx, gridy
+    float mov;
 
-        // For each projection angle
-        for(p = 0; p < dt; p++)
+#pragma omp parallel num_threads(num_threads)
+    {
+        int tid = 0, nth = 1;
+#ifdef _OPENMP
+        tid = omp_get_thread_num();
+        nth = omp_get_num_threads();
+#endif
+        const int units = (interleave) ? nblocks : dy;
+        const int s_beg = (int) ((long) units * tid / nth);
+        const int s_end = (int) ((long) units * (tid + 1) / nth);
+
+        // No allocations past this point
+        art_scratch scratch;
+        alloc_scratch(ngridx, ngridy, &scratch);
+        float* coordx = scratch.coordx;
+        float* coordy = scratch.coordy;
+        float* ax     = scratch.ax;
+        float* ay     = scratch.ay;
+        float* bx     = scratch.bx;
+        float* by     = scratch.by;
+        float* coorx  = scratch.coorx;
+        float* coory  = scratch.coory;
+
+        int   s, p, d, i, n;
+        int   quadrant;
+        float theta_p, sin_p, cos_p;
+        float xi, yi;
+        int   asize, bsize, csize;
+        float upd, simdata;
+        int   ind_data, ind_recon;
+
+        for(i = 0; i < num_iter; i++)
         {
+#pragma omp single
+            {
+                std::cout << "Iteration: " << i << std::endl;
 
-            // Calculate the sin and cos values
-            // of the projection angle and find
-            // at which quadrant on the cartesian grid.
-            theta_p  = fmodf(theta[p], 2.0f * (float) M_PI);
-            quadrant = calc_quadrant(theta_p);
-            sin_p    = sinf(theta_p);
-            cos_p    = cosf(theta_p);
+                preprocessing(ngridx, ngridy, dx, center[0], &mov, gridx,
+                              gridy);  // Outputs: mov, gridx, gridy
+            }
 
-            // For each detector pixel
-            for(d = 0; d < dx; d++)
+            // For each projection angle
+            for(p = 0; p < dt; p++)
             {
-                // Calculate coordinates
-                xi = -ngridx - ngridy;
-                yi = 0.5f * (1 - dx) + d + mov;
-                calc_coords(ngridx, ngridy, xi, yi, sin_p, cos_p, gridx, gridy, coordx,
-                            coordy);
-
-                // Merge the (coordx, gridy) and (gridx, coordy)
-                trim_coords(ngridx, ngridy, coordx, coordy, gridx, gridy, &asize, ax, ay,
-                            &bsize, bx, by);
-
-                // Sort the array of intersection points (ax, ay) and
-                // (bx, by). The new sorted intersection points are
-                // stored in (coorx, coory). Total number of points
-                // are csize.
-                sort_intersections(quadrant, asize, ax, ay, bsize, bx, by, &csize, coorx,
-                                   coory);
-
-                // Calculate the distances (dist) between the
-                // intersection points (coorx, coory). Find the
-                // indices of the pixels on the reconstruction grid.
-                calc_dist(ngridx, ngridy, csize, coorx, coory, indi, dist);
-
-                // Calculate dist*dist
-                float sum_dist2 = 0.0f;
-                for(n = 0; n < csize - 1; n++)
+
+                // Calculate the sin and cos values
+                // of the projection angle and find
+                // at which quadrant on the cartesian grid.
+                theta_p  = fmodf(theta[p], 2.0f * (float) M_PI);
+                quadrant = calc_quadrant(theta_p);
+                sin_p    = sinf(theta_p);
+                cos_p    = cosf(theta_p);
+
+                // For each detector pixel
+#pragma omp for schedule(static)
+                for(d = 0; d < dx; d++)
                 {
-                    sum_dist2 += dist[n] * dist[n];
-                }
+                    int*   indi = ray_indi + (size_t) d * ray_len;
+                    float* dist = ray_dist + (size_t) d * ray_len;
+
+                    // Calculate coordinates
+                    xi = -ngridx - ngridy;
+                    yi = 0.5f * (1 - dx) + d + mov;
+                    calc_coords(ngridx, ngridy, xi, yi, sin_p, cos_p, gridx, gridy,
+                                coordx, coordy);
+
+                    // Merge the (coordx, gridy) and (gridx, coordy)
+                    trim_coords(ngridx, ngridy, coordx, coordy, gridx, gridy, &asize, ax,
+                                ay, &bsize, bx, by);
+
+                    // Sort the array of intersection points (ax, ay) and
+                    // (bx, by). The new sorted intersection points are
+                    // stored in (coorx, coory). Total number of points
+                    // are csize.
+                    sort_intersections(quadrant, asize, ax, ay, bsize, bx, by, &csize,
+                                       coorx, coory);
+
+                    // Calculate the distances (dist) between the
+                    // intersection points (coorx, coory). Find the
+                    // indices of the pixels on the reconstruction grid.
+                    calc_dist(ngridx, ngridy, csize, coorx, coory, indi, dist,
+                              &scratch);
+
+                    // Calculate dist*dist
+                    float sum_dist2 = 0.0f;
+                    for(n = 0; n < csize - 1; n++)
+                    {
+                        sum_dist2 += dist[n] * dist[n];
+                    }
+                    ray_csize[d] = csize;
+                    ray_dist2[d] = sum_dist2;
+                }  // Implicit barrier: the geometry of p is complete
 
-                if(sum_dist2 != 0.0f)
+                // For each detector pixel, in the serial order
+                for(d = 0; d < dx; d++)
                 {
-                    // For each slice
-                    for(s = 0; s < dy; s++)
+                    const int*   indi      = ray_indi + (size_t) d * ray_len;
+                    const float* dist      = ray_dist + (size_t) d * ray_len;
+                    float        sum_dist2 = ray_dist2[d];
+                    csize                  = ray_csize[d];
+
+                    if(sum_dist2 != 0.0f && interleave)
+                    {
+                        // For each slice block of this thread
+                        for(s = s_beg; s < s_end; s++)
+                        {
+                            switch(interleave)
+                            {
+                                case 4:
+                                    update_interleaved<4>(s, p, d, dy, dt, dx, npixels,
+                                                          csize, indi, dist, sum_dist2,
+                                                          data, recon_il);
+                                    break;
+                                case 8:
+                                    update_interleaved<8>(s, p, d, dy, dt, dx, npixels,
+                                                          csize, indi, dist, sum_dist2,
+                                                          data, recon_il);
+                                    break;
+                                default:
+                                    update_interleaved<16>(s, p, d, dy, dt, dx, npixels,
+                                                           csize, indi, dist, sum_dist2,
+                                                           data, recon_il);
+                                    break;
+                            }
+                        }
+                    }
+                    else if(sum_dist2 != 0.0f)
                     {
-                        // Calculate simdata
-                        calc_simdata(s, p, d, ngridx, ngridy, dt, dx, csize, indi, dist,
-                                     recon,
-                                     simdata);  // Output: simdata
-
-                        // Update
-                        ind_data  = d + p * dx + s * dt * dx;
-                        ind_recon = s * ngridx * ngridy;
-                        upd       = (data[ind_data] - simdata[ind_data]) / sum_dist2;
-                        for(n = 0; n < csize - 1; n++)
+                        // For each slice of this thread
+                        for(s = s_beg; s < s_end; s++)
                         {
-                            recon[indi[n] + ind_recon] += upd * dist[n];
+                            // Calculate simdata of the ray, summed in the
+                            // order of calc_simdata
+                            ind_data  = d + p * dx + s * dt * dx;
+                            ind_recon = s * ngridx * ngridy;
+                            simdata   = 0.0f;
+                            for(n = 0; n < csize - 1; n++)
+                            {
+                                simdata += recon[indi[n] + ind_recon] * dist[n];
+                            }
+
+                            // Update
+                            upd = (data[ind_data] - simdata) / sum_dist2;
+                            for(n = 0; n < csize - 1; n++)
+                            {
+                                recon[indi[n] + ind_recon] += upd * dist[n];
+                            }
                         }
                     }
                 }
+
+                // The geometry of p is overwritten by the next projection
+#pragma omp barrier
             }
         }
+
+        free_scratch(&scratch);
+    }
+
+    if(interleave)
+    {
+        deinterleave_slices(dy, npixels, interleave, recon_il, recon);
+        free(recon_il);
     }
     free(gridx);
     free(gridy);
-    free(coordx);
-    free(coordy);
-    free(ax);
-    free(ay);
-    free(bx);
-    free(by);
-    free(coorx);
-    free(coory);
-    free(dist);
-    free(indi);
-    free(simdata);
+    free(ray_csize);
+    free(ray_dist2);
+    free(ray_dist);
+    free(ray_indi);
 }
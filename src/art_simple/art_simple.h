@@ -9,6 +9,9 @@ void art(const float* data,
          const float* theta, 
          float* recon, 
          int ngridx, int ngridy, 
-         int num_iter);
+         int num_iter,
+         int num_threads = 1,   // Slices are split among the threads
+         int interleave = 0);   // 4, 8 or 16: update this many slices at once
+                                // on a slice-interleaved copy of recon
 
 #endif // ART_SIMPLE_H
@@ -1,52 +1,135 @@
 #include <iostream>
 #include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <future>
+#include <mutex>
 #include "art_simple.h"
 #include "hdf5.h"
+#include "trace_h5io.h"
+#include "trace_transpose.h"
 
-// Function to swap dimensions of a flat 3D array
-float* swapDimensions(float* original, int x, int y, int z, int dim1, int dim2) {
-    float* transposed= new float[x*y*z];
-
-    for (int i = 0; i < x; ++i) {
-        for (int j = 0; j < y; ++j) {
-            for (int k = 0; k < z; ++k) {
-                int original_index = i * (y * z) + j * z + k;
-
-                int transposed_index;
-                if (dim1 == 1 && dim2 == 2) {  // Swap y and z
-                    transposed_index = i * (z * y) + k * y + j;
-                } else if (dim1 == 0 && dim2 == 2) {  // Swap x and z
-                    transposed_index = k * (y * x) + j * x + i;
-                } else if (dim1 == 0 && dim2 == 1) {  // Swap x and y
-                    transposed_index = j * (x * z) + i * z + k;
-                } else {
-                    continue;  // No valid swap detected
-                }
-
-                transposed[transposed_index] = original[original_index];
-            }
+// HDF5 is not thread safe; the background reader and the writers share this lock
+static std::mutex h5_mutex;
+
+// Read slices [beg, beg+count) of a [dt, slices, dx] dataset into
+// sinogram order [count, dt, dx]. With md, the sinograms are read directly
+// in that order; otherwise the hyperslab is read and transposed in memory
+// with num_threads threads. Returns an empty vector on failure.
+static std::vector<float> readSinogramBlock(hid_t dataset_id, const hsize_t* dims,
+                                            int beg, int count,
+                                            trace_io::H5Metadata* md, int num_threads)
+{
+    std::vector<float> sinograms(dims[0] * count * dims[2]);
+    if (md != nullptr) {
+        std::lock_guard<std::mutex> lock(h5_mutex);
+        try {
+            trace_io::ReadSinograms(md, beg, count, sinograms.data());
+        } catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            sinograms.clear();
         }
+        return sinograms;
     }
 
-    return transposed;
+    std::vector<float> block(sinograms.size());
+    {
+        std::lock_guard<std::mutex> lock(h5_mutex);
+        hid_t dataspace_id = H5Dget_space(dataset_id);
+        hsize_t start[3] = {0, static_cast<hsize_t>(beg), 0};
+        hsize_t sizes[3] = {dims[0], static_cast<hsize_t>(count), dims[2]};
+        H5Sselect_hyperslab(dataspace_id, H5S_SELECT_SET, start, NULL, sizes, NULL);
+        hid_t memspace_id = H5Screate_simple(3, sizes, NULL);
+        herr_t status = H5Dread(dataset_id, H5T_NATIVE_FLOAT, memspace_id, dataspace_id,
+                                H5P_DEFAULT, block.data());
+        H5Sclose(memspace_id);
+        H5Sclose(dataspace_id);
+        if (status < 0) {
+            sinograms.clear();
+            return sinograms;
+        }
+    }
+    // swap axis in data dt dy
+    trace_utils::SwapAxes(block.data(), sinograms.data(), dims[0], count, dims[2],
+                          0, 1, num_threads);
+    return sinograms;
+}
+
+// Write (or read) slices [beg, beg+count) of a [slices, ngridy, ngridx] dataset
+static herr_t accessReconBlock(hid_t dataset_id, int beg, int count, int ngridy,
+                               int ngridx, float* recon, bool write)
+{
+    std::lock_guard<std::mutex> lock(h5_mutex);
+    hid_t dataspace_id = H5Dget_space(dataset_id);
+    hsize_t start[3] = {static_cast<hsize_t>(beg), 0, 0};
+    hsize_t sizes[3] = {static_cast<hsize_t>(count), static_cast<hsize_t>(ngridy),
+                        static_cast<hsize_t>(ngridx)};
+    H5Sselect_hyperslab(dataspace_id, H5S_SELECT_SET, start, NULL, sizes, NULL);
+    hid_t memspace_id = H5Screate_simple(3, sizes, NULL);
+    herr_t status = (write) ?
+        H5Dwrite(dataset_id, H5T_NATIVE_FLOAT, memspace_id, dataspace_id, H5P_DEFAULT, recon) :
+        H5Dread(dataset_id, H5T_NATIVE_FLOAT, memspace_id, dataspace_id, H5P_DEFAULT, recon);
+    H5Sclose(memspace_id);
+    H5Sclose(dataspace_id);
+    return status;
 }
 
 int main(int argc, char* argv[])
 {
     std::cout << "argc: " << argc << std::endl;
 
-    if(argc != 7 && argc != 8) {
-        std::cerr << "Usage: " << argv[0] << " <filename> <center> <num_outer_iter> <num_iter> <beginning_sino> <num_sino> [check_point_path]" << std::endl;
+    // Options may appear anywhere; the remaining arguments are positional
+    int num_threads = 1;
+    int interleave = 0;
+    int block_slices = 0;
+    bool direct_read = false;
+    std::vector<char*> args;
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            num_threads = atoi(argv[++i]);
+        } else if (arg == "--interleave" && i + 1 < argc) {
+            interleave = atoi(argv[++i]);
+        } else if (arg == "--block-slices" && i + 1 < argc) {
+            block_slices = atoi(argv[++i]);
+        } else if (arg == "--direct-read") {
+            direct_read = true;
+        } else if (arg.compare(0, 2, "--") == 0 && i > 0) {
+            std::cerr << "Error: Unknown option " << arg << std::endl;
+            return 1;
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    int nargs = static_cast<int>(args.size());
+
+    if(nargs != 7 && nargs != 8) {
+        std::cerr << "Usage: " << argv[0] << " [--threads <n>] [--interleave <4|8|16>] [--block-slices <n>] [--direct-read] <filename> <center> <num_outer_iter> <num_iter> <beginning_sino> <num_sino> [check_point_path]" << std::endl;
+        return 1;
+    }
+    if(num_threads < 1) {
+        std::cerr << "Error: --threads must be positive" << std::endl;
+        return 1;
+    }
+    if(block_slices < 0) {
+        std::cerr << "Error: --block-slices must not be negative" << std::endl;
+        return 1;
+    }
+    if(interleave != 0 && interleave != 4 && interleave != 8 && interleave != 16) {
+        std::cerr << "Error: --interleave must be 4, 8 or 16" << std::endl;
         return 1;
     }
 
-    const char* filename = argv[1];
-    float center = atof(argv[2]);
-    int num_outer_iter = atoi(argv[3]);
-    int num_iter = atoi(argv[4]);
-    int beg_index = atoi(argv[5]);
-    int nslices = atoi(argv[6]);
-    const char* check_point_path = (argc == 8) ? argv[7] : nullptr;
+    const char* filename = args[1];
+    float center = atof(args[2]);
+    int num_outer_iter = atoi(args[3]);
+    int num_iter = atoi(args[4]);
+    int beg_index = atoi(args[5]);
+    int nslices = atoi(args[6]);
+    const char* check_point_path = (nargs == 8) ? args[7] : nullptr;
 
 
     // Open tomo_00058_all_subsampled1p_ HDF5 file
@@ -57,7 +140,7 @@ int main(int argc, char* argv[])
         return 1;
     }
 
-    // Read the data from the HDF5 file
+    // Open the projection dataset; slice blocks are read from it as needed
     const char* dataset_name = "exchange/data";
     hid_t dataset_id = H5Dopen(file_id, dataset_name, H5P_DEFAULT);
     if (dataset_id < 0) {
@@ -65,33 +148,16 @@ int main(int argc, char* argv[])
         return 1;
     }
 
-    //// read the data
     hid_t dataspace_id = H5Dget_space(dataset_id);
     hsize_t dims[3];
     H5Sget_simple_extent_dims(dataspace_id, dims, NULL);
+    H5Sclose(dataspace_id);
     std::cout << "Data dimensions: " << dims[0] << " x " << dims[1] << " x " << dims[2] << std::endl;
-    //float* data = new float[dims[0]*dims[1]*dims[2]];
-    //H5Dread(dataset_id, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, data);
-
-    // read slices from the dataset
     std::cout << "Target dimensions: " << dims[0] << " x [" << beg_index << "-" << beg_index+nslices << "] x " << dims[2] << std::endl;
-    hsize_t start[3] = {0, beg_index, 0};
-    hsize_t count[3] = {dims[0], nslices, dims[2]};
-    H5Sselect_hyperslab(dataspace_id, H5S_SELECT_SET, start, NULL, count, NULL);
-
-    // Create a memory dataspace
-    hsize_t mem_dims[3] = {dims[0], nslices, dims[2]};
-    hid_t memspace_id = H5Screate_simple(3, mem_dims, NULL);
-
-    // Allocate memory for the hyperslab
-    float* data = new float[dims[0] * nslices * dims[2]];
-
-    // Read the data from the hyperslab
-    H5Dread(dataset_id, H5T_NATIVE_FLOAT, memspace_id, dataspace_id, H5P_DEFAULT, data);
-
-    //close the dataset
-    H5Dclose(dataset_id);
-    H5Sclose(memspace_id);
+    if (nslices <= 0 || beg_index < 0 || static_cast<hsize_t>(beg_index + nslices) > dims[1]) {
+        std::cerr << "Error: Slices out of the dataset range" << std::endl;
+        return 1;
+    }
 
     // read the theta
     const char* theta_name = "exchange/theta";
@@ -104,60 +170,57 @@ int main(int argc, char* argv[])
     hid_t theta_dataspace_id = H5Dget_space(theta_id);
     hsize_t theta_dims[1];
     H5Sget_simple_extent_dims(theta_dataspace_id, theta_dims, NULL);
+    H5Sclose(theta_dataspace_id);
     std::cout << "Theta dimensions: " << theta_dims[0] << std::endl;
     float* theta = new float[theta_dims[0]];
     H5Dread(theta_id, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, theta);
     // close the dataset
     H5Dclose(theta_id);
 
-    // Close the HDF5 file
-    H5Fclose(file_id);
-
     // reconstruct using art
     int dt = dims[0];
-    int dy = nslices; //dims[1];
     int dx = dims[2];
     int ngridx = dx;
     int ngridy = dx;
+    // Slices are reconstructed in blocks; all of them at once by default
+    int block = (block_slices > 0) ? std::min(block_slices, nslices) : nslices;
     //int num_iter = 2;
     //int num_outer_iter = 5;
     //float center = 294.078;
-    float *recon = new float[dy*ngridx*ngridy];
 
+    hid_t check_point_file_id = -1;
+    hid_t check_point_dataset_id = -1;
     if(check_point_path != nullptr) {
         std::cout << "Check point path: " << check_point_path << std::endl;
         // read recon data from checkpointing file /recon
-        hid_t check_point_file_id = H5Fopen(check_point_path, H5F_ACC_RDONLY, H5P_DEFAULT);
+        check_point_file_id = H5Fopen(check_point_path, H5F_ACC_RDONLY, H5P_DEFAULT);
         if (check_point_file_id < 0) {
             std::cerr << "Error: Unable to open file " << check_point_path << std::endl;
             return 1;
         }
-        hid_t check_point_dataset_id = H5Dopen(check_point_file_id, "/recon", H5P_DEFAULT);
+        check_point_dataset_id = H5Dopen(check_point_file_id, "/recon", H5P_DEFAULT);
         if (check_point_dataset_id < 0) {
             std::cerr << "Error: Unable to open dataset /recon" << std::endl;
             return 1;
         }
-        H5Dread(check_point_dataset_id, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, recon);
-        H5Dclose(check_point_dataset_id);
-        H5Fclose(check_point_file_id);
     }
 
-    std::cout << "dt: " << dt << ", dy: " << dy << ", dx: " << dx << 
+    std::cout << "dt: " << dt << ", dy: " << nslices << ", dx: " << dx << 
                  ", ngridx: " << ngridx << ", ngridy: " << ngridy << 
                  ", num_iter: " << num_iter << ", center: " << center << 
                  ", beg_index: " << beg_index <<
-                 ", nslices: " << nslices << std::endl;
+                 ", nslices: " << nslices <<
+                 ", threads: " << num_threads <<
+                 ", interleave: " << interleave <<
+                 ", block_slices: " << block <<
+                 ", direct_read: " << direct_read << std::endl;
 
-    // swap axis in data dt dy
-    float *data_swap = swapDimensions(data, dt, dy, dx, 0, 1);
-
-    // run the reconstruction
+    // Create the output file of every outer iteration up front; each slice
+    // block writes its part of every file
+    std::vector<hid_t> output_file_ids(num_outer_iter);
+    std::vector<hid_t> output_dataset_ids(num_outer_iter);
     for (int i = 0; i < num_outer_iter; i++)
     {
-        std::cout << "Outer iteration: " << i << std::endl;
-        art(data_swap, dy, dt, dx, &center, theta, recon, ngridx, ngridy, num_iter);
-
-        // write the reconstructed data to a file
         // Create the output file name
         std::ostringstream oss;
         if (check_point_path != nullptr) {
@@ -168,26 +231,87 @@ int main(int argc, char* argv[])
         std::string output_filename = oss.str();
         const char* output_filename_cstr = output_filename.c_str();
 
-        hid_t output_file_id = H5Fcreate(output_filename_cstr, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
-        if (output_file_id < 0) {
+        output_file_ids[i] = H5Fcreate(output_filename_cstr, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+        if (output_file_ids[i] < 0) {
             std::cerr << "Error: Unable to create file " << output_filename << std::endl;
             return 1;
         }
-        hsize_t output_dims[3] = {dy, ngridy, ngridx};
+        hsize_t output_dims[3] = {static_cast<hsize_t>(nslices),
+                                  static_cast<hsize_t>(ngridy),
+                                  static_cast<hsize_t>(ngridx)};
         hid_t output_dataspace_id = H5Screate_simple(3, output_dims, NULL);
-        hid_t output_dataset_id = H5Dcreate(output_file_id, "/data", H5T_NATIVE_FLOAT, output_dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-        H5Dwrite(output_dataset_id, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, recon);
-        H5Dclose(output_dataset_id);
+        output_dataset_ids[i] = H5Dcreate(output_file_ids[i], "/data", H5T_NATIVE_FLOAT, output_dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
         H5Sclose(output_dataspace_id);
-        H5Fclose(output_file_id);
     }
 
+    // Sinograms are read in their final layout with --direct-read
+    trace_io::H5Metadata md;
+    md.file_path = filename;
+    md.dataset_path = dataset_name;
+    md.ndims = 3;
+    md.dims = dims;
+    md.data_size = dims[0] * dims[1] * dims[2];
+    trace_io::H5Metadata* read_md = (direct_read) ? &md : nullptr;
+
+    // Memory is bounded by a few blocks: the one being read (and its
+    // transposed copy), the one being reconstructed and its reconstruction
+    std::vector<float> recon(static_cast<size_t>(block) * ngridx * ngridy);
+    std::future<std::vector<float>> next = std::async(std::launch::async,
+        readSinogramBlock, dataset_id, dims, beg_index, block, read_md, num_threads);
+
+    for (int b = 0; b < nslices; b += block)
+    {
+        int dy = std::min(block, nslices - b);
+        std::vector<float> data_swap = next.get();
+        if (data_swap.empty()) {
+            std::cerr << "Error: Unable to read slices " << beg_index + b << "-" <<
+                beg_index + b + dy << std::endl;
+            return 1;
+        }
+        // Read the next block while this one is reconstructed
+        if (b + dy < nslices) {
+            next = std::async(std::launch::async, readSinogramBlock, dataset_id, dims,
+                              beg_index + b + dy, std::min(block, nslices - b - dy),
+                              read_md, num_threads);
+        }
+
+        std::cout << "Slice block: [" << beg_index + b << "-" << beg_index + b + dy << "]" << std::endl;
+        std::fill(recon.begin(), recon.end(), 0.f);
+        if (check_point_dataset_id >= 0 &&
+            accessReconBlock(check_point_dataset_id, b, dy, ngridy, ngridx, recon.data(), false) < 0) {
+            std::cerr << "Error: Unable to read the check point" << std::endl;
+            return 1;
+        }
+
+        // run the reconstruction
+        for (int i = 0; i < num_outer_iter; i++)
+        {
+            std::cout << "Outer iteration: " << i << std::endl;
+            art(data_swap.data(), dy, dt, dx, &center, theta, recon.data(), ngridx, ngridy, num_iter, num_threads, interleave);
+
+            // write the reconstructed block to the output file
+            if (accessReconBlock(output_dataset_ids[i], b, dy, ngridy, ngridx, recon.data(), true) < 0) {
+                std::cerr << "Error: Unable to write outer iteration " << i << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    for (int i = 0; i < num_outer_iter; i++)
+    {
+        H5Dclose(output_dataset_ids[i]);
+        H5Fclose(output_file_ids[i]);
+    }
+    if (check_point_dataset_id >= 0) {
+        H5Dclose(check_point_dataset_id);
+        H5Fclose(check_point_file_id);
+    }
+    H5Dclose(dataset_id);
+    // Close the HDF5 file
+    H5Fclose(file_id);
 
     // free the memory
-    delete[] data;
-    delete[] data_swap;
     delete[] theta;
-    delete[] recon;
 
     return 0;
-}
\ No newline at end of file
+}
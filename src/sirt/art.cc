@@ -0,0 +1,119 @@
+#include "art.h"
+
+void ARTReconSpace::UpdateRay(
+    float *recon,
+    float ray,
+    int const * const indi,
+    float *leng2,
+    float *leng,
+    int len)
+{
+  float simdata = 0., a2 = 0.;
+  for (int i=0; i<len-1; ++i) {
+    simdata += recon[indi[i]]*leng[i];
+    a2 += leng2[i];
+  }
+  if (a2<=0.) return;   /// Ray misses the grid
+
+  float upd = relaxation_*(ray-simdata) / a2;
+  for (int i=0; i<len-1; ++i)
+    recon[indi[i]] += leng[i]*upd;
+}
+
+void ARTReconSpace::Initialize(int n_grids){
+  num_grids = n_grids; 
+
+  coordx = new float[num_grids+1]; 
+  coordy = new float[num_grids+1];
+  ax = new float[num_grids+1];
+  ay = new float[num_grids+1];
+  bx = new float[num_grids+1];
+  by = new float[num_grids+1];
+  coorx = new float[2*num_grids];
+  coory = new float[2*num_grids];
+  leng = new float[2*num_grids];
+  leng2 = new float[2*num_grids];
+  indi = new int[2*num_grids];
+}
+
+void ARTReconSpace::Finalize(){
+  delete [] coordx;
+  delete [] coordy;
+  delete [] ax;
+  delete [] ay;
+  delete [] bx;
+  delete [] by;
+  delete [] coorx;
+  delete [] coory;
+  delete [] leng;
+  delete [] leng2;
+  delete [] indi;
+}
+
+int ARTReconSpace::Owner(MirroredRegionBareBase<float> &input)
+{
+  auto &rays = *(static_cast<MirroredRegionBase<float, TraceMetadata>*>(&input));
+  return rays.metadata().RaySlice(rays.index());
+}
+
+void ARTReconSpace::Reduce(MirroredRegionBareBase<float> &input)
+{
+  auto &rays = *(static_cast<MirroredRegionBase<float, TraceMetadata>*>(&input));
+  auto &metadata = rays.metadata();
+
+  const float *theta = metadata.theta();
+  const float *gridx = metadata.gridx();
+  const float *gridy = metadata.gridy();
+  float mov = metadata.mov();
+
+  int num_cols = metadata.num_cols();
+  int num_grids = metadata.num_cols();
+
+  /// One projection row per iteration
+  for (size_t row=0; row<rays.count(); row+=num_cols) {
+    int proj = metadata.RayProjection(rays.index()+row);
+    int curr_slice = metadata.RaySlice(rays.index()+row);
+    float theta_q = theta[proj];
+    int quadrant = trace_utils::CalculateQuadrant(theta_q);
+    float sinq = sinf(theta_q);
+    float cosq = cosf(theta_q);
+
+    int curr_slice_offset = 
+      (metadata.num_neighbor_recon_slices()+curr_slice)*num_grids*num_grids;
+    float *recon = (&(metadata.recon()[0])+curr_slice_offset);
+
+    for (int curr_col=0; curr_col<num_cols; ++curr_col) {
+      float xi = -1e6;
+      float yi = (1-num_cols)/2. + curr_col+mov;
+      trace_utils::CalculateCoordinates(
+          num_grids, 
+          xi, yi, sinq, cosq, 
+          gridx, gridy, 
+          coordx, coordy);
+
+      int alen, blen;
+      trace_utils::MergeTrimCoordinates(
+          num_grids, 
+          coordx, coordy, 
+          gridx, gridy, 
+          &alen, &blen, 
+          ax, ay, bx, by);
+
+      trace_utils::SortIntersectionPoints(
+          quadrant, 
+          alen, blen, 
+          ax, ay, bx, by, 
+          coorx, coory);
+
+      int len = alen + blen;
+      trace_utils::CalculateDistanceLengths(
+          len, 
+          num_grids, 
+          coorx, coory, 
+          leng, leng2, 
+          indi);
+
+      UpdateRay(recon, rays[row+curr_col], indi, leng2, leng, len);
+    }
+  }
+}
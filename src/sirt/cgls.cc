@@ -0,0 +1,85 @@
+#include <stdexcept>
+#include "cgls.h"
+
+float *CGLSReconSpace::ProjectedSlice(TraceMetadata &metadata, int curr_slice)
+{
+  if(main_->phase_==kGradient)
+    return SIRTReconSpace::ProjectedSlice(metadata, curr_slice);
+  return &main_->p_[static_cast<size_t>(curr_slice)*num_pixels_];
+}
+
+void CGLSReconSpace::UpdateReconReplica(
+    float simdata,
+    float ray,
+    int curr_slice,
+    int const * const indi,
+    float * /*leng2*/,
+    float *leng, 
+    int len)
+{
+  /// Residual of the ray, or its projection through p
+  float v = (main_->phase_==kGradient) ? ray-simdata : simdata;
+
+  auto &slice_t = reduction_objects()[curr_slice];
+  auto slice = &slice_t[0];
+
+  for (int i=0; i<(len-1); ++i) {
+    if (indi[i]>=num_pixels_) continue;
+    slice[indi[i]] += leng[i]*v;
+  }
+  slice[num_pixels_] += v*v;
+}
+
+void CGLSReconSpace::UpdateRecon(
+    ADataRegion<float> &recon,                  // Reconstruction object
+    DataRegion2DBareBase<float> &comb_replica,  // Locally combined replica
+    size_t recon_offset)
+{
+  size_t rows = comb_replica.rows();
+  size_t n = static_cast<size_t>(num_pixels_);
+  if(p_.size()!=rows*n){
+    p_.assign(rows*n, 0.);
+    s_.assign(rows*n, 0.);
+    gamma_.assign(rows, 0.);
+  }
+
+  for(size_t i=0; i<rows; ++i){
+    auto replica = comb_replica[i];
+    float *p = &p_[i*n];
+    float *s = &s_[i*n];
+
+    if(phase_==kGradient){
+      double gamma = 0.;
+      for(size_t j=0; j<n; ++j){
+        s[j] = p[j] = replica[j];
+        gamma += static_cast<double>(s[j])*s[j];
+      }
+      gamma_[i] = gamma;
+      continue;
+    }
+
+    double qq = replica[n];     /// |Ap|^2
+    if(!(qq>0.) || !(gamma_[i]>0.)) continue;   /// Converged or no rays
+    float alpha = static_cast<float>(gamma_[i]/qq);
+    double gamma = 0.;
+    for(size_t j=0; j<n; ++j){
+      recon[recon_offset + i*n + j] += alpha*p[j];
+      s[j] -= alpha*replica[j];
+      gamma += static_cast<double>(s[j])*s[j];
+    }
+    float beta = static_cast<float>(gamma/gamma_[i]);
+    for(size_t j=0; j<n; ++j)
+      p[j] = s[j] + beta*p[j];
+    gamma_[i] = gamma;
+  }
+  phase_ = kStep;
+}
+
+void CGLSReconSpace::UpdateReconStripe(
+    ADataRegion<float> &,
+    float const *,
+    size_t, size_t,
+    size_t)
+{
+  throw std::logic_error("CGLS does not support striped updates");
+}
@@ -0,0 +1,135 @@
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include "fbp.h"
+
+FBPReconSpace::Filter FBPReconSpace::ParseFilter(std::string const &name)
+{
+  if(name=="ramp") return kRamp;
+  if(name=="shepp-logan") return kSheppLogan;
+  if(name=="cosine") return kCosine;
+  if(name=="hamming") return kHamming;
+  if(name=="hann") return kHann;
+  throw std::invalid_argument("Unknown FBP filter: " + name);
+}
+
+void FBPReconSpace::Initialize(int num_cols, Filter filter)
+{
+  num_cols_ = num_cols;
+  filter_ = filter;
+  size_t n = trace_utils::NextPowerOfTwo(2*static_cast<size_t>(num_cols));
+  fft_.reset(new trace_utils::RealFFT(n));
+  filtered_.resize(num_cols);
+
+  /// Spectrum of the band-limited ramp sampled in space (Kak & Slaney),
+  /// h[0]=1/4, h[odd j]=-1/(pi j)^2, which has no DC offset unlike |f|
+  const double pi = std::acos(-1.);
+  float *h = fft_->real();
+  std::fill(h, h+n, 0.f);
+  h[0] = 0.25f;
+  for(size_t j=1; j<n/2; j+=2){
+    float v = static_cast<float>(-1./(pi*pi*j*j));
+    h[j] = v;
+    h[n-j] = v;
+  }
+  fft_->Forward();
+
+  response_.resize(n/2+1);
+  for(size_t k=0; k<=n/2; ++k){
+    double f = static_cast<double>(k)/n;    /// Cycles per ray, [0, 0.5]
+    double w = 1.;
+    switch(filter){
+      case kRamp: break;
+      case kSheppLogan: w = (k==0) ? 1. : std::sin(pi*f)/(pi*f); break;
+      case kCosine: w = std::cos(pi*f); break;
+      case kHamming: w = 0.54+0.46*std::cos(2.*pi*f); break;
+      case kHann: w = 0.5+0.5*std::cos(2.*pi*f); break;
+    }
+    response_[k] = static_cast<float>(fft_->spectrum()[k].real()*w);
+  }
+}
+
+void FBPReconSpace::FilterRow(float const *row)
+{
+  size_t n = fft_->size();
+  float *x = fft_->real();
+  std::copy(row, row+num_cols_, x);
+  std::fill(x+num_cols_, x+n, 0.f);
+  fft_->Forward();
+  auto spectrum = fft_->spectrum();
+  for(size_t k=0; k<=n/2; ++k) spectrum[k] *= response_[k];
+  fft_->Inverse();
+  std::copy(x, x+num_cols_, filtered_.begin());
+}
+
+/// Pixel (ix, iy) has its center at (ix-g/2+0.5, iy-g/2+0.5), the ray
+/// through (x, y) is at detector position -x sin + y cos + center
+void FBPReconSpace::Backproject(
+    float *slice, float theta, float center, float weight)
+{
+  int g = num_cols_;
+  float sinq = sinf(theta);
+  float cosq = cosf(theta);
+  float x0 = -g/2.f + 0.5f;
+  float const *q = filtered_.data();
+  float last = static_cast<float>(num_cols_-1);
+
+  for(int iy=0; iy<g; ++iy){
+    float y = -g/2.f + 0.5f + iy;
+    float u0 = -x0*sinq + y*cosq + center;  /// Position of pixel ix=0
+    float du = -sinq;
+    /// Pixels whose position is in [0, num_cols-1)
+    int beg = 0, end = g;
+    if(du>0.){
+      beg = std::max(beg, static_cast<int>(std::ceil(-u0/du)));
+      end = std::min(end, static_cast<int>(std::ceil((last-u0)/du)));
+    }
+    else if(du<0.){
+      beg = std::max(beg, static_cast<int>(std::floor((last-u0)/du))+1);
+      end = std::min(end, static_cast<int>(std::floor(-u0/du))+1);
+    }
+    else if(u0<0. || u0>=last) continue;
+
+    float *row = slice + static_cast<size_t>(iy)*g;
+    for(int ix=beg; ix<end; ++ix){
+      float u = u0 + ix*du;
+      int i = static_cast<int>(u);
+      if(i<0 || i>=num_cols_-1) continue;   /// Rounding at the range ends
+      float w = u - i;
+      row[ix] += weight*((1.f-w)*q[i] + w*q[i+1]);
+    }
+  }
+}
+
+int FBPReconSpace::Owner(MirroredRegionBareBase<float> &input)
+{
+  auto &rays = *(static_cast<MirroredRegionBase<float, TraceMetadata>*>(&input));
+  return rays.metadata().RaySlice(rays.index());
+}
+
+void FBPReconSpace::Reduce(MirroredRegionBareBase<float> &input)
+{
+  auto &rays = *(static_cast<MirroredRegionBase<float, TraceMetadata>*>(&input));
+  auto &metadata = rays.metadata();
+  if(metadata.num_cols()!=num_cols_)
+    throw std::logic_error("FBPReconSpace initialized for other rows");
+
+  const float *theta = metadata.theta();
+  int num_grids = metadata.num_cols();
+  /// Detector position of the rotation axis, see CalculateCoordinates
+  float center = (num_cols_-1)/2.f - metadata.mov();
+  int num_projs = (main_->window_projs_>0) ? main_->window_projs_ :
+                                              metadata.num_projs();
+  float weight = std::acos(-1.f)/num_projs;
+
+  for (size_t row=0; row<rays.count(); row+=num_cols_) {
+    int proj = metadata.RayProjection(rays.index()+row);
+    int curr_slice = metadata.RaySlice(rays.index()+row);
+    int curr_slice_offset = 
+      (metadata.num_neighbor_recon_slices()+curr_slice)*num_grids*num_grids;
+    float *recon = (&(metadata.recon()[0])+curr_slice_offset);
+
+    FilterRow(&rays[row]);
+    Backproject(recon, theta[proj], center, weight);
+  }
+}
@@ -0,0 +1,39 @@
+#include "mlem.h"
+
+void MLEMReconSpace::UpdateReconStripe(
+    ADataRegion<float> &recon,
+    float const *stripe,
+    size_t beg, size_t end,
+    size_t recon_offset)
+{
+  for(size_t e=beg; e<end; e+=2){
+    if(stripe[e-beg+1]<=0.) continue;  /// No ray of the window crosses it
+    float upd = stripe[e-beg] / stripe[e-beg+1];
+    if(std::isnan(upd)) continue;
+    recon[recon_offset + e/2] *= upd;
+  }
+}
+
+void MLEMReconSpace::UpdateReconReplica(
+    float simdata,
+    float ray,
+    int curr_slice,
+    int const * const indi,
+    float * /*leng2*/,
+    float *leng, 
+    int len)
+{
+  /// Negative measurements are noise; rays with a non-positive simulated
+  /// sum only add to the sensitivity
+  float ratio = (simdata>0. && ray>0.) ? ray/simdata : 0.;
+
+  auto &slice_t = reduction_objects()[curr_slice];
+  auto slice = &slice_t[0];
+
+  for (int i=0; i<(len-1); ++i) {
+    size_t index = indi[i]*2;
+    if (index>=slice_t.count()) continue;
+    slice[index] += leng[i]*ratio; 
+    slice[index+1] += leng[i];
+  }
+}
@@ -32,26 +32,29 @@ float SIRTReconSpace::CalculateSimdata(
 
 void SIRTReconSpace::UpdateRecon(
     ADataRegion<float> &recon,                  // Reconstruction object
-    DataRegion2DBareBase<float> &comb_replica)  // Locally combined replica
+    DataRegion2DBareBase<float> &comb_replica,  // Locally combined replica
+    size_t recon_offset)
 {
-  size_t rows = comb_replica.rows();
-  size_t cols = comb_replica.cols()/2;
-  size_t nans = 0;
-  for(size_t i=0; i<rows; ++i){
-    auto replica = comb_replica[i];
-    for(size_t j=0; j<cols; ++j){
-      float upd = replica[j*2] / replica[j*2+1];
-      if(std::isnan(upd)) {
-        nans++; 
-        //std::cout << "NaN value: replica[" << j*2 << "]=" << replica[j*2] <<
-        //  " / replica[" << j*2+1 << "]=" << replica[j*2+1]  << 
-        //  " = " << replica[j*2]/replica[j*2+1] << std::endl;
-        continue;
-      }
-      recon[i*cols + j] += upd;
-    }
+  /// Replica rows are separate buffers; each is a stripe of the row-major
+  /// combined replica
+  size_t cols = comb_replica.cols();
+  for(size_t i=0; i<comb_replica.rows(); ++i)
+    UpdateReconStripe(recon, &comb_replica[i][0], i*cols, (i+1)*cols,
+                      recon_offset);
+}
+
+void SIRTReconSpace::UpdateReconStripe(
+    ADataRegion<float> &recon,
+    float const *stripe,
+    size_t beg, size_t end,
+    size_t recon_offset)
+{
+  /// Pixel p of the image is at replica element 2p, rows are contiguous
+  for(size_t e=beg; e<end; e+=2){
+    float upd = stripe[e-beg] / stripe[e-beg+1];
+    if(std::isnan(upd)) continue;
+    recon[recon_offset + e/2] += upd;
   }
-  std::cout << "NaNs=" << nans << std::endl;
 }
 
 void SIRTReconSpace::UpdateReconReplica(
@@ -123,6 +126,14 @@ void SIRTReconSpace::Finalize(){
   delete [] indi;
 }
 
+float *SIRTReconSpace::ProjectedSlice(TraceMetadata &metadata, int curr_slice)
+{
+  int num_grids = metadata.num_cols();
+  int curr_slice_offset = 
+    (metadata.num_neighbor_recon_slices()+curr_slice)*num_grids*num_grids;
+  return (&(metadata.recon()[0])+curr_slice_offset);
+}
+
 void SIRTReconSpace::Reduce(MirroredRegionBareBase<float> &input)
 {
   auto &rays = *(static_cast<MirroredRegionBase<float, TraceMetadata>*>(&input));
@@ -151,8 +162,7 @@ void SIRTReconSpace::Reduce(MirroredRegionBareBase<float> &input)
     //std::cout << "Current proj=" << curr_proj  << "; Theta=" << theta_q << std::endl;
 
     int curr_slice = metadata.RaySlice(rays.index());
-    int curr_slice_offset = curr_slice*num_grids*num_grids;
-    float *recon = (&(metadata.recon()[0])+curr_slice_offset);
+    float *recon = ProjectedSlice(metadata, curr_slice);
 
     for (int curr_col=0; curr_col<num_cols; ++curr_col) {
       /// Calculate coordinates
@@ -1,12 +1,25 @@
 #include <iomanip>
-#include "mpi.h"
+#include "trace_mpi.h"
 #include "trace_h5io.h"
+#include "trace_writer.h"
 #include "data_region_base.h"
 #include "tclap/CmdLine.h"
+#ifdef TRACE_USE_MPI
 #include "disp_comm_mpi.h"
+#include "trace_comm.h"
+#else
+#include "disp_comm_local.h"
+#endif
 #include "disp_engine_reduction.h"
 #include "sirt.h"
+#include "art.h"
+#include "mlem.h"
+#include "cgls.h"
+#include "fbp.h"
 #include "trace_stream.h"
+#include "trace_checkpoint.h"
+#include "trace_subsets.h"
+#include "trace_span.h"
 
 class TraceRuntimeConfig {
   public:
@@ -23,6 +36,35 @@ class TraceRuntimeConfig {
     int dest_port;
     std::string pub_addr;
     int pub_freq = 0;
+    int recv_queue_len = 0;
+    int write_buffers = 0;
+    std::string write_mode;
+    int write_filter = 0;
+    int write_filter_level = 0;
+    int proj_group_size = 1;
+    bool dist_update = false;
+    bool shm_combine = false;
+    int halo_depth = 0;
+    float slice_smoothing = 0.;
+    std::string comm_precision;
+    bool cache_lengths = false;
+    int combine_blocks = 0;
+    std::string checkpoint_dir;
+    int checkpoint_freq = 0;
+    std::string restart_from;
+    std::string input_file;
+    std::string input_dataset;
+    std::string theta_dataset;
+    bool theta_degrees = false;
+    int os_subsets = 1;
+    std::string os_order;
+    std::string algorithm;
+    float art_relaxation = 0.1;
+    std::string fbp_filter;
+    bool warm_start = false;
+    int trace_level = 0;
+    std::string trace_output;
+    int trace_capacity = 0;
 
     TraceRuntimeConfig(int argc, char **argv, int rank, int size){
       try
@@ -49,6 +91,21 @@ class TraceRuntimeConfig {
           "t", "thread", "Number of threads per process", false, 1, "int");
         TCLAP::ValueArg<float> argWriteFreq(
           "", "write-freq", "Write frequency", false, 10000, "int");
+        TCLAP::ValueArg<int> argWriteBuffers(
+          "", "write-buffers", "Number of snapshot buffers for asynchronous output. "
+          "0 writes synchronously in the main loop", false, 0, "int");
+        std::vector<std::string> write_modes {"files", "series"};
+        TCLAP::ValuesConstraint<std::string> writeModeConstraint(write_modes);
+        TCLAP::ValueArg<std::string> argWriteMode(
+          "", "write-mode", "files: one file per write in recon-output-dir; "
+          "series: append every write as a time step to reconOutputPath",
+          false, "files", &writeModeConstraint);
+        TCLAP::ValueArg<int> argWriteFilter(
+          "", "write-filter", "HDF5 filter id for series output. 0: none, "
+          "1: deflate, other: registered filter", false, 0, "int");
+        TCLAP::ValueArg<int> argWriteFilterLevel(
+          "", "write-filter-level", "Deflate compression level (1-9)",
+          false, 1, "int");
         TCLAP::ValueArg<float> argWindowLen(
           "", "window-length", "Number of projections that will be stored in the window",
           false, 32, "int");
@@ -64,6 +121,117 @@ class TraceRuntimeConfig {
             "string");
         TCLAP::ValueArg<float> argDestPort(
           "", "dest-port", "Starting port of destination host", false, 5560, "int");
+        TCLAP::ValueArg<int> argRecvQueueLen(
+          "", "recv-queue-length", "Number of projections that can be buffered by "
+          "the background receiver thread. 0 receives synchronously in the main loop",
+          false, 0, "int");
+        TCLAP::ValueArg<int> argProjGroupSize(
+          "", "proj-group-size", "Number of ranks that share the same sinograms "
+          "and split the projections of the window among them", false, 1, "int");
+        TCLAP::SwitchArg argDistUpdate(
+          "", "dist-update", "Projection groups reduce-scatter the replica, "
+          "update their own stripe of the image and allgather it", false);
+        TCLAP::SwitchArg argShmCombine(
+          "", "shm-combine", "Sum the replicas of the ranks of a node in MPI "
+          "shared memory; only one rank per node joins the global allreduce",
+          false);
+
+        std::vector<std::string> comm_precisions {"fp32", "bf16", "fp16"};
+        TCLAP::ValuesConstraint<std::string> commPrecisionConstraint(
+            comm_precisions);
+        TCLAP::ValueArg<std::string> argCommPrecision(
+          "", "comm-precision", "Precision of the values sent by the replica "
+          "combination of projection groups", false, "fp32",
+          &commPrecisionConstraint);
+        TCLAP::ValueArg<int> argCombineBlocks(
+          "", "combine-blocks", "Row blocks of the pipelined replica "
+          "combination within a projection group; the group combination of "
+          "a block overlaps with the local combination of the next ones. 0 "
+          "combines the whole replica at once", false, 0, "int");
+        TCLAP::SwitchArg argCacheLengths(
+          "", "cache-lengths", "Combine the length plane of the replicas "
+          "once per window instead of every iteration", false);
+
+        TCLAP::ValueArg<int> argOSSubsets(
+          "", "os-subsets", "Number of ordered subsets of a window; the image "
+          "is updated after each subset (OS-SIRT). 1 updates once per "
+          "iteration", false, 1, "int");
+        std::vector<std::string> os_orders {"sequential", "bit-reverse", "random"};
+        TCLAP::ValuesConstraint<std::string> osOrderConstraint(os_orders);
+        TCLAP::ValueArg<std::string> argOSOrder(
+          "", "os-order", "Processing order of the ordered subsets", false,
+          "bit-reverse", &osOrderConstraint);
+
+        std::vector<std::string> algorithms {"sirt", "art", "mlem", "cgls",
+          "fbp"};
+        TCLAP::ValuesConstraint<std::string> algorithmConstraint(algorithms);
+        TCLAP::ValueArg<std::string> argAlgorithm(
+          "", "algorithm", "Reconstruction algorithm; art updates the image "
+          "after every ray (Kaczmarz), mlem multiplies it with the "
+          "backprojected data ratios (OSEM with --os-subsets), cgls restarts "
+          "conjugate gradients on every window, fbp is a filtered "
+          "backprojection of every window (preview)", false, "sirt",
+          &algorithmConstraint);
+        TCLAP::ValueArg<float> argARTRelaxation(
+          "", "art-relaxation", "Relaxation factor of the ART updates, in "
+          "(0, 2). 1 fits every ray exactly, noisy data needs less",
+          false, 0.1, "float");
+        std::vector<std::string> fbp_filters {"ramp", "shepp-logan", "cosine",
+          "hamming", "hann"};
+        TCLAP::ValuesConstraint<std::string> fbpFilterConstraint(fbp_filters);
+        TCLAP::ValueArg<std::string> argFBPFilter(
+          "", "fbp-filter", "Filter of the filtered backprojection", false,
+          "ramp", &fbpFilterConstraint);
+        TCLAP::SwitchArg argWarmStart(
+          "", "warm-start", "Start the iterations from the filtered "
+          "backprojection of the first window", false);
+
+        std::vector<int> allowedTraceLevels {0, 1, 2};
+        TCLAP::ValuesConstraint<int> allowedTraceLevelVals(allowedTraceLevels);
+        TCLAP::ValueArg<int> argTraceLevel(
+          "", "trace-level", "Span tracing: 0 off, 1 phases of every window, "
+          "2 also chunks and partition requests", false, 0,
+          &allowedTraceLevelVals);
+        TCLAP::ValueArg<std::string> argTraceOutput(
+          "", "trace-output", "Prefix of the per-rank traces, "
+          "<prefix>-<rank>.json (Chrome trace) and <prefix>-<rank>.bin",
+          false, "trace", "string");
+        TCLAP::ValueArg<int> argTraceCapacity(
+          "", "trace-capacity", "Spans recorded per thread; later spans are "
+          "dropped", false, 1<<20, "int");
+
+        TCLAP::ValueArg<std::string> argCheckpointDir(
+          "", "checkpoint-dir", "Directory of the per-rank checkpoints",
+          false, ".", "string");
+        TCLAP::ValueArg<int> argCheckpointFreq(
+          "", "checkpoint-freq", "Checkpoint frequency, in windows. 0 disables "
+          "checkpoints", false, 0, "int");
+        TCLAP::ValueArg<std::string> argRestartFrom(
+          "", "restart-from", "Checkpoint directory to resume the image, the "
+          "window and the counters from", false, "", "string");
+
+        TCLAP::ValueArg<std::string> argInputFile(
+          "", "input-file", "Reconstruct the projections of this hdf5 file "
+          "instead of streaming them from the distributor", false, "", "string");
+        TCLAP::ValueArg<std::string> argInputDataset(
+          "", "input-dataset", "Projection dataset [projection, slice, column] "
+          "in the input file", false, "exchange/data", "string");
+        TCLAP::ValueArg<std::string> argThetaDataset(
+          "", "theta-dataset", "Projection angle dataset in the input file",
+          false, "exchange/theta", "string");
+        TCLAP::SwitchArg argThetaDegrees(
+          "", "theta-degrees", "Projection angles of the input file are in "
+          "degrees", false);
+
+        TCLAP::ValueArg<int> argHaloDepth(
+          "", "halo-depth", "Number of neighboring slices exchanged with the "
+          "ranks of the adjacent slabs after every update, for --slice-smoothing",
+          false, 0, "int");
+        TCLAP::ValueArg<float> argSliceSmoothing(
+          "", "slice-smoothing", "Weight of the smoothing step along the "
+          "slice axis after every update, in (0, 0.5]; reads the halo "
+          "slices of --halo-depth. Default is 0, i.e. no smoothing",
+          false, 0., "float");
 
         cmd.add(argReconOutputPath);
         cmd.add(argReconOutputDir);
@@ -75,12 +243,41 @@ class TraceRuntimeConfig {
         cmd.add(argCenter);
         cmd.add(argThreadCount);
         cmd.add(argWriteFreq);
+        cmd.add(argWriteBuffers);
+        cmd.add(argWriteMode);
+        cmd.add(argWriteFilter);
+        cmd.add(argWriteFilterLevel);
         cmd.add(argWindowLen);
         cmd.add(argWindowStep);
         cmd.add(argWindowIter);
 
         cmd.add(argDestHost);
         cmd.add(argDestPort);
+        cmd.add(argRecvQueueLen);
+        cmd.add(argProjGroupSize);
+        cmd.add(argDistUpdate);
+        cmd.add(argShmCombine);
+        cmd.add(argCommPrecision);
+        cmd.add(argCacheLengths);
+        cmd.add(argCombineBlocks);
+        cmd.add(argOSSubsets);
+        cmd.add(argOSOrder);
+        cmd.add(argAlgorithm);
+        cmd.add(argARTRelaxation);
+        cmd.add(argFBPFilter);
+        cmd.add(argWarmStart);
+        cmd.add(argTraceLevel);
+        cmd.add(argTraceOutput);
+        cmd.add(argTraceCapacity);
+        cmd.add(argCheckpointDir);
+        cmd.add(argCheckpointFreq);
+        cmd.add(argRestartFrom);
+        cmd.add(argInputFile);
+        cmd.add(argInputDataset);
+        cmd.add(argThetaDataset);
+        cmd.add(argThetaDegrees);
+        cmd.add(argHaloDepth);
+        cmd.add(argSliceSmoothing);
 
         cmd.parse(argc, argv);
         kReconOutputPath = argReconOutputPath.getValue();
@@ -89,6 +286,10 @@ class TraceRuntimeConfig {
         center = argCenter.getValue();
         thread_count = argThreadCount.getValue();
         write_freq= argWriteFreq.getValue();
+        write_buffers= argWriteBuffers.getValue();
+        write_mode= argWriteMode.getValue();
+        write_filter= argWriteFilter.getValue();
+        write_filter_level= argWriteFilterLevel.getValue();
         window_len= argWindowLen.getValue();
         window_step= argWindowStep.getValue();
         window_iter= argWindowIter.getValue();
@@ -96,6 +297,31 @@ class TraceRuntimeConfig {
         dest_port= argDestPort.getValue();
         pub_addr= argPubAddr.getValue();
         pub_freq= argPubFreq.getValue();
+        recv_queue_len= argRecvQueueLen.getValue();
+        proj_group_size= argProjGroupSize.getValue();
+        dist_update= argDistUpdate.getValue();
+        shm_combine= argShmCombine.getValue();
+        comm_precision= argCommPrecision.getValue();
+        cache_lengths= argCacheLengths.getValue();
+        combine_blocks= argCombineBlocks.getValue();
+        os_subsets= argOSSubsets.getValue();
+        os_order= argOSOrder.getValue();
+        algorithm= argAlgorithm.getValue();
+        art_relaxation= argARTRelaxation.getValue();
+        fbp_filter= argFBPFilter.getValue();
+        warm_start= argWarmStart.getValue();
+        trace_level= argTraceLevel.getValue();
+        trace_output= argTraceOutput.getValue();
+        trace_capacity= argTraceCapacity.getValue();
+        checkpoint_dir= argCheckpointDir.getValue();
+        checkpoint_freq= argCheckpointFreq.getValue();
+        restart_from= argRestartFrom.getValue();
+        input_file= argInputFile.getValue();
+        input_dataset= argInputDataset.getValue();
+        theta_dataset= argThetaDataset.getValue();
+        theta_degrees= argThetaDegrees.getValue();
+        halo_depth= argHaloDepth.getValue();
+        slice_smoothing= argSliceSmoothing.getValue();
 
         std::cout << "MPI rank:"<< rank << "; MPI size:" << size << std::endl;
         if(rank==0)
@@ -106,6 +332,9 @@ class TraceRuntimeConfig {
           std::cout << "Center value=" << center << std::endl;
           std::cout << "Number of threads per process=" << thread_count << std::endl;
           std::cout << "Write frequency=" << write_freq << std::endl;
+          std::cout << "Write buffers=" << write_buffers << std::endl;
+          std::cout << "Write mode=" << write_mode << std::endl;
+          std::cout << "Write filter=" << write_filter << std::endl;
           std::cout << "Window length=" << window_len << std::endl;
           std::cout << "Window step=" << window_step << std::endl;
           std::cout << "Window iter=" << window_iter << std::endl;
@@ -113,6 +342,31 @@ class TraceRuntimeConfig {
           std::cout << "Destination port=" << dest_port << std::endl;
           std::cout << "Publisher address=" << pub_addr << std::endl;
           std::cout << "Publish frequency=" << pub_freq << std::endl;
+          std::cout << "Receive queue length=" << recv_queue_len << std::endl;
+          std::cout << "Projection group size=" << proj_group_size << std::endl;
+          std::cout << "Distributed update=" << dist_update << std::endl;
+          std::cout << "Shared-memory combination=" << shm_combine << std::endl;
+          std::cout << "Combination precision=" << comm_precision << std::endl;
+          std::cout << "Cache lengths=" << cache_lengths << std::endl;
+          std::cout << "Combine blocks=" << combine_blocks << std::endl;
+          std::cout << "OS subsets=" << os_subsets << std::endl;
+          std::cout << "OS order=" << os_order << std::endl;
+          std::cout << "Algorithm=" << algorithm << std::endl;
+          std::cout << "ART relaxation=" << art_relaxation << std::endl;
+          std::cout << "FBP filter=" << fbp_filter << std::endl;
+          std::cout << "Warm start=" << warm_start << std::endl;
+          std::cout << "Trace level=" << trace_level << std::endl;
+          std::cout << "Trace output=" << trace_output << std::endl;
+          std::cout << "Trace capacity=" << trace_capacity << std::endl;
+          std::cout << "Checkpoint dir=" << checkpoint_dir << std::endl;
+          std::cout << "Checkpoint frequency=" << checkpoint_freq << std::endl;
+          std::cout << "Restart from=" << restart_from << std::endl;
+          std::cout << "Input file=" << input_file << std::endl;
+          std::cout << "Input dataset=" << input_dataset << std::endl;
+          std::cout << "Theta dataset=" << theta_dataset << std::endl;
+          std::cout << "Theta in degrees=" << theta_degrees << std::endl;
+          std::cout << "Halo depth=" << halo_depth << std::endl;
+          std::cout << "Slice smoothing=" << slice_smoothing << std::endl;
         }
       }
       catch (TCLAP::ArgException &e)
@@ -122,16 +376,165 @@ class TraceRuntimeConfig {
     }
 };
 
+/* Offline mode: reads the sinograms of this rank's group collectively and
+ * feeds them to the sliding window instead of the distributor */
+TraceStream* OpenFileStream(TraceRuntimeConfig &config,
+    int rank, int size, int group_size)
+{
+  trace_io::H5Metadata *md = trace_io::ReadMetadata(
+      config.input_file.c_str(), config.input_dataset.c_str());
+  auto free_md = [](trace_io::H5Metadata *m) { delete [] m->dims; delete m; };
+  if(md->ndims!=3){
+    free_md(md);
+    throw std::runtime_error("Input dataset is not [projection, slice, column]");
+  }
+  size_t n_projs = md->dims[0];
+  int tn_slices = static_cast<int>(md->dims[1]);
+  int n_cols = static_cast<int>(md->dims[2]);
+  int beg_slice, n_slices;
+  trace_io::DistributeSlices(rank/group_size, size/group_size, tn_slices,
+      beg_slice, n_slices);
+  /// Read in place; the window takes over the buffer
+  std::vector<float> projs(n_projs*n_slices*n_cols);
+  try{
+    trace_io::ReadSlicesCollective(md, beg_slice, n_slices, MPI_COMM_WORLD,
+        MPI_INFO_NULL, projs.data());
+  }
+  catch(...){
+    free_md(md);
+    throw;
+  }
+  free_md(md);
+
+  trace_io::H5Metadata *tmd = trace_io::ReadMetadata(
+      config.input_file.c_str(), config.theta_dataset.c_str());
+  trace_io::H5Data *tdata = nullptr;
+  try{
+    tdata = trace_io::ReadTheta(tmd);
+  }
+  catch(...){
+    free_md(tmd);
+    throw;
+  }
+  free_md(tmd);
+  std::vector<float> theta(tdata->count);
+  for(size_t i=0; i<theta.size(); ++i){
+    if(tdata->in_memory_type_size==sizeof(double))
+      theta[i] = static_cast<float>(static_cast<double*>(tdata->data)[i]);
+    else
+      theta[i] = static_cast<float*>(tdata->data)[i];
+    if(config.theta_degrees) theta[i] *= 3.14159265358979f/180.f;
+  }
+  delete [] static_cast<char*>(tdata->data);
+  delete tdata;
+  if(theta.size()!=n_projs)
+    throw std::runtime_error("Number of angles does not match the projections");
+
+  tomo_msg_metadata_t tmetadata;
+  tmetadata.tn_sinograms = static_cast<uint32_t>(tn_slices);
+  tmetadata.beg_sinogram = static_cast<uint32_t>(beg_slice);
+  tmetadata.n_sinograms = static_cast<uint32_t>(n_slices);
+  tmetadata.n_rays_per_proj_row = static_cast<uint32_t>(n_cols);
+  tmetadata.codec = 0;
+  /// Same default as the distributor
+  float center = (config.center!=0) ? config.center : n_cols/2.f;
+
+  return new TraceStream(tmetadata, std::move(projs), std::move(theta),
+      center, config.window_len, rank, size, config.pub_addr, group_size);
+}
+
+/* Main reduction space of the algorithms that combine replicas */
+SIRTReconSpace* NewReplicaSpace(std::string const &algorithm,
+    int n_blocks, int num_cols)
+{
+  int n_grids = num_cols*num_cols;
+  if(algorithm=="mlem") return new MLEMReconSpace(n_blocks, 2*n_grids);
+  if(algorithm=="cgls") return new CGLSReconSpace(n_blocks, n_grids+1);
+  return new SIRTReconSpace(n_blocks, 2*n_grids);
+}
+
+/* Initializes main_space, the main reduction space of algorithm RS, and
+ * returns the engine that runs it; the engine clones main_space for its
+ * other threads */
+template <typename RS>
+DISPEngineBase<RS, float>* NewEngine(
+    DISPCommBase<float> *comm, int thread_count, RS *main_space, int n_grids)
+{
+  main_space->Initialize(n_grids);
+  float init_val=0.;
+  main_space->reduction_objects().ResetAllItems(init_val);
+  return new DISPEngineReduction<RS, float>(comm, main_space, thread_count);
+}
+
 int main(int argc, char **argv)
 {
   /* Initiate middleware's communication layer */
-  DISPCommBase<float> *comm =
-        new DISPCommMPI<float>(&argc, &argv);
+#ifdef TRACE_USE_MPI
+  auto mpi_comm = new DISPCommMPI<float>(&argc, &argv);
+  DISPCommBase<float> *comm = mpi_comm;
+#else
+  DISPCommBase<float> *comm = new DISPCommLocal<float>();
+#endif
   TraceRuntimeConfig config(argc, argv, comm->rank(), comm->size());
-  TraceStream tstream(config.dest_host, config.dest_port, 
-                      config.window_len, 
-                      comm->rank(), comm->size(),
-                      config.pub_addr);
+  /// Before the stream, so that the receiver thread is traced
+  if(config.trace_level>0){
+    if(config.trace_capacity<1)
+      throw std::invalid_argument("--trace-capacity must be positive");
+    trace_span::Enable(config.trace_level, config.trace_capacity);
+    trace_span::ThreadName("main");
+  }
+
+#ifdef TRACE_USE_MPI
+
+  /* Projection-parallel groups: consecutive ranks share the same sinograms,
+   * their replicas are combined over group_comm. Member 0 of every group
+   * holds the complete slices and does the output. */
+  int group_size = config.proj_group_size;
+  if(group_size<1 || comm->size()%group_size!=0){
+    if(comm->rank()==0)
+      std::cerr << "Number of ranks (" << comm->size() << ") is not a multiple "
+        "of the projection group size (" << group_size << ")" << std::endl;
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  bool group_leader = (comm->rank()%group_size==0);
+  MPI_Comm group_comm, output_comm, halo_comm;
+  MPI_Comm_split(MPI_COMM_WORLD, comm->rank()/group_size, comm->rank(),
+      &group_comm);
+  MPI_Comm_split(MPI_COMM_WORLD, (group_leader) ? 0 : MPI_UNDEFINED,
+      comm->rank(), &output_comm);
+  /// Ranks with the same member index hold consecutive slabs
+  MPI_Comm_split(MPI_COMM_WORLD, comm->rank()%group_size, comm->rank(),
+      &halo_comm);
+  mpi_comm->reduce_comm(group_comm);
+  mpi_comm->SharedMemoryCombination(config.shm_combine);
+  if(config.comm_precision=="bf16")
+    mpi_comm->CombinationPrecision(kDISPCommBF16);
+  else if(config.comm_precision=="fp16")
+    mpi_comm->CombinationPrecision(kDISPCommFP16);
+  mpi_comm->CacheLengths(config.cache_lengths);
+#else
+  /* Single process: no groups, neighbors or nodes to combine with */
+  if(config.proj_group_size!=1 || config.halo_depth!=0 ||
+     config.slice_smoothing!=0.){
+    std::cerr << "--proj-group-size, --halo-depth and --slice-smoothing "
+      "require a build with TRACE_USE_MPI" << std::endl;
+    return 1;
+  }
+  int group_size = 1;
+  bool group_leader = true;
+  MPI_Comm output_comm = MPI_COMM_WORLD;
+#endif
+
+  TraceStream *stream = (config.input_file.empty()) ?
+    new TraceStream(config.dest_host, config.dest_port, 
+                    config.window_len, 
+                    comm->rank(), comm->size(),
+                    config.pub_addr, config.recv_queue_len, group_size) :
+    OpenFileStream(config, comm->rank(), comm->size(), group_size);
+  TraceStream &tstream = *stream;
+  /// Clamped to the rows of the ranks after a reassignment
+  int halo_depth = config.halo_depth;
+  tstream.NeighborSlices(halo_depth);
 
   /* Get metadata structure */
   tomo_msg_metadata_t tmetadata = (tomo_msg_metadata_t)tstream.metadata();
@@ -140,42 +543,69 @@ int main(int argc, char **argv)
 
   /***********************/
   /* Initiate middleware */
-  /* Prepare main reduction space and its objects */
-  /* The size of the reconstruction object (in reconstruction space) is
-   * twice the reconstruction object size, because of the length storage
+  /* Prepare main reduction space, its objects and the processing engine;
+   * only the engine of --algorithm is created.
+   * SIRT: the size of the reconstruction object (in reconstruction space)
+   * is twice the reconstruction object size, because of the length storage.
+   * MLEM: same replica layout as SIRT, (ratio, sensitivity) pairs.
+   * CGLS: a backprojection and a squared norm per slice.
+   * ART, FBP: update the image in place, their reduction objects are
+   * unused. FBP is also created for --warm-start.
+   * # threads is 0 for auto assign the number of threads.
    */
-  auto main_recon_space = new SIRTReconSpace(
-      n_blocks, 2*num_cols*num_cols);
-  main_recon_space->Initialize(num_cols*num_cols);
-  auto &main_recon_replica = main_recon_space->reduction_objects();
   float init_val=0.;
-  main_recon_replica.ResetAllItems(init_val);
-
-  /* Prepare processing engine and main reduction space for other threads */
-  DISPEngineBase<SIRTReconSpace, float> *engine =
-    new DISPEngineReduction<SIRTReconSpace, float>(
-        comm,
-        main_recon_space,
-        config.thread_count);
-        /// # threads (0 for auto assign the number of threads)
+  SIRTReconSpace *main_recon_space = nullptr;
+  DISPEngineBase<SIRTReconSpace, float> *engine = nullptr;
+  ARTReconSpace *art_space = nullptr;
+  DISPEngineBase<ARTReconSpace, float> *art_engine = nullptr;
+  FBPReconSpace *fbp_space = nullptr;
+  DISPEngineBase<FBPReconSpace, float> *fbp_engine = nullptr;
+  if(config.algorithm=="fbp" || config.warm_start){
+    fbp_space = new FBPReconSpace(1, 1);
+    fbp_space->Initialize(num_cols,
+        FBPReconSpace::ParseFilter(config.fbp_filter));
+    fbp_engine = new DISPEngineReduction<FBPReconSpace, float>(
+        comm, fbp_space, config.thread_count);
+  }
+  /// FBP has nothing to iterate
+  if(config.algorithm=="art"){
+    art_space = new ARTReconSpace(1, 1);
+    art_space->relaxation(config.art_relaxation);
+    art_engine = NewEngine(comm, config.thread_count, art_space,
+        num_cols*num_cols);
+  }
+  else if(config.algorithm!="fbp"){
+    main_recon_space = NewReplicaSpace(config.algorithm, n_blocks, num_cols);
+    engine = NewEngine(comm, config.thread_count, main_recon_space,
+        num_cols*num_cols);
+  }
 
   /**********************/
 
   /**************************/
   /* Perform reconstruction */
   /* Define job size per thread request */
-  #ifdef TIMERON
-  std::chrono::duration<double> recon_tot(0.), inplace_tot(0.), update_tot(0.), 
-    datagen_tot(0.);
-  std::chrono::duration<double> write_tot(0.);
-  #endif
-
   //DataRegionBase<float, TraceMetadata> *curr_slices = nullptr;
   DataRegionBase<float, TraceMetadata> *curr_slices = nullptr;
   /// Reconstructed image
-  DataRegionBareBase<float> recon_image(n_blocks*num_cols*num_cols);  
-  for(size_t i=0; i<recon_image.count(); ++i) 
-    recon_image[i]=0.; /// Initial values of the reconstructe image
+  /// Own slices are surrounded by halo_depth neighbor slices on each side
+  size_t slice_size = static_cast<size_t>(num_cols)*num_cols;
+  size_t recon_offset = halo_depth*slice_size;
+  auto recon_image = new DataRegionBareBase<float>(
+      (n_blocks+2*halo_depth)*slice_size);
+  /// MLEM updates are multiplicative and cannot start from zero
+  float init_image = (config.algorithm=="mlem") ? 1. : 0.;
+  for(size_t i=0; i<recon_image->count(); ++i) 
+    (*recon_image)[i]=init_image; /// Initial values of the reconstructe image
+#ifdef TRACE_USE_MPI
+  auto halo = new trace_comm::HaloExchange(&(*recon_image)[0], n_blocks,
+      slice_size, halo_depth, halo_comm);
+  /// Stripe of the combined replica owned by this rank (--dist-update)
+  bool dist_update = config.dist_update && group_size>1;
+  std::vector<float> recon_stripe;
+#else
+  bool dist_update = false;
+#endif
 
   /// Number of requested ray-sum values by each thread poll
   int64_t req_number = num_cols; 
@@ -186,18 +616,130 @@ int main(int argc, char **argv)
   h5md.dims[1] = tmetadata.tn_sinograms; 
   h5md.dims[0] = 0;   /// Number of projections is unknown
   h5md.dims[2] = tmetadata.n_rays_per_proj_row; 
-  for(int passes=0; ; ++passes){
-      #ifdef TIMERON
-      auto datagen_beg = std::chrono::system_clock::now();
-      #endif
-      curr_slices = tstream.ReadSlidingWindow(recon_image, config.window_step);
-      if(config.center!=0 && curr_slices!=nullptr) 
-        curr_slices->metadata().center(config.center);
-      #ifdef TIMERON
-      datagen_tot += (std::chrono::system_clock::now()-datagen_beg);
-      #endif
+  /// Output stage; writes overlap with reconstruction if buffers are given
+  trace_io::AsyncReconWriter *writer = nullptr;
+  if(group_leader)
+    writer = new trace_io::AsyncReconWriter(output_comm, config.write_buffers);
+  if(writer!=nullptr && config.write_mode=="series")
+    writer->EnableSeries(config.kReconOutputPath, config.kReconDatasetPath,
+        config.write_filter, config.write_filter_level);
+
+  /* Resume from the last checkpoint of this rank; the distributor assigned
+   * the initial sinograms again in the handshake, so rows saved after a
+   * reassignment are migrated back to them */
+  int first_pass = 0;
+  if(!config.restart_from.empty()){
+    trace_io::CheckpointState ckpt;
+    trace_io::ReadCheckpoint(
+        trace_io::CheckpointPath(config.restart_from, comm->rank()), ckpt);
+    if(ckpt.size!=comm->size() ||
+       ckpt.image.size()!=static_cast<size_t>(ckpt.n_sinograms)*slice_size)
+      throw std::runtime_error("Checkpoint does not match the run");
+    std::vector<uint32_t> old_ranges, new_ranges;
+    tstream.Restore(ckpt, MPI_COMM_WORLD, old_ranges, new_ranges);
+    if(old_ranges==new_ranges)
+      std::copy(ckpt.image.begin(), ckpt.image.end(), &(*recon_image)[recon_offset]);
+#ifdef TRACE_USE_MPI
+    else    /// Rows of the checkpoints differ from the handshake assignment
+      trace_comm::MigrateRows(ckpt.image.data(), &(*recon_image)[recon_offset],
+          slice_size, 1, old_ranges, new_ranges, MPI_COMM_WORLD);
+#endif
+    first_pass = static_cast<int>(ckpt.passes);
+    std::cout << "Rank " << comm->rank() << " restarted at pass " << first_pass <<
+      "; received projections=" << ckpt.counter << std::endl;
+  }
+  trace_io::AsyncCheckpointer *checkpointer = nullptr;
+  if(config.checkpoint_freq>0)
+    checkpointer = new trace_io::AsyncCheckpointer(config.checkpoint_dir,
+        comm->rank());
+
+  /// OS-SIRT: subsets are seeded alike on all ranks, so random orders match
+  /// within a projection group
+  if(config.os_subsets<1)
+    throw std::invalid_argument("--os-subsets must be positive");
+  /// The length plane differs between subsets
+  if(config.combine_blocks<0)
+    throw std::invalid_argument("--combine-blocks must not be negative");
+  if(config.os_subsets>1 && config.cache_lengths)
+    throw std::invalid_argument("--cache-lengths requires --os-subsets=1");
+  /// Row-action updates are sequential over the projections of a slice
+  if(config.algorithm=="art" && group_size>1)
+    throw std::invalid_argument("--algorithm=art requires --proj-group-size=1");
+  if(config.art_relaxation<=0. || config.art_relaxation>=2.)
+    throw std::invalid_argument("--art-relaxation must be in (0, 2)");
+  /// The first CGLS iteration of a window only computes the gradient, and
+  /// the steps need whole slices of a single system
+  if(config.algorithm=="cgls" && (config.window_iter<2 ||
+        config.os_subsets>1 || config.dist_update || config.cache_lengths))
+    throw std::invalid_argument("--algorithm=cgls requires --window-iter>=2, "
+        "--os-subsets=1 and no --dist-update or --cache-lengths");
+  if(config.algorithm=="fbp" && config.os_subsets>1)
+    throw std::invalid_argument("--algorithm=fbp requires --os-subsets=1");
+  /// The halos are only read by the smoothing step
+  if(config.slice_smoothing<0. || config.slice_smoothing>0.5)
+    throw std::invalid_argument("--slice-smoothing must be in [0, 0.5]");
+  if((config.slice_smoothing>0.) != (config.halo_depth>0))
+    throw std::invalid_argument("--slice-smoothing and --halo-depth>0 must "
+        "be given together");
+  /// Smoothing moves the iterate off the conjugate directions
+  if(config.algorithm=="cgls" && config.slice_smoothing>0.)
+    throw std::invalid_argument("--slice-smoothing is not supported by cgls");
+  /// The filtered backprojection has negative pixels
+  if(config.algorithm=="mlem" && config.warm_start)
+    throw std::invalid_argument("--warm-start is not supported by mlem");
+  OrderedSubsets *subsets = (config.os_subsets>1) ?
+    new OrderedSubsets(config.os_subsets,
+        OrderedSubsets::ParseOrder(config.os_order)) : nullptr;
+
+  for(int passes=first_pass; ; ++passes){
+      trace_span::Window(passes);
+      {
+        TRACE_SPAN("window");
+        curr_slices = tstream.ReadSlidingWindow(*recon_image, config.window_step);
+        if(config.center!=0 && curr_slices!=nullptr) 
+          curr_slices->metadata().center(config.center);
+      }
 
       if(curr_slices == nullptr) break; /// If nullptr, there is no more projection 
+      if(subsets!=nullptr) subsets->Split(*curr_slices);
+      /// A new window is a new least squares problem
+      if(auto cgls = dynamic_cast<CGLSReconSpace*>(main_recon_space))
+        cgls->Restart();
+
+      /// Analytic image of the window: the preview itself, or the starting
+      /// image of the iterations
+      bool fbp_window = (config.algorithm=="fbp") ||
+        (config.warm_start && passes==first_pass && config.restart_from.empty());
+      if(fbp_window){
+        TRACE_SPAN("fbp");
+#ifdef TRACE_USE_MPI
+        halo->Wait();
+#endif
+        float *own = &(*recon_image)[recon_offset];
+        std::fill(own, own+n_blocks*slice_size, 0.f);
+#ifdef TRACE_USE_MPI
+        /// Members backproject their share of the window's projections,
+        /// weighted by the projections of the whole window
+        if(group_size>1){
+          int window_projs = curr_slices->metadata().num_projs();
+          MPI_Allreduce(MPI_IN_PLACE, &window_projs, 1, MPI_INT, MPI_SUM,
+              group_comm);
+          fbp_space->WindowProjections(window_projs);
+        }
+#endif
+        fbp_engine->RunParallelReduction(*curr_slices, req_number);
+        curr_slices->ResetMirroredRegionIter();
+#ifdef TRACE_USE_MPI
+        if(group_size>1)
+          MPI_Allreduce(MPI_IN_PLACE, own, n_blocks*slice_size, MPI_FLOAT,
+              MPI_SUM, group_comm);
+        halo->Start();
+#endif
+      }
+      int window_iter = (config.algorithm=="fbp") ? 0 : config.window_iter;
+#ifdef TRACE_USE_MPI
+      mpi_comm->NewWindow();  /// Lengths change with the projections
+#endif
       
       /// Check window effect
       /// and iteration
@@ -209,81 +751,219 @@ int main(int argc, char **argv)
       */
 
       /// Iterate on window
-      for(int i=0; i<config.window_iter; ++i){
-        #ifdef TIMERON
-        auto recon_beg = std::chrono::system_clock::now();
-        #endif
-        engine->RunParallelReduction(*curr_slices, req_number);  /// Reconstruction
-
-        #ifdef TIMERON
-        recon_tot += (std::chrono::system_clock::now()-recon_beg);
-        auto inplace_beg = std::chrono::system_clock::now();
-        #endif
-        engine->ParInPlaceLocalSynchWrapper();              /// Local combination
-        #ifdef TIMERON
-        inplace_tot += (std::chrono::system_clock::now()-inplace_beg);
-
-        /// Update reconstruction object
-        auto update_beg = std::chrono::system_clock::now();
-        #endif
-        main_recon_space->UpdateRecon(recon_image, main_recon_replica);
-        #ifdef TIMERON
-        update_tot += (std::chrono::system_clock::now()-update_beg);
-        #endif
-        engine->ResetReductionSpaces(init_val);
-        curr_slices->ResetMirroredRegionIter();
+      auto window_beg = std::chrono::steady_clock::now();
+      for(int i=0; i<window_iter; ++i){
+        /// One update per subset; the whole window is a single subset
+        int n_subsets = (subsets!=nullptr) ? subsets->size() : 1;
+        std::vector<int> order(1, 0);
+        if(subsets!=nullptr) order = subsets->NextOrder();
+        for(int k=0; k<n_subsets; ++k){
+          auto &region = (subsets!=nullptr) ? (*subsets)[order[k]] : *curr_slices;
+          if(art_engine!=nullptr){
+#ifdef TRACE_USE_MPI
+            halo->Wait();   /// Own boundary slices change during the reduction
+#endif
+            {
+              TRACE_SPAN("reduce");
+              art_engine->RunParallelReduction(region, req_number);
+            }
+#ifdef TRACE_USE_MPI
+            if(config.slice_smoothing>0.)
+              trace_comm::SmoothSlices(&(*recon_image)[0], n_blocks,
+                  slice_size, *halo, config.slice_smoothing);
+            halo->Start();
+#endif
+            region.ResetMirroredRegionIter();
+            continue;
+          }
+          {
+            TRACE_SPAN("reduce");
+            engine->RunParallelReduction(region, req_number);  /// Reconstruction
+          }
+          {
+            TRACE_SPAN("combine");
+            if(group_size>1 && !dist_update && config.combine_blocks>0){
+              /// Local and group combination, pipelined over row blocks
+              engine->ParInPlaceLocalGlobalSynchWrapper(config.combine_blocks);
+            }
+            else{
+              engine->ParInPlaceLocalSynchWrapper();            /// Local combination
+              if(group_size>1 && !dist_update)
+                engine->DistInPlaceGlobalSynchWrapper();        /// Group combination
+            }
+          }
+
+          /// Update reconstruction object
+          {
+            TRACE_SPAN("update");
+#ifdef TRACE_USE_MPI
+            halo->Wait();   /// Own boundary slices are about to change
+            if(dist_update){
+              /// Each member divides only its stripe, pairs are kept together
+              size_t beg = mpi_comm->GlobalReduceScatter(
+                  main_recon_space->reduction_objects(), 2, recon_stripe);
+              main_recon_space->UpdateReconStripe(*recon_image, recon_stripe.data(),
+                  beg, beg+recon_stripe.size(), recon_offset);
+              mpi_comm->GlobalAllgather(&(*recon_image)[recon_offset],
+                  n_blocks*slice_size, 1);
+            }
+            else
+#endif
+              main_recon_space->UpdateRecon(*recon_image,
+                  main_recon_space->reduction_objects(), recon_offset);
+#ifdef TRACE_USE_MPI
+            /// Halos are from the previous update of the neighbors
+            if(config.slice_smoothing>0.)
+              trace_comm::SmoothSlices(&(*recon_image)[0], n_blocks,
+                  slice_size, *halo, config.slice_smoothing);
+            halo->Start();  /// Completed before the next update
+#endif
+          }
+          engine->ResetReductionSpaces(init_val);
+          region.ResetMirroredRegionIter();
+        }
       }
+      /// Reported to the distributor for rebalancing the sinograms
+      double window_sec = std::chrono::duration<double>(
+          std::chrono::steady_clock::now()-window_beg).count();
+      if(window_sec>0.)
+        tstream.ReportThroughput(static_cast<double>(n_blocks)*
+            curr_slices->metadata().num_projs()*std::max(window_iter, 1)/
+            window_sec);
 
       /* Emit reconstructed data */
-      #ifdef TIMERON
-      auto write_beg = std::chrono::system_clock::now();
-      #endif
       /* Publish the reconstructed image (slices) outside */
-      if(!(passes%config.pub_freq)){
+      if(group_leader && !(passes%config.pub_freq)){
+        TRACE_SPAN("publish");
         tstream.PublishImage(*curr_slices);
       }
-      if(!(passes%config.write_freq)){
-        std::stringstream iteration_stream;
-        iteration_stream << std::setfill('0') << std::setw(6) << passes;
-        std::string outputpath = config.kReconOutputDir + "/" + 
-          iteration_stream.str() + "-recon.h5";
-        trace_io::WriteRecon(
-            curr_slices->metadata(), h5md, 
-            outputpath, config.kReconDatasetPath);
+      {
+        TRACE_SPAN("write");
+        if(writer==nullptr){
+          /// Output is done by the group leader
+        }
+        else if(!(passes%config.write_freq) && config.write_mode=="series"){
+          writer->AppendRecon(curr_slices->metadata(), h5md, passes);
+        }
+        else if(!(passes%config.write_freq)){
+          std::stringstream iteration_stream;
+          iteration_stream << std::setfill('0') << std::setw(6) << passes;
+          std::string outputpath = config.kReconOutputDir + "/" + 
+            iteration_stream.str() + "-recon.h5";
+          writer->WriteRecon(
+              curr_slices->metadata(), h5md, 
+              outputpath, config.kReconDatasetPath);
+        }
       }
-      #ifdef TIMERON
-      write_tot += (std::chrono::system_clock::now()-write_beg);
-      #endif
 
 
       //delete curr_slices->metadata(); //TODO Check for memory leak
       delete curr_slices;
+
+      /* The distributor reassigned the sinograms: migrate the window and
+       * the image rows, and rebuild the reduction spaces for the new rows */
+      if(tstream.ReassignmentPending()){
+        TRACE_SPAN("reassign");
+        std::vector<uint32_t> old_ranges, new_ranges;
+        tstream.Reassign(MPI_COMM_WORLD, old_ranges, new_ranges);
+        n_blocks = tstream.metadata().n_sinograms;
+#ifdef TRACE_USE_MPI
+        /// A rank may now own fewer rows than the halo depth; all ranks use
+        /// the same depth, so that the halos of neighbors match
+        int new_depth = config.halo_depth;
+        for(size_t r=1; r<new_ranges.size(); r+=2)
+          new_depth = std::min(new_depth, static_cast<int>(new_ranges[r]));
+        if(new_depth!=halo_depth && comm->rank()==0)
+          std::cout << "Halo depth=" << new_depth << std::endl;
+        size_t new_offset = new_depth*slice_size;
+        delete halo;    /// Completes the exchange on the old image
+        auto new_image = new DataRegionBareBase<float>(
+            (n_blocks+2*new_depth)*slice_size);
+        for(size_t i=0; i<new_image->count(); ++i) (*new_image)[i]=0.;
+        trace_comm::MigrateRows(&(*recon_image)[recon_offset],
+            &(*new_image)[new_offset], slice_size, 1,
+            old_ranges, new_ranges, MPI_COMM_WORLD);
+        delete recon_image;
+        recon_image = new_image;
+        halo_depth = new_depth;
+        recon_offset = new_offset;
+        tstream.NeighborSlices(halo_depth);
+        halo = new trace_comm::HaloExchange(&(*recon_image)[0], n_blocks,
+            slice_size, halo_depth, halo_comm);
+        halo->Start();
+#endif
+
+        if(engine!=nullptr){   /// ART does not depend on the rows
+          delete engine;  /// Also deletes main_recon_space
+          main_recon_space = NewReplicaSpace(config.algorithm, n_blocks,
+              num_cols);
+          engine = NewEngine(comm, config.thread_count, main_recon_space,
+              num_cols*num_cols);
+        }
+      }
+
+      /* Snapshot for restarts; written by the checkpointer thread */
+      if(checkpointer!=nullptr && !(passes%config.checkpoint_freq)){
+        TRACE_SPAN("checkpoint");
+        std::unique_ptr<trace_io::CheckpointState> ckpt(
+            new trace_io::CheckpointState);
+        ckpt->rank = comm->rank();
+        ckpt->size = comm->size();
+        ckpt->passes = passes+1;
+        tstream.Checkpoint(*ckpt);
+        ckpt->image.assign(&(*recon_image)[recon_offset],
+            &(*recon_image)[recon_offset]+n_blocks*slice_size);
+        checkpointer->Submit(std::move(ckpt));
+      }
   }
 
   /**************************/
-  #ifdef TIMERON
-  if(comm->rank()==0){
-    std::cout << "Reconstruction time=" << recon_tot.count() << std::endl;
-    std::cout << "Local combination time=" << inplace_tot.count() << std::endl;
-    std::cout << "Update time=" << update_tot.count() << std::endl;
-    //std::cout << "Write time=" << write_tot.count() << std::endl;
-    std::cout << "Data gen total time=" << datagen_tot.count() << std::endl;
-    std::cout << "Total comp=" << recon_tot.count() + inplace_tot.count() + update_tot.count() << std::endl;
+  /// Phase totals of rank 0, from the spans of its main thread
+  if(comm->rank()==0 && trace_span::Enabled(trace_span::kPhases)){
+    double recon_tot = trace_span::TotalSeconds("reduce") +
+      trace_span::TotalSeconds("fbp");
+    double inplace_tot = trace_span::TotalSeconds("combine");
+    double update_tot = trace_span::TotalSeconds("update");
+    std::cout << "Reconstruction time=" << recon_tot << std::endl;
+    std::cout << "Local combination time=" << inplace_tot << std::endl;
+    std::cout << "Update time=" << update_tot << std::endl;
+    std::cout << "Write time=" << trace_span::TotalSeconds("write") << std::endl;
+    std::cout << "Data gen total time=" << trace_span::TotalSeconds("window") << std::endl;
+    std::cout << "Total comp=" << recon_tot + inplace_tot + update_tot << std::endl;
     std::cout << "Sustained proj/sec=" << tstream.counter() / 
-                                          (recon_tot.count()+inplace_tot.count()+update_tot.count()) << std::endl;
+                                          (recon_tot+inplace_tot+update_tot) << std::endl;
   }
-  #endif
 
   /* Clean-up the resources */
+  std::cout << "Waiting for pending writes" << std::endl;
+  delete writer;  /// Flushes; needs MPI, so before comm
+  delete checkpointer;
+  delete subsets;
   std::cout << "Deleting h5md.dimm" << std::endl;
   delete [] h5md.dims;
-  std::cout << "Deleting main_recon_space" << std::endl;
-  delete main_recon_space;
+  std::cout << "Deleting engines" << std::endl;
+  delete engine;        /// Also deletes main_recon_space
+  delete art_engine;    /// Also deletes art_space
+  delete fbp_engine;    /// Also deletes fbp_space
   //delete curr_slices;
+#ifdef TRACE_USE_MPI
+  delete halo;    /// Completes the last exchange
+#endif
+  delete recon_image;
+#ifdef TRACE_USE_MPI
+  if(output_comm!=MPI_COMM_NULL) MPI_Comm_free(&output_comm);
+  MPI_Comm_free(&group_comm);
+  MPI_Comm_free(&halo_comm);
+#endif
+  delete stream;   /// Joins the receiver thread
+  if(trace_span::Enabled(trace_span::kPhases)){
+    std::string prefix = config.trace_output + "-" +
+      std::to_string(comm->rank());
+    trace_span::WriteChromeTrace(prefix + ".json", comm->rank());
+    trace_span::WriteBinaryLog(prefix + ".bin", comm->rank());
+  }
   std::cout << "Deleting comm" << std::endl;
   delete comm;
-  //std::cout << "Deleting engine" << std::endl;
-  //delete engine;
   std::cout << "Exiting" << std::endl;
 }
 
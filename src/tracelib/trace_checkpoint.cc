@@ -0,0 +1,212 @@
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "trace_checkpoint.h"
+
+namespace {
+  const char kMagic[8] = {'T', 'R', 'C', 'C', 'K', 'P', 'T', '\0'};
+  const uint32_t kVersion = 1;
+  const uint64_t kAlign = 64;
+
+  uint64_t AlignUp(uint64_t off) { return (off+kAlign-1)/kAlign*kAlign; }
+
+  /* The arrays lie within the len bytes of the file, are aligned, and their
+   * counts match the sinograms of the header */
+  bool ArraysFit(trace_io::CheckpointHeader const &h, uint64_t len){
+    uint64_t const elem_size[4] = { sizeof(float), sizeof(float),
+                                    sizeof(float), sizeof(tomo_msg_data_t) };
+    for(int i=0; i<4; ++i){
+      if(h.offsets[i]<sizeof(h) || h.offsets[i]%kAlign!=0 ||
+         h.offsets[i]>len || h.counts[i]>(len-h.offsets[i])/elem_size[i])
+        return false;
+    }
+    uint64_t row = static_cast<uint64_t>(h.n_sinograms)*h.n_rays;
+    if(h.counts[0]!=row*h.n_rays) return false;     /// n_rays^2 slices
+    if(h.counts[2]!=h.counts[3]) return false;      /// theta, meta
+    if(row==0) return h.counts[1]==0;
+    /// Owned projections of the window
+    return h.counts[1]%row==0 && h.counts[1]/row<=h.counts[3];
+  }
+
+  void WriteAll(int fd, void const *buf, size_t n){
+    char const *p = static_cast<char const*>(buf);
+    while(n>0){
+      ssize_t rc = write(fd, p, n);
+      if(rc<0) throw std::runtime_error("Unable to write checkpoint");
+      p += rc;
+      n -= static_cast<size_t>(rc);
+    }
+  }
+}
+
+std::string trace_io::CheckpointPath(std::string const &dir, int rank)
+{
+  return dir + "/ckpt-" + std::to_string(rank) + ".bin";
+}
+
+void trace_io::WriteCheckpoint(
+    std::string const &path,
+    CheckpointState const &state)
+{
+  CheckpointHeader h;
+  std::memset(&h, 0, sizeof(h));
+  std::memcpy(h.magic, kMagic, sizeof(kMagic));
+  h.version = kVersion;
+  h.rank = state.rank;
+  h.size = state.size;
+  h.beg_sinogram = state.beg_sinogram;
+  h.n_sinograms = state.n_sinograms;
+  h.n_rays = state.n_rays;
+  h.passes = state.passes;
+  h.counter = state.counter;
+  h.meta_size = sizeof(tomo_msg_data_t);
+
+  void const *arrays[4] = { state.image.data(), state.proj.data(),
+                            state.theta.data(), state.meta.data() };
+  uint64_t bytes[4] = { state.image.size()*sizeof(float),
+                        state.proj.size()*sizeof(float),
+                        state.theta.size()*sizeof(float),
+                        state.meta.size()*sizeof(tomo_msg_data_t) };
+  h.counts[0] = state.image.size();
+  h.counts[1] = state.proj.size();
+  h.counts[2] = state.theta.size();
+  h.counts[3] = state.meta.size();
+  uint64_t off = AlignUp(sizeof(h));
+  for(int i=0; i<4; ++i){
+    h.offsets[i] = off;
+    off = AlignUp(off+bytes[i]);
+  }
+  h.file_size = off;
+
+  std::string tmp_path = path + ".tmp";
+  int fd = open(tmp_path.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+  if(fd<0) throw std::runtime_error("Unable to create checkpoint " + tmp_path);
+  try{
+    static const char zeros[kAlign] = {0};
+    WriteAll(fd, &h, sizeof(h));
+    uint64_t pos = sizeof(h);
+    for(int i=0; i<4; ++i){
+      WriteAll(fd, zeros, h.offsets[i]-pos);
+      WriteAll(fd, arrays[i], bytes[i]);
+      pos = h.offsets[i]+bytes[i];
+    }
+    WriteAll(fd, zeros, h.file_size-pos);
+  }
+  catch(...){
+    close(fd);
+    unlink(tmp_path.c_str());
+    throw;
+  }
+  close(fd);
+  if(std::rename(tmp_path.c_str(), path.c_str())!=0)
+    throw std::runtime_error("Unable to rename checkpoint " + tmp_path);
+}
+
+void trace_io::ReadCheckpoint(std::string const &path, CheckpointState &state)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  if(fd<0) throw std::runtime_error("Unable to open checkpoint " + path);
+  struct stat st;
+  if(fstat(fd, &st)!=0 || static_cast<size_t>(st.st_size)<sizeof(CheckpointHeader)){
+    close(fd);
+    throw std::runtime_error("Truncated checkpoint " + path);
+  }
+  size_t len = static_cast<size_t>(st.st_size);
+  void *map = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(map==MAP_FAILED) throw std::runtime_error("Unable to map checkpoint " + path);
+
+  char const *base = static_cast<char const*>(map);
+  CheckpointHeader const &h = *reinterpret_cast<CheckpointHeader const*>(base);
+  char const *err = nullptr;
+  if(std::memcmp(h.magic, kMagic, sizeof(kMagic))!=0 || h.version!=kVersion)
+    err = "Not a checkpoint file ";
+  else if(h.meta_size!=sizeof(tomo_msg_data_t))
+    err = "Incompatible checkpoint ";
+  else if(h.file_size!=len)
+    err = "Truncated checkpoint ";
+  else if(!ArraysFit(h, len))
+    err = "Corrupt checkpoint ";
+  if(err!=nullptr){
+    munmap(map, len);
+    throw std::runtime_error(err + path);
+  }
+
+  state.rank = h.rank;
+  state.size = h.size;
+  state.beg_sinogram = h.beg_sinogram;
+  state.n_sinograms = h.n_sinograms;
+  state.n_rays = h.n_rays;
+  state.passes = h.passes;
+  state.counter = h.counter;
+  float const *image = reinterpret_cast<float const*>(base+h.offsets[0]);
+  float const *proj = reinterpret_cast<float const*>(base+h.offsets[1]);
+  float const *theta = reinterpret_cast<float const*>(base+h.offsets[2]);
+  tomo_msg_data_t const *meta =
+    reinterpret_cast<tomo_msg_data_t const*>(base+h.offsets[3]);
+  state.image.assign(image, image+h.counts[0]);
+  state.proj.assign(proj, proj+h.counts[1]);
+  state.theta.assign(theta, theta+h.counts[2]);
+  state.meta.assign(meta, meta+h.counts[3]);
+  munmap(map, len);
+}
+
+trace_io::AsyncCheckpointer::AsyncCheckpointer(std::string const &dir, int rank) :
+  path_ {CheckpointPath(dir, rank)}
+{
+  io_thread_ = std::thread(&AsyncCheckpointer::IOLoop, this);
+}
+
+trace_io::AsyncCheckpointer::~AsyncCheckpointer()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  io_thread_.join();
+}
+
+void trace_io::AsyncCheckpointer::Submit(std::unique_ptr<CheckpointState> state)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_ = std::move(state);    /// Drops an older unwritten snapshot
+  }
+  cv_.notify_all();
+}
+
+void trace_io::AsyncCheckpointer::IOLoop()
+{
+  for(;;){
+    std::unique_ptr<CheckpointState> state;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this]{ return stop_ || pending_!=nullptr; });
+      if(pending_==nullptr) return;   /// stop_ and nothing left
+      state = std::move(pending_);
+    }
+
+    try{
+      WriteCheckpoint(path_, *state);
+    }
+    catch(std::exception &e){
+      std::cerr << e.what() << std::endl;  /// Keep streaming
+      continue;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++written_;
+  }
+}
+
+uint64_t trace_io::AsyncCheckpointer::written()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return written_;
+}
@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "trace_codec.h"
+
+#ifdef TRACE_HAVE_LZ4
+#include "lz4.h"
+#endif
+#ifdef TRACE_HAVE_ZSTD
+#include "zstd.h"
+#endif
+
+static const char *codec_names[TRACE_CODEC_COUNT] = {
+  "none", "lz4", "zstd", "bshuf-lz4"
+};
+
+uint32_t trace_codec_supported(void)
+{
+  uint32_t mask = 1u<<TRACE_CODEC_NONE;
+#ifdef TRACE_HAVE_LZ4
+  mask |= (1u<<TRACE_CODEC_LZ4) | (1u<<TRACE_CODEC_BSHUF_LZ4);
+#endif
+#ifdef TRACE_HAVE_ZSTD
+  mask |= 1u<<TRACE_CODEC_ZSTD;
+#endif
+  return mask;
+}
+
+const char* trace_codec_name(uint32_t codec)
+{
+  return (codec<TRACE_CODEC_COUNT) ? codec_names[codec] : "unknown";
+}
+
+int trace_codec_from_name(const char *name)
+{
+  for(int i=0; i<TRACE_CODEC_COUNT; ++i)
+    if(strcmp(name, codec_names[i])==0) return i;
+  return -1;
+}
+
+/* Transposes the 8x8 bit matrix x, where row i is byte i (Hacker's Delight,
+ * transpose8). Byte k of the result holds bit k of every input byte. */
+static inline uint64_t transpose8x8(uint64_t x)
+{
+  uint64_t t;
+  t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+  x = x ^ t ^ (t << 7);
+  t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+  x = x ^ t ^ (t << 14);
+  t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+  x = x ^ t ^ (t << 28);
+  return x;
+}
+
+/*
+ * Output layout: 32 bit planes of n/8 bytes each; plane (b*8+k) holds bit k
+ * of byte b of every element. Elements beyond the last multiple of 8 are
+ * copied unchanged after the planes.
+ */
+void trace_bitshuffle4(const void *src, void *dst, size_t n)
+{
+  const uint8_t *in = (const uint8_t *)src;
+  uint8_t *out = (uint8_t *)dst;
+  size_t n_groups = n/8;
+
+  for(size_t g=0; g<n_groups; ++g){
+    const uint8_t *elems = in + g*8*4;
+    for(int b=0; b<4; ++b){
+      uint64_t x = 0;
+      for(int j=0; j<8; ++j)
+        x |= (uint64_t)elems[j*4+b] << (8*j);
+      x = transpose8x8(x);
+      for(int k=0; k<8; ++k)
+        out[(size_t)(b*8+k)*n_groups + g] = (uint8_t)(x >> (8*k));
+    }
+  }
+  memcpy(out + n_groups*8*4, in + n_groups*8*4, (n-n_groups*8)*4);
+}
+
+void trace_bitunshuffle4(const void *src, void *dst, size_t n)
+{
+  const uint8_t *in = (const uint8_t *)src;
+  uint8_t *out = (uint8_t *)dst;
+  size_t n_groups = n/8;
+
+  for(size_t g=0; g<n_groups; ++g){
+    uint8_t *elems = out + g*8*4;
+    for(int b=0; b<4; ++b){
+      uint64_t x = 0;
+      for(int k=0; k<8; ++k)
+        x |= (uint64_t)in[(size_t)(b*8+k)*n_groups + g] << (8*k);
+      x = transpose8x8(x);
+      for(int j=0; j<8; ++j)
+        elems[j*4+b] = (uint8_t)(x >> (8*j));
+    }
+  }
+  memcpy(out + n_groups*8*4, in + n_groups*8*4, (n-n_groups*8)*4);
+}
+
+size_t trace_codec_bound(uint32_t codec, size_t raw_size)
+{
+  switch(codec){
+#ifdef TRACE_HAVE_LZ4
+    case TRACE_CODEC_LZ4:
+    case TRACE_CODEC_BSHUF_LZ4:
+      return (size_t)LZ4_compressBound((int)raw_size);
+#endif
+#ifdef TRACE_HAVE_ZSTD
+    case TRACE_CODEC_ZSTD:
+      return ZSTD_compressBound(raw_size);
+#endif
+    default:
+      return raw_size;
+  }
+}
+
+struct trace_codec_ctx {
+  void *scratch;
+  size_t scratch_cap;
+#ifdef TRACE_HAVE_ZSTD
+  ZSTD_CCtx *cctx;
+  ZSTD_DCtx *dctx;
+#endif
+};
+
+trace_codec_ctx_t* trace_codec_ctx_create(void)
+{
+  return (trace_codec_ctx_t *)calloc(1, sizeof(trace_codec_ctx_t));
+}
+
+void trace_codec_ctx_free(trace_codec_ctx_t *ctx)
+{
+  if(ctx==NULL) return;
+  free(ctx->scratch);
+#ifdef TRACE_HAVE_ZSTD
+  ZSTD_freeCCtx(ctx->cctx);
+  ZSTD_freeDCtx(ctx->dctx);
+#endif
+  free(ctx);
+}
+
+#ifdef TRACE_HAVE_LZ4
+/* Scratch buffer of at least n bytes, or NULL */
+static void* ctx_scratch(trace_codec_ctx_t *ctx, size_t n)
+{
+  if(ctx->scratch_cap<n){
+    void *p = realloc(ctx->scratch, n);
+    if(p==NULL) return NULL;
+    ctx->scratch = p;
+    ctx->scratch_cap = n;
+  }
+  return ctx->scratch;
+}
+#endif
+
+size_t trace_codec_compress_ctx(trace_codec_ctx_t *ctx, uint32_t codec,
+                                const void *src, size_t raw_size,
+                                void *dst, size_t dst_cap, int level)
+{
+  (void)ctx;
+  (void)level;
+  switch(codec){
+    case TRACE_CODEC_NONE:
+      if(dst_cap<raw_size) return 0;
+      memcpy(dst, src, raw_size);
+      return raw_size;
+#ifdef TRACE_HAVE_LZ4
+    case TRACE_CODEC_LZ4: {
+      if(raw_size>INT_MAX) return 0;
+      if(dst_cap>INT_MAX) dst_cap = INT_MAX;
+      int rc = LZ4_compress_fast((const char *)src, (char *)dst, (int)raw_size,
+                                 (int)dst_cap, (level>0) ? level : 1);
+      return (rc>0) ? (size_t)rc : 0;
+    }
+    case TRACE_CODEC_BSHUF_LZ4: {
+      if(raw_size>INT_MAX) return 0;
+      if(dst_cap>INT_MAX) dst_cap = INT_MAX;
+      void *tmp = ctx_scratch(ctx, raw_size);
+      if(tmp==NULL) return 0;
+      /* Trailing bytes of a partial element are kept as they are */
+      trace_bitshuffle4(src, tmp, raw_size/4);
+      memcpy((char *)tmp+raw_size/4*4, (const char *)src+raw_size/4*4,
+             raw_size%4);
+      int rc = LZ4_compress_fast((const char *)tmp, (char *)dst, (int)raw_size,
+                                 (int)dst_cap, (level>0) ? level : 1);
+      return (rc>0) ? (size_t)rc : 0;
+    }
+#endif
+#ifdef TRACE_HAVE_ZSTD
+    case TRACE_CODEC_ZSTD: {
+      if(ctx->cctx==NULL && (ctx->cctx = ZSTD_createCCtx())==NULL) return 0;
+      size_t rc = ZSTD_compressCCtx(ctx->cctx, dst, dst_cap, src, raw_size,
+                                    (level>0) ? level : 1);
+      return ZSTD_isError(rc) ? 0 : rc;
+    }
+#endif
+    default:
+      return 0;
+  }
+}
+
+int trace_codec_decompress_ctx(trace_codec_ctx_t *ctx, uint32_t codec,
+                               const void *src, size_t comp_size,
+                               void *dst, size_t raw_size)
+{
+  (void)ctx;
+  switch(codec){
+    case TRACE_CODEC_NONE:
+      if(comp_size!=raw_size) return -1;
+      memcpy(dst, src, raw_size);
+      return 0;
+#ifdef TRACE_HAVE_LZ4
+    case TRACE_CODEC_LZ4: {
+      if(comp_size>INT_MAX || raw_size>INT_MAX) return -1;
+      int rc = LZ4_decompress_safe((const char *)src, (char *)dst,
+                                   (int)comp_size, (int)raw_size);
+      return (rc==(int)raw_size) ? 0 : -1;
+    }
+    case TRACE_CODEC_BSHUF_LZ4: {
+      if(comp_size>INT_MAX || raw_size>INT_MAX) return -1;
+      void *tmp = ctx_scratch(ctx, raw_size);
+      if(tmp==NULL) return -1;
+      int rc = LZ4_decompress_safe((const char *)src, (char *)tmp,
+                                   (int)comp_size, (int)raw_size);
+      if(rc!=(int)raw_size) return -1;
+      trace_bitunshuffle4(tmp, dst, raw_size/4);
+      memcpy((char *)dst+raw_size/4*4, (const char *)tmp+raw_size/4*4,
+             raw_size%4);
+      return 0;
+    }
+#endif
+#ifdef TRACE_HAVE_ZSTD
+    case TRACE_CODEC_ZSTD: {
+      if(ctx->dctx==NULL && (ctx->dctx = ZSTD_createDCtx())==NULL) return -1;
+      size_t rc = ZSTD_decompressDCtx(ctx->dctx, dst, raw_size, src, comp_size);
+      return (!ZSTD_isError(rc) && rc==raw_size) ? 0 : -1;
+    }
+#endif
+    default:
+      return -1;
+  }
+}
+
+size_t trace_codec_compress(uint32_t codec, const void *src, size_t raw_size,
+                            void *dst, size_t dst_cap, int level)
+{
+  trace_codec_ctx_t *ctx = trace_codec_ctx_create();
+  if(ctx==NULL) return 0;
+  size_t rc = trace_codec_compress_ctx(ctx, codec, src, raw_size, dst,
+                                       dst_cap, level);
+  trace_codec_ctx_free(ctx);
+  return rc;
+}
+
+int trace_codec_decompress(uint32_t codec, const void *src, size_t comp_size,
+                           void *dst, size_t raw_size)
+{
+  trace_codec_ctx_t *ctx = trace_codec_ctx_create();
+  if(ctx==NULL) return -1;
+  int rc = trace_codec_decompress_ctx(ctx, codec, src, comp_size, dst,
+                                      raw_size);
+  trace_codec_ctx_free(ctx);
+  return rc;
+}
@@ -1,15 +1,20 @@
+#include <climits>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
 #include "trace_comm.h"
 #include "mpi.h"
 
 void trace_comm::GlobalNeighborUpdate(
     ADataRegion<float> &recon_a,
     int num_slices,
-    size_t slice_size)  // Reconstruction object
+    size_t slice_size,
+    MPI_Comm comm)  // Reconstruction object
 {
   int mpi_rank;
-  MPI_Comm_rank(MPI_COMM_WORLD, &mpi_rank);
+  MPI_Comm_rank(comm, &mpi_rank);
   int mpi_size; 
-  MPI_Comm_size(MPI_COMM_WORLD, &mpi_size);
+  MPI_Comm_size(comm, &mpi_size);
 
   float *recon = &recon_a[0];
 
@@ -28,9 +33,9 @@ void trace_comm::GlobalNeighborUpdate(
     recv_ptr = ((float*)recon) + slice_size*(num_slices-1);
 
     MPI_Isend(send_ptr, slice_size, MPI_FLOAT, mpi_rank+1, 0,
-      MPI_COMM_WORLD, &requests[0]);
+      comm, &requests[0]);
     MPI_Irecv(recv_ptr, slice_size, MPI_FLOAT, mpi_rank+1, 0,
-      MPI_COMM_WORLD, &requests[1]);
+      comm, &requests[1]);
 
     MPI_Waitall(2, requests, statuses);
 
@@ -39,17 +44,17 @@ void trace_comm::GlobalNeighborUpdate(
     send_ptr = ((float*)recon) + slice_size;
     recv_ptr = ((float*)recon);
     MPI_Isend(send_ptr, slice_size, MPI_FLOAT, mpi_rank-1, 0, 
-        MPI_COMM_WORLD, &requests[0]);
+        comm, &requests[0]);
     MPI_Irecv(recv_ptr, slice_size, MPI_FLOAT, mpi_rank-1, 0,
-        MPI_COMM_WORLD, &requests[1]);
+        comm, &requests[1]);
 
     /* With bottom */
     float *send_ptr_b = ((float*)recon) + slice_size*(num_slices-2);
     float *recv_ptr_b = ((float*)recon) + slice_size*(num_slices-1);
     MPI_Isend(send_ptr_b, slice_size, MPI_FLOAT, mpi_rank+1, 0,
-      MPI_COMM_WORLD, &requests[2]);
+      comm, &requests[2]);
     MPI_Irecv(recv_ptr_b, slice_size, MPI_FLOAT, mpi_rank+1, 0,
-      MPI_COMM_WORLD, &requests[3]);
+      comm, &requests[3]);
 
     MPI_Waitall(4, requests, statuses);
 
@@ -58,10 +63,175 @@ void trace_comm::GlobalNeighborUpdate(
     send_ptr = ((float*)recon) + slice_size;
     recv_ptr = ((float*)recon);
     MPI_Isend(send_ptr, slice_size, MPI_FLOAT, mpi_rank-1, 0, 
-        MPI_COMM_WORLD, &requests[0]);
+        comm, &requests[0]);
     MPI_Irecv(recv_ptr, slice_size, MPI_FLOAT, mpi_rank-1, 0,
-        MPI_COMM_WORLD, &requests[1]);
+        comm, &requests[1]);
 
     MPI_Waitall(2, requests, statuses);
   }
 }
+
+void trace_comm::MigrateRows(
+    float const *src,
+    float *dst,
+    size_t row_size,
+    int num_blocks,
+    std::vector<uint32_t> const &old_ranges,
+    std::vector<uint32_t> const &new_ranges,
+    MPI_Comm comm)
+{
+  int rank, size;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+  if(old_ranges.size()!=2*static_cast<size_t>(size) ||
+     new_ranges.size()!=2*static_cast<size_t>(size))
+    throw std::invalid_argument("Ranges do not match the communicator size");
+
+  size_t old_beg = old_ranges[2*rank], old_n = old_ranges[2*rank+1];
+  size_t new_beg = new_ranges[2*rank], new_n = new_ranges[2*rank+1];
+  if(std::max(old_n, new_n)*row_size>INT_MAX)
+    throw std::overflow_error("Migrated block exceeds int count");
+
+  std::vector<MPI_Request> requests;
+  std::vector<MPI_Datatype> types;
+  /// Rows [beg, beg+n) of every block of a buffer with stride rows per block
+  auto block_rows = [&](size_t n, size_t stride) {
+    MPI_Datatype type;
+    MPI_Type_vector(num_blocks, static_cast<int>(n*row_size),
+        static_cast<int>(stride*row_size), MPI_FLOAT, &type);
+    MPI_Type_commit(&type);
+    types.push_back(type);
+    return type;
+  };
+
+  for(int r=0; r<size; ++r){
+    /// My old rows that r owns now
+    size_t s_beg = std::max<size_t>(old_beg, new_ranges[2*r]);
+    size_t s_end = std::min<size_t>(old_beg+old_n,
+        new_ranges[2*r]+new_ranges[2*r+1]);
+    /// My new rows that r owned
+    size_t r_beg = std::max<size_t>(new_beg, old_ranges[2*r]);
+    size_t r_end = std::min<size_t>(new_beg+new_n,
+        old_ranges[2*r]+old_ranges[2*r+1]);
+
+    if(r==rank){
+      for(int b=0; b<num_blocks && s_beg<s_end; ++b)
+        std::memcpy(dst+(b*new_n+s_beg-new_beg)*row_size,
+            src+(b*old_n+s_beg-old_beg)*row_size,
+            (s_end-s_beg)*row_size*sizeof(float));
+      continue;
+    }
+    if(s_beg<s_end){
+      requests.emplace_back();
+      MPI_Isend(src+(s_beg-old_beg)*row_size, 1,
+          block_rows(s_end-s_beg, old_n), r, 0, comm, &requests.back());
+    }
+    if(r_beg<r_end){
+      requests.emplace_back();
+      MPI_Irecv(dst+(r_beg-new_beg)*row_size, 1,
+          block_rows(r_end-r_beg, new_n), r, 0, comm, &requests.back());
+    }
+  }
+  MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+  for(auto &type : types) MPI_Type_free(&type);
+}
+
+trace_comm::HaloExchange::HaloExchange(
+    float *recon,
+    int num_slices,
+    size_t slice_size,
+    int depth,
+    MPI_Comm comm) :
+  comm_ {comm},
+  depth_ {depth}
+{
+  if(depth<0 || depth>num_slices)
+    throw std::invalid_argument("Halo depth exceeds the number of slices");
+
+  int rank, size;
+  MPI_Comm_rank(comm_, &rank);
+  MPI_Comm_size(comm_, &size);
+  if(depth==0 || size==1) return;
+
+  size_t count = slice_size*depth;
+  if(count>INT_MAX)
+    throw std::overflow_error("Halo exceeds int count");
+
+  float *top_halo = recon;
+  float *top_own = recon + count;
+  float *bottom_own = recon + slice_size*num_slices;
+  float *bottom_halo = recon + slice_size*(num_slices+depth);
+
+  /// Tag 0: data going down (to rank+1), tag 1: data going up
+  has_top_ = (rank>0);
+  has_bottom_ = (rank<size-1);
+  if(rank>0){
+    MPI_Send_init(top_own, count, MPI_FLOAT, rank-1, 1, comm_,
+        &requests_[num_requests_++]);
+    MPI_Recv_init(top_halo, count, MPI_FLOAT, rank-1, 0, comm_,
+        &requests_[num_requests_++]);
+  }
+  if(rank<size-1){
+    MPI_Send_init(bottom_own, count, MPI_FLOAT, rank+1, 0, comm_,
+        &requests_[num_requests_++]);
+    MPI_Recv_init(bottom_halo, count, MPI_FLOAT, rank+1, 1, comm_,
+        &requests_[num_requests_++]);
+  }
+}
+
+trace_comm::HaloExchange::~HaloExchange()
+{
+  Wait();
+  for(int i=0; i<num_requests_; ++i)
+    MPI_Request_free(&requests_[i]);
+}
+
+void trace_comm::HaloExchange::Start()
+{
+  if(active_) throw std::logic_error("Halo exchange is already started");
+  if(num_requests_==0) return;
+  MPI_Startall(num_requests_, requests_);
+  active_ = true;
+}
+
+void trace_comm::HaloExchange::Wait()
+{
+  if(!active_) return;
+  MPI_Waitall(num_requests_, requests_, MPI_STATUSES_IGNORE);
+  active_ = false;
+}
+
+bool trace_comm::HaloExchange::Test()
+{
+  if(!active_) return true;
+  int flag;
+  MPI_Testall(num_requests_, requests_, &flag, MPI_STATUSES_IGNORE);
+  if(flag) active_ = false;
+  return flag;
+}
+
+void trace_comm::SmoothSlices(
+    float *recon,
+    int num_slices,
+    size_t slice_size,
+    HaloExchange const &halo,
+    float beta)
+{
+  if(num_slices<1) return;
+  float *own = recon + slice_size*halo.depth();
+  /// Old values of the slice above the current one, and of the current one
+  std::vector<float> above(slice_size), curr(slice_size);
+  float const *top = (halo.has_top()) ? own-slice_size : own;
+  std::copy(top, top+slice_size, above.begin());
+
+  for(int s=0; s<num_slices; ++s){
+    float *slice = own + slice_size*s;
+    std::copy(slice, slice+slice_size, curr.begin());
+    /// Slice below is not updated yet, or it is the bottom halo
+    float const *below = (s+1<num_slices || halo.has_bottom()) ?
+      slice+slice_size : curr.data();
+    for(size_t j=0; j<slice_size; ++j)
+      slice[j] += beta*(above[j] - 2.f*curr[j] + below[j]);
+    above.swap(curr);
+  }
+}
@@ -0,0 +1,157 @@
+#include <cmath>
+#include <mutex>
+#include <stdexcept>
+#include "trace_fft.h"
+
+#ifdef TRACE_HAVE_FFTW
+#include <fftw3.h>
+#endif
+
+size_t trace_utils::NextPowerOfTwo(size_t n)
+{
+  size_t p = 1;
+  while(p<n) p <<= 1;
+  return p;
+}
+
+#ifdef TRACE_HAVE_FFTW
+
+namespace {
+  /// FFTW planning is not thread safe
+  std::mutex plan_mutex;
+}
+
+trace_utils::RealFFT::RealFFT(size_t n) : n_{n}
+{
+  if(n<4 || (n & (n-1))!=0)
+    throw std::invalid_argument("RealFFT: length must be a power of two >= 4");
+  std::lock_guard<std::mutex> lock(plan_mutex);
+  real_ = fftwf_alloc_real(n);
+  spectrum_ = reinterpret_cast<std::complex<float>*>(fftwf_alloc_complex(n/2+1));
+  auto cplx = reinterpret_cast<fftwf_complex*>(spectrum_);
+  forward_plan_ = fftwf_plan_dft_r2c_1d(static_cast<int>(n), real_, cplx,
+      FFTW_ESTIMATE);
+  inverse_plan_ = fftwf_plan_dft_c2r_1d(static_cast<int>(n), cplx, real_,
+      FFTW_ESTIMATE);
+}
+
+trace_utils::RealFFT::~RealFFT()
+{
+  std::lock_guard<std::mutex> lock(plan_mutex);
+  fftwf_destroy_plan(static_cast<fftwf_plan>(forward_plan_));
+  fftwf_destroy_plan(static_cast<fftwf_plan>(inverse_plan_));
+  fftwf_free(real_);
+  fftwf_free(spectrum_);
+}
+
+void trace_utils::RealFFT::Forward()
+{
+  fftwf_execute(static_cast<fftwf_plan>(forward_plan_));
+}
+
+void trace_utils::RealFFT::Inverse()
+{
+  fftwf_execute(static_cast<fftwf_plan>(inverse_plan_));  /// Unscaled
+  float scale = 1.f/n_;
+  for(size_t i=0; i<n_; ++i) real_[i] *= scale;
+}
+
+#else
+
+trace_utils::RealFFT::RealFFT(size_t n) : n_{n}
+{
+  if(n<4 || (n & (n-1))!=0)
+    throw std::invalid_argument("RealFFT: length must be a power of two >= 4");
+  real_ = new float[n];
+  spectrum_ = new std::complex<float>[n/2+1];
+
+  size_t m = n/2;
+  const double pi = std::acos(-1.);
+  work_.resize(m);
+  twiddles_.resize(m);
+  for(size_t k=0; k<m; ++k){
+    double a = -2.*pi*k/n;
+    twiddles_[k] = std::complex<float>(std::cos(a), std::sin(a));
+  }
+  int bits = 0;
+  while((static_cast<size_t>(1)<<bits)<m) ++bits;
+  bitrev_.resize(m);
+  for(size_t i=0; i<m; ++i){
+    size_t r = 0;
+    for(int b=0; b<bits; ++b)
+      if(i & (static_cast<size_t>(1)<<b)) r |= static_cast<size_t>(1)<<(bits-1-b);
+    bitrev_[i] = r;
+  }
+}
+
+trace_utils::RealFFT::~RealFFT()
+{
+  delete [] real_;
+  delete [] spectrum_;
+}
+
+/// In-place iterative transform of work_ (m = n/2 points); twiddles of the
+/// m-point transform are every second twiddle of the n-point one
+void trace_utils::RealFFT::Radix2(bool inverse)
+{
+  size_t m = work_.size();
+  for(size_t i=0; i<m; ++i)
+    if(i<bitrev_[i]) std::swap(work_[i], work_[bitrev_[i]]);
+
+  for(size_t len=2; len<=m; len<<=1){
+    size_t half = len/2;
+    size_t step = n_/len;
+    for(size_t beg=0; beg<m; beg+=len){
+      for(size_t k=0; k<half; ++k){
+        std::complex<float> w = twiddles_[k*step];
+        if(inverse) w = std::conj(w);
+        std::complex<float> t = w*work_[beg+k+half];
+        work_[beg+k+half] = work_[beg+k]-t;
+        work_[beg+k] += t;
+      }
+    }
+  }
+}
+
+void trace_utils::RealFFT::Forward()
+{
+  /// z[j] = x[2j] + i x[2j+1]; X[k] = (Z[k]+conj(Z[m-k]))/2
+  ///   - i/2 W^k (Z[k]-conj(Z[m-k])), with W = exp(-2 pi i/n)
+  size_t m = n_/2;
+  for(size_t j=0; j<m; ++j)
+    work_[j] = std::complex<float>(real_[2*j], real_[2*j+1]);
+  Radix2(false);
+
+  const std::complex<float> i_half(0.f, 0.5f);
+  spectrum_[0] = std::complex<float>(work_[0].real()+work_[0].imag(), 0.f);
+  spectrum_[m] = std::complex<float>(work_[0].real()-work_[0].imag(), 0.f);
+  for(size_t k=1; k<m; ++k){
+    std::complex<float> a = work_[k];
+    std::complex<float> b = std::conj(work_[m-k]);
+    spectrum_[k] = 0.5f*(a+b) - i_half*twiddles_[k]*(a-b);
+  }
+}
+
+void trace_utils::RealFFT::Inverse()
+{
+  /// Inverse of the split in Forward(): Z[k] = E[k] + i O[k], with
+  /// E[k] = (X[k]+conj(X[m-k]))/2 and O[k] = conj(W^k) (X[k]-conj(X[m-k]))/2
+  size_t m = n_/2;
+  const std::complex<float> i_unit(0.f, 1.f);
+  for(size_t k=0; k<m; ++k){
+    std::complex<float> a = spectrum_[k];
+    std::complex<float> b = std::conj(spectrum_[m-k]);
+    std::complex<float> e = 0.5f*(a+b);
+    std::complex<float> o = 0.5f*std::conj(twiddles_[k])*(a-b);
+    work_[k] = e + i_unit*o;
+  }
+  Radix2(true);
+
+  float scale = 1.f/m;
+  for(size_t j=0; j<m; ++j){
+    real_[2*j] = work_[j].real()*scale;
+    real_[2*j+1] = work_[j].imag()*scale;
+  }
+}
+
+#endif
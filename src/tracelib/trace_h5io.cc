@@ -1,7 +1,8 @@
 #include <string>
 #include <stdexcept>
 #include <stdlib.h>
-#include "mpi.h"
+#include <algorithm>
+#include "trace_mpi.h"
 #include "trace_h5io.h"
 
 void trace_io::DistributeSlices(
@@ -105,9 +106,8 @@ trace_io::H5Data* trace_io::ReadTheta(H5Metadata *metadata_p){
   l_data->count = metadata.dims[0];
   l_data->in_memory_type_size = ldtype_size;
 
+  /* H5Dread fills the whole buffer */
   char *dset_data = new char[l_data->count * l_data->in_memory_type_size];
-  for(size_t i=0; i<l_data->count * l_data->in_memory_type_size; ++i)
-    (static_cast<char *>(dset_data))[0] = 0x00;
 
   /* Read data into memory */
   H5Dread(
@@ -115,11 +115,12 @@ trace_io::H5Data* trace_io::ReadTheta(H5Metadata *metadata_p){
       mem_type_id, 
       H5S_ALL, /*hid_t mem_space_id*/
       H5S_ALL, /*hid_t file_space_id*/
-      H5S_ALL, /*hid_t xfer_plist_id*/
+      H5P_DEFAULT, /*hid_t xfer_plist_id*/
       dset_data);
 
   l_data->data = dset_data;
 
+  H5Tclose(mem_type_id);
   H5Tclose(dtype_id);
   H5Dclose(dataset_id);
   H5Fclose(file_id);
@@ -220,9 +221,8 @@ trace_io::H5Data* trace_io::ReadSlices(
 
   size_t nelem_per_slice = metadata.dims[0] * metadata.dims[2];
   size_t nelem_slices = nelem_per_slice * count;
+  /* The selection covers the whole buffer, no need to clear it */
   char *dset_data = new char[nelem_slices*ldtype_size];
-  for(size_t i=0; i<nelem_slices*ldtype_size; ++i)
-    (static_cast<char*>(dset_data))[i] = 0x00;
 
   /* Read data into memory */
   H5Dread(dataset_id, mem_type_id, memspace, dataspace,
@@ -366,6 +366,151 @@ trace_io::H5Data* trace_io::ReadProjections(H5Metadata *metadata_p,
   return l_data;
 }
 
+void trace_io::ReadSinograms(
+    H5Metadata *metadata_p,
+    int beg_slice, int count,
+    float *sinograms)
+{
+  auto &metadata = *metadata_p;
+  if(metadata.ndims!=3)
+    throw std::runtime_error("Currently only 3D dataset is supporter");
+  hsize_t *dims = metadata.dims;
+  if(beg_slice<0 || count<0 ||
+     static_cast<hsize_t>(beg_slice+count)>dims[1])
+    throw std::out_of_range("Sinograms are out of the dataset range");
+
+  hid_t file_id = H5Fopen(metadata.file_path.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  if(file_id<0)
+    throw std::runtime_error("Unable to open " + metadata.file_path);
+  hid_t dataset_id = H5Dopen2(file_id, metadata.dataset_path.c_str(), H5P_DEFAULT);
+  if(dataset_id<0){
+    H5Fclose(file_id);
+    throw std::runtime_error("Unable to open " + metadata.dataset_path);
+  }
+  hid_t dataspace = H5Dget_space(dataset_id);
+
+  /* Memory is [slice, projection, column]; a slice of the file, i.e. a
+   * [projection, 1, column] hyperslab, lands in one [1, projection, column]
+   * hyperslab of memory since both are traversed projection-major. */
+  hsize_t dimsm[3] = { static_cast<hsize_t>(count), dims[0], dims[2] };
+  hid_t memspace = H5Screate_simple(3, dimsm, NULL);
+
+  herr_t status = 0;
+  for(int s=0; s<count && status>=0; ++s){
+    hsize_t h_offset[3] = { 0, static_cast<hsize_t>(beg_slice+s), 0 };
+    hsize_t h_count[3] = { dims[0], 1, dims[2] };
+    hsize_t m_offset[3] = { static_cast<hsize_t>(s), 0, 0 };
+    hsize_t m_count[3] = { 1, dims[0], dims[2] };
+    H5Sselect_hyperslab(dataspace, H5S_SELECT_SET, h_offset, NULL, h_count, NULL);
+    H5Sselect_hyperslab(memspace, H5S_SELECT_SET, m_offset, NULL, m_count, NULL);
+    status = H5Dread(dataset_id, H5T_NATIVE_FLOAT, memspace, dataspace,
+        H5P_DEFAULT, sinograms);
+  }
+
+  H5Sclose(memspace);
+  H5Sclose(dataspace);
+  H5Dclose(dataset_id);
+  H5Fclose(file_id);
+  if(status<0)
+    throw std::runtime_error("Unable to read sinograms of " + metadata.file_path);
+}
+
+void trace_io::ReadSlicesCollective(
+    H5Metadata *metadata_p,
+    int beg_slice, int count,
+    MPI_Comm comm, MPI_Info info,
+    float *slices)
+{
+  auto &metadata = *metadata_p;
+  if(metadata.ndims!=3)
+    throw std::runtime_error("Currently only 3D dataset is supporter");
+  hsize_t *dims = metadata.dims;
+
+  hid_t plist_id = H5Pcreate(H5P_FILE_ACCESS);
+#ifdef TRACE_USE_MPI
+  H5Pset_fapl_mpio(plist_id, comm, info);
+  H5Pset_all_coll_metadata_ops(plist_id, true);
+#else
+  (void)comm; (void)info;
+#endif
+  /* Errors are agreed on by all ranks before throwing, otherwise the other
+   * ranks would wait in the next collective call */
+  auto all_ok = [&](bool ok) {
+#ifdef TRACE_USE_MPI
+    int l_ok = ok, g_ok = 0;
+    MPI_Allreduce(&l_ok, &g_ok, 1, MPI_INT, MPI_MIN, comm);
+    return g_ok!=0;
+#else
+    return ok;
+#endif
+  };
+
+  hid_t file_id = H5Fopen(metadata.file_path.c_str(), H5F_ACC_RDONLY, plist_id);
+  H5Pclose(plist_id);
+  if(!all_ok(file_id>=0)){
+    if(file_id>=0) H5Fclose(file_id);
+    throw std::runtime_error("Unable to open hdf5 file");
+  }
+  hid_t dataset_id = H5Dopen2(file_id, metadata.dataset_path.c_str(),
+      H5P_DEFAULT);
+  if(!all_ok(dataset_id>=0)){
+    if(dataset_id>=0) H5Dclose(dataset_id);
+    H5Fclose(file_id);
+    throw std::runtime_error("Unable to open hdf5 dataset");
+  }
+
+  /* Projections per read: whole chunks of about kReadBlockBytes of the
+   * dataset. Only depends on the dataset, so all ranks issue the same
+   * number of collective reads. */
+  const hsize_t kReadBlockBytes = 256ull<<20;
+  hsize_t chunk_projs = 1;
+  hid_t dcpl = H5Dget_create_plist(dataset_id);
+  if(H5Pget_layout(dcpl)==H5D_CHUNKED){
+    hsize_t chunk_dims[3];
+    if(H5Pget_chunk(dcpl, 3, chunk_dims)==3) chunk_projs = chunk_dims[0];
+  }
+  H5Pclose(dcpl);
+  hsize_t proj_bytes = dims[1]*dims[2]*sizeof(float);
+  hsize_t block_projs = chunk_projs*
+    std::max<hsize_t>(1, kReadBlockBytes/(chunk_projs*proj_bytes));
+
+  hid_t dxpl = H5Pcreate(H5P_DATASET_XFER);
+#ifdef TRACE_USE_MPI
+  H5Pset_dxpl_mpio(dxpl, H5FD_MPIO_COLLECTIVE);
+#endif
+  hsize_t m_dims[3] = { dims[0], static_cast<hsize_t>(count), dims[2] };
+  hid_t memspace = H5Screate_simple(3, m_dims, NULL);
+  hid_t filespace = H5Dget_space(dataset_id);
+  bool ok = true;
+  for(hsize_t p=0; ok && p<dims[0]; p+=block_projs){
+    hsize_t n = std::min(block_projs, dims[0]-p);
+    hsize_t h_offset[3] = { p, static_cast<hsize_t>(beg_slice), 0 };
+    hsize_t m_offset[3] = { p, 0, 0 };
+    hsize_t h_count[3] = { n, static_cast<hsize_t>(count), dims[2] };
+    if(count>0){
+      H5Sselect_hyperslab(filespace, H5S_SELECT_SET, h_offset, NULL,
+          h_count, NULL);
+      H5Sselect_hyperslab(memspace, H5S_SELECT_SET, m_offset, NULL,
+          h_count, NULL);
+    }
+    else{
+      H5Sselect_none(filespace);
+      H5Sselect_none(memspace);
+    }
+    ok = all_ok(H5Dread(dataset_id, H5T_NATIVE_FLOAT, memspace, filespace,
+                        dxpl, slices)>=0);
+  }
+
+  H5Sclose(filespace);
+  H5Sclose(memspace);
+  H5Pclose(dxpl);
+  H5Dclose(dataset_id);
+  H5Fclose(file_id);
+
+  if(!ok)
+    throw std::runtime_error("Unable to read hdf5 dataset");
+}
+
 void trace_io::WriteData(
     float *recon, /* Data values */
     hsize_t ndims, hsize_t *dims, /* This process' dimension values */
@@ -380,7 +525,11 @@ void trace_io::WriteData(
 
   /* Set up file access property list with parallel I/O access */
   hid_t plist_id = H5Pcreate(H5P_FILE_ACCESS);
+#ifdef TRACE_USE_MPI
   H5Pset_fapl_mpio(plist_id, comm, info);
+#else
+  (void)comm; (void)info;   /* Serial build, default file driver */
+#endif
 
 
   /* Create a new file collectively and release property list identifier. */
@@ -441,7 +590,11 @@ void trace_io::WriteData(
 
   /* Create property list for collective dataset write */
   plist_id = H5Pcreate(H5P_DATASET_XFER);
+#ifdef TRACE_USE_MPI
   H5Pset_dxpl_mpio(plist_id, mpio_xfer_flag);
+#else
+  (void)mpio_xfer_flag;
+#endif
 
   H5Dwrite(dset_id, H5T_NATIVE_FLOAT, memspace, filespace,
       plist_id, recon);
@@ -459,6 +612,141 @@ void trace_io::WriteData(
   free(d_offset);
 }
 
+trace_io::H5Series* trace_io::CreateSeries(
+    char const *file_name, char const *dataset_name,
+    hsize_t *dataset_dims,
+    int filter_id, unsigned int filter_level,
+    MPI_Comm comm, MPI_Info info)
+{
+  if(filter_id>0 && !H5Zfilter_avail(filter_id))
+    throw std::runtime_error("Requested HDF5 filter is not available");
+
+  H5Series *series = new H5Series;
+  series->n_steps = 0;
+  for(int i=0; i<3; ++i) series->dims[i] = dataset_dims[i];
+
+  /* Parallel file access; the latest format indexes the chunks of the
+   * unlimited dimension with an extensible array */
+  hid_t plist_id = H5Pcreate(H5P_FILE_ACCESS);
+#ifdef TRACE_USE_MPI
+  MPI_Comm_rank(comm, &series->rank);
+  H5Pset_fapl_mpio(plist_id, comm, info);
+#else
+  (void)comm; (void)info;
+  series->rank = 0;
+#endif
+  H5Pset_libver_bounds(plist_id, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST);
+  series->file_id = H5Fcreate(file_name, H5F_ACC_TRUNC, H5P_DEFAULT, plist_id);
+  H5Pclose(plist_id);
+  if(series->file_id<0){
+    delete series;
+    throw std::runtime_error("Unable to create time-series output file");
+  }
+
+  /* [time, slices, rows, cols], one chunk per slice per time step */
+  hsize_t dims[4] = { 0, dataset_dims[0], dataset_dims[1], dataset_dims[2] };
+  hsize_t max_dims[4] = { H5S_UNLIMITED, dataset_dims[0], dataset_dims[1],
+                          dataset_dims[2] };
+  hsize_t chunk_dims[4] = { 1, 1, dataset_dims[1], dataset_dims[2] };
+  hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+  H5Pset_chunk(dcpl, 4, chunk_dims);
+  H5Pset_fill_time(dcpl, H5D_FILL_TIME_NEVER);  /* Every step is written */
+  if(filter_id==1)
+    H5Pset_deflate(dcpl, filter_level);
+  else if(filter_id>0)
+    H5Pset_filter(dcpl, filter_id, H5Z_FLAG_MANDATORY, 0, NULL);
+  hid_t filespace = H5Screate_simple(4, dims, max_dims);
+  series->dset_id = H5Dcreate(series->file_id, dataset_name, H5T_NATIVE_FLOAT,
+      filespace, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+  H5Sclose(filespace);
+  H5Pclose(dcpl);
+
+  /* Iteration number of each time step */
+  hsize_t steps_dims[1] = { 0 };
+  hsize_t steps_max_dims[1] = { H5S_UNLIMITED };
+  hsize_t steps_chunk_dims[1] = { 1024 };
+  dcpl = H5Pcreate(H5P_DATASET_CREATE);
+  H5Pset_chunk(dcpl, 1, steps_chunk_dims);
+  filespace = H5Screate_simple(1, steps_dims, steps_max_dims);
+  std::string steps_name = std::string(dataset_name) + "_steps";
+  series->steps_id = H5Dcreate(series->file_id, steps_name.c_str(),
+      H5T_NATIVE_INT64, filespace, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+  H5Sclose(filespace);
+  H5Pclose(dcpl);
+
+  if(series->dset_id<0 || series->steps_id<0){
+    CloseSeries(series);
+    throw std::runtime_error("Unable to create time-series dataset");
+  }
+
+  return series;
+}
+
+void trace_io::AppendSeries(
+    H5Series *series,
+    float *recon, hsize_t *dims,
+    int slice_id,
+    int64_t step,
+    H5FD_mpio_xfer_t mpio_xfer_flag)
+{
+  hid_t plist_id = H5Pcreate(H5P_DATASET_XFER);
+#ifdef TRACE_USE_MPI
+  H5Pset_dxpl_mpio(plist_id, mpio_xfer_flag);
+#else
+  (void)mpio_xfer_flag;
+#endif
+
+  hsize_t t = series->n_steps;
+
+  /* Extend both datasets by one time step (collective) */
+  hsize_t new_dims[4] = { t+1, series->dims[0], series->dims[1],
+                          series->dims[2] };
+  H5Dset_extent(series->dset_id, new_dims);
+  hsize_t new_steps_dims[1] = { t+1 };
+  H5Dset_extent(series->steps_id, new_steps_dims);
+
+  /* This process' slices of the new time step */
+  hsize_t m_count[4] = { 1, dims[0], dims[1], dims[2] };
+  hid_t memspace = H5Screate_simple(4, m_count, NULL);
+  hsize_t d_offset[4] = { t, static_cast<hsize_t>(slice_id), 0, 0 };
+  hid_t filespace = H5Dget_space(series->dset_id);
+  H5Sselect_hyperslab(filespace, H5S_SELECT_SET, d_offset, NULL,
+      m_count, NULL);
+  H5Dwrite(series->dset_id, H5T_NATIVE_FLOAT, memspace, filespace,
+      plist_id, recon);
+  H5Sclose(filespace);
+  H5Sclose(memspace);
+
+  /* Iteration number; written by rank 0, others take part with empty
+   * selections */
+  hsize_t s_count[1] = { 1 };
+  hsize_t s_offset[1] = { t };
+  memspace = H5Screate_simple(1, s_count, NULL);
+  filespace = H5Dget_space(series->steps_id);
+  if(series->rank==0)
+    H5Sselect_hyperslab(filespace, H5S_SELECT_SET, s_offset, NULL,
+        s_count, NULL);
+  else{
+    H5Sselect_none(memspace);
+    H5Sselect_none(filespace);
+  }
+  H5Dwrite(series->steps_id, H5T_NATIVE_INT64, memspace, filespace,
+      plist_id, &step);
+  H5Sclose(filespace);
+  H5Sclose(memspace);
+
+  H5Pclose(plist_id);
+  series->n_steps = t+1;
+}
+
+void trace_io::CloseSeries(H5Series *series)
+{
+  if(series->steps_id>=0) H5Dclose(series->steps_id);
+  if(series->dset_id>=0) H5Dclose(series->dset_id);
+  H5Fclose(series->file_id);
+  delete series;
+}
+
 void trace_io::WriteRecon(
     TraceMetadata &rank_metadata,
     H5Metadata &dataset_metadata,
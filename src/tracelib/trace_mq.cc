@@ -1,26 +1,39 @@
 #include "trace_mq.h"
+#include "trace_span.h"
 #include <sstream>
 #include <cstring>
 #include <cassert>
 
 TraceMQ::TraceMQ(
   std::string dest_ip, int dest_port, int comm_rank, int comm_size, std::string pub_info) : 
+    TraceMQ(dest_ip, dest_port, comm_rank, comm_size, pub_info, 1)
+{ }
+
+TraceMQ::TraceMQ(
+  std::string dest_ip, int dest_port, int comm_rank, int comm_size, 
+  std::string pub_info, int group_size) : 
     dest_ip_ {dest_ip}, 
     dest_port_ {dest_port}, 
     comm_rank_ {comm_rank}, 
     comm_size_ {comm_size},
+    group_size_ {group_size},
     pub_info_ {pub_info}, /// Publisher information
     fbuilder_ {1024},
     state_ {TMQ_State::DATA},  /// Initial state is expecting DATA
-    seq_ {0}
+    seq_ {0},
+    throughput_ {0.}
 {
-  std::string addr("tcp://" + dest_ip_ + ":" + 
-    std::to_string(static_cast<long long>(dest_port_+comm_rank_)));
-  std::cout << "[" << comm_rank_ << "] Destination address: " << addr << std::endl;
-
+  int rc;
   context = zmq_ctx_new();
-  server = zmq_socket(context, ZMQ_REQ);
-  int rc = zmq_connect(server, addr.c_str()); assert(rc==0); 
+  server = nullptr;
+  if(!dest_ip_.empty()){
+    std::string addr("tcp://" + dest_ip_ + ":" + 
+      std::to_string(static_cast<long long>(dest_port_+comm_rank_)));
+    std::cout << "[" << comm_rank_ << "] Destination address: " << addr << std::endl;
+
+    server = zmq_socket(context, ZMQ_REQ);
+    rc = zmq_connect(server, addr.c_str()); assert(rc==0); 
+  }
 
   server_pub = zmq_socket(context, ZMQ_PUB);
   rc = zmq_bind(server_pub, pub_info_.c_str()); //assert(rc==0);
@@ -40,6 +53,7 @@ void TraceMQ::Initialize() {
   msg = recv_msg(server); assert(seq_==msg->seq_n);
   std::cout << "Received data info" << std::endl;
   metadata(*(read_data_info_rep(msg)));
+  print_data_info_rep_msg(&metadata_);
   // release allocations
   free_msg(msg);
   ++seq_;
@@ -104,9 +118,12 @@ tomo_msg_t* TraceMQ::ReceiveMsg() {
   /// If previously fin message was recevied, return nullptr
   if(state()==TMQ_State::FIN) return nullptr;
 
+  TRACE_SPAN("receive");
   tomo_msg_t *dmsg = recv_msg(server);
   assert(seq_==dmsg->seq_n); ++seq_;
-  if(dmsg->type == TRACEMQ_MSG_DATA_REP) { /// Message has data
+  if(dmsg->type == TRACEMQ_MSG_DATA_REP ||
+     dmsg->type == TRACEMQ_MSG_CDATA_REP ||
+     dmsg->type == TRACEMQ_MSG_REASSIGN_REP) { /// Message has data
     /// Tell data acquisition machine that you received the projection data
     tomo_msg_t *msg = prepare_data_req_msg(seq_);
     send_msg(server, msg);
@@ -115,7 +132,8 @@ tomo_msg_t* TraceMQ::ReceiveMsg() {
 
     state(TMQ_State::DATA);
     size_t count=10;
-    print_data(read_data(dmsg), count);
+    if(dmsg->type == TRACEMQ_MSG_DATA_REP)
+      print_data(read_data(dmsg), count);
 
     return dmsg;
   } 
@@ -139,7 +157,7 @@ tomo_msg_t* TraceMQ::ReceiveMsg() {
 }
 
 TraceMQ::~TraceMQ() {
-  zmq_close(server);
+  if(server != nullptr) zmq_close(server);
   zmq_ctx_destroy(context);
 }
 
@@ -154,10 +172,13 @@ void TraceMQ::setup_msg_header(
 
 tomo_msg_t* TraceMQ::prepare_data_req_msg(uint64_t seq_n)
 {
-  size_t tot_msg_size = sizeof(tomo_msg_t);
+  size_t tot_msg_size = sizeof(tomo_msg_t)+sizeof(tomo_msg_data_req_t);
   tomo_msg_t *msg = (tomo_msg_t *) malloc(tot_msg_size);
   setup_msg_header(msg, seq_n, TRACEMQ_MSG_DATA_REQ, tot_msg_size);
 
+  tomo_msg_data_req_t *req = (tomo_msg_data_req_t *) msg->data;
+  req->throughput = throughput_.load();
+
   return msg;
 }
 
@@ -176,6 +197,7 @@ tomo_msg_t* TraceMQ::prepare_data_rep_msg(uint64_t seq_n,
   msg->projection_id = projection_id;
   msg->theta = theta;
   msg->center = center;
+  msg->owner = 0;
   memcpy(msg->data, data, data_size);
 
   return msg_h;
@@ -185,6 +207,18 @@ tomo_msg_data_t* TraceMQ::read_data(tomo_msg_t *msg){
   return (tomo_msg_data_t *) msg->data;
 }
 
+tomo_msg_cdata_t* TraceMQ::read_cdata(tomo_msg_t *msg){
+  size_t header = sizeof(tomo_msg_t)+sizeof(tomo_msg_cdata_t);
+  if(msg->size<header) return nullptr;
+  tomo_msg_cdata_t *cmsg = (tomo_msg_cdata_t *) msg->data;
+  if(cmsg->comp_size>msg->size-header) return nullptr;
+  return cmsg;
+}
+
+tomo_msg_reassign_t* TraceMQ::read_reassign(tomo_msg_t *msg){
+  return (tomo_msg_reassign_t *) msg->data;
+}
+
 void TraceMQ::print_data(tomo_msg_data_t *msg, size_t data_count){
   printf("projection_id=%u; theta=%f; center=%f\n", 
     msg->projection_id, msg->theta, msg->center);
@@ -198,7 +232,8 @@ void TraceMQ::print_data(tomo_msg_data_t *msg, size_t data_count){
 tomo_msg_t* TraceMQ::prepare_data_info_rep_msg(uint64_t seq_n, 
                                               int beg_sinogram, int n_sinograms,
                                               int n_rays_per_proj_row,
-                                              uint64_t tn_sinograms)
+                                              uint64_t tn_sinograms,
+                                              uint32_t codec)
 {
   uint64_t tot_msg_size = sizeof(tomo_msg_t)+sizeof(tomo_msg_data_info_rep_t);
   tomo_msg_t *msg = (tomo_msg_t *) malloc(tot_msg_size);
@@ -209,6 +244,7 @@ tomo_msg_t* TraceMQ::prepare_data_info_rep_msg(uint64_t seq_n,
   info->beg_sinogram = beg_sinogram;
   info->n_sinograms = n_sinograms;
   info->n_rays_per_proj_row = n_rays_per_proj_row;
+  info->codec = codec;
 
   return msg;
 }
@@ -217,9 +253,9 @@ tomo_msg_data_info_rep_t* TraceMQ::read_data_info_rep(tomo_msg_t *msg){
 }
 void TraceMQ::print_data_info_rep_msg(tomo_msg_data_info_rep_t *msg){
   printf("Total # sinograms=%u; Beginning sinogram id=%u;"
-          "# assigned sinograms=%u; # rays per projection row=%u\n", 
+          "# assigned sinograms=%u; # rays per projection row=%u; codec=%s\n", 
           msg->tn_sinograms, msg->beg_sinogram, msg->n_sinograms, 
-          msg->n_rays_per_proj_row);
+          msg->n_rays_per_proj_row, trace_codec_name(msg->codec));
 }
 
 tomo_msg_t* TraceMQ::prepare_data_info_req_msg(uint64_t seq_n, 
@@ -234,6 +270,8 @@ tomo_msg_t* TraceMQ::prepare_data_info_req_msg(uint64_t seq_n,
   tomo_msg_data_info_req_t *info = (tomo_msg_data_info_req_t *) msg->data;
   info->comm_rank = comm_rank;
   info->comm_size = comm_size;
+  info->codecs = trace_codec_supported();
+  info->group_size = group_size_;
 
   return msg;
 }
@@ -267,9 +305,13 @@ tomo_msg_t* TraceMQ::recv_msg(void *server){
   //printf("zmq_msg_size(&zmsg)=%zu; ((tomo_msg_t*)&zmsg)->size=%zu", zmq_msg_size(&zmsg), ((tomo_msg_t*)&zmsg)->size);
   //assert(zmq_msg_size(&zmsg)==((tomo_msg_t*)&zmsg)->size);
 
-  tomo_msg_t *msg = (tomo_msg_t *) malloc(((tomo_msg_t*)zmq_msg_data(&zmsg))->size);
+  /// Sized by the received bytes, so msg->size bounds the payload
+  size_t size = zmq_msg_size(&zmsg);
+  assert(size>=sizeof(tomo_msg_t));
+  tomo_msg_t *msg = (tomo_msg_t *) malloc(size);
   /// Zero-copy would have been better
-  memcpy(msg, zmq_msg_data(&zmsg), zmq_msg_size(&zmsg));
+  memcpy(msg, zmq_msg_data(&zmsg), size);
+  msg->size = size;
   zmq_msg_close(&zmsg);
 
   return msg;
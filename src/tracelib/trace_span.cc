@@ -0,0 +1,259 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <map>
+#include <stdexcept>
+#include "trace_span.h"
+
+std::atomic<int> trace_span::detail::level{trace_span::kOff};
+std::atomic<int64_t> trace_span::detail::window{0};
+
+namespace {
+  const char kMagic[8] = {'T', 'R', 'C', 'S', 'P', 'A', 'N', '\0'};
+  const uint32_t kVersion = 1;
+  const size_t kBlockSpans = 4096;    /// Buffers grow by blocks of spans
+
+  struct Span {
+    uint64_t beg;
+    uint64_t end;
+    int64_t window;
+    char const *name;
+  };
+
+  /**
+   * Written only by the thread holding it. Spans and their blocks are
+   * published by the release store of count, so a buffer can be read while
+   * its thread is still recording. The block table is sized up front and
+   * never reallocated.
+   */
+  struct ThreadBuffer {
+    uint32_t id;
+    std::string name = "thread";
+    size_t capacity;
+    std::vector<std::unique_ptr<Span[]>> blocks;
+    std::atomic<size_t> count{0};
+    std::atomic<uint64_t> dropped{0};
+    bool busy = false;
+
+    explicit ThreadBuffer(size_t capacity)
+      : capacity{capacity}
+      , blocks((capacity+kBlockSpans-1)/kBlockSpans)
+    {}
+
+    Span& at(size_t i) { return blocks[i/kBlockSpans][i%kBlockSpans]; }
+  };
+
+  struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    size_t capacity = 0;
+    uint64_t base_ticks = 0;
+    std::chrono::steady_clock::time_point base_time;
+
+    /// A free buffer of an earlier thread with the same name, so that
+    /// e.g. the reduction threads of every iteration share trace ids
+    ThreadBuffer* Acquire(char const *name){
+      std::lock_guard<std::mutex> lock(mutex);
+      for(auto &buffer : buffers)
+        if(!buffer->busy && buffer->name==name){
+          buffer->busy = true;
+          return buffer.get();
+        }
+      buffers.emplace_back(new ThreadBuffer(capacity));
+      buffers.back()->id = static_cast<uint32_t>(buffers.size()-1);
+      buffers.back()->name = name;
+      buffers.back()->busy = true;
+      return buffers.back().get();
+    }
+
+    void Release(ThreadBuffer *buffer){
+      std::lock_guard<std::mutex> lock(mutex);
+      buffer->busy = false;
+    }
+  };
+
+  Registry& registry(){
+    static Registry *r = new Registry;  /// Outlives the thread_local handles
+    return *r;
+  }
+
+  /// Returns the buffer of a thread to the registry when the thread exits
+  struct BufferHandle {
+    ThreadBuffer *buffer = nullptr;
+    ~BufferHandle(){ if(buffer!=nullptr) registry().Release(buffer); }
+
+    ThreadBuffer& get(char const *name="thread"){
+      if(buffer==nullptr) buffer = registry().Acquire(name);
+      return *buffer;
+    }
+  };
+
+  thread_local BufferHandle handle;
+
+  double TicksPerMicrosecond(Registry &r){
+    uint64_t ticks = trace_span::Now();
+    double us = std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now()-r.base_time).count();
+    if(us<=0. || ticks<=r.base_ticks) return 1.;
+    return static_cast<double>(ticks-r.base_ticks)/us;
+  }
+
+  void CheckStream(std::ostream &out, std::string const &path){
+    if(!out) throw std::runtime_error("Unable to write trace " + path);
+  }
+}
+
+void trace_span::Enable(int level, size_t capacity)
+{
+  Registry &r = registry();
+  {
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.capacity = capacity;
+    if(r.base_ticks==0){    /// Time origin of all spans, also if re-enabled
+      r.base_time = std::chrono::steady_clock::now();
+      r.base_ticks = Now();
+    }
+  }
+  detail::level.store(level, std::memory_order_relaxed);
+}
+
+void trace_span::ThreadName(char const *name)
+{
+  if(!Enabled(kPhases)) return;
+  ThreadBuffer &b = handle.get(name);
+  if(b.name!=name){       /// Recorded spans before it was named
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    b.name = name;
+  }
+}
+
+void trace_span::Record(char const *name, uint64_t beg, uint64_t end)
+{
+  ThreadBuffer &b = handle.get();
+  size_t n = b.count.load(std::memory_order_relaxed);
+  if(n>=b.capacity){
+    b.dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  if(b.blocks[n/kBlockSpans]==nullptr)
+    b.blocks[n/kBlockSpans].reset(new Span[kBlockSpans]);
+  Span &s = b.at(n);
+  s.beg = beg;
+  s.end = end;
+  s.window = detail::window.load(std::memory_order_relaxed);
+  s.name = name;
+  b.count.store(n+1, std::memory_order_release);
+}
+
+double trace_span::TotalSeconds(char const *name)
+{
+  Registry &r = registry();
+  double ticks_per_us = TicksPerMicrosecond(r);
+  std::lock_guard<std::mutex> lock(r.mutex);
+  double total = 0.;
+  for(auto &b : r.buffers){
+    size_t n = b->count.load(std::memory_order_acquire);
+    for(size_t i=0; i<n; ++i){
+      Span &s = b->at(i);
+      if(std::strcmp(s.name, name)==0) total += s.end-s.beg;
+    }
+  }
+  return total/ticks_per_us*1e-6;
+}
+
+void trace_span::WriteChromeTrace(std::string const &path, int pid)
+{
+  Registry &r = registry();
+  double ticks_per_us = TicksPerMicrosecond(r);
+  std::lock_guard<std::mutex> lock(r.mutex);
+
+  std::ofstream out(path);
+  CheckStream(out, path);
+  out << "{\"traceEvents\":[\n";
+  bool first = true;
+  for(auto &b : r.buffers){
+    out << ((first) ? "" : ",\n")
+        << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+        << ",\"tid\":" << b->id << ",\"args\":{\"name\":\"" << b->name
+        << "\"}}";
+    first = false;
+    size_t n = b->count.load(std::memory_order_acquire);
+    for(size_t i=0; i<n; ++i){
+      Span &s = b->at(i);
+      double ts = (static_cast<double>(s.beg)-r.base_ticks)/ticks_per_us;
+      double dur = static_cast<double>(s.end-s.beg)/ticks_per_us;
+      out << ",\n{\"name\":\"" << s.name << "\",\"ph\":\"X\",\"pid\":" << pid
+          << ",\"tid\":" << b->id << ",\"ts\":" << ts << ",\"dur\":" << dur
+          << ",\"args\":{\"window\":" << s.window << "}}";
+    }
+    uint64_t dropped = b->dropped.load(std::memory_order_relaxed);
+    if(dropped>0)
+      std::cerr << "Trace thread " << b->id << " dropped " << dropped
+                << " spans" << std::endl;
+  }
+  out << "\n]}\n";
+  CheckStream(out, path);
+}
+
+void trace_span::WriteBinaryLog(std::string const &path, int pid)
+{
+  Registry &r = registry();
+  double ticks_per_us = TicksPerMicrosecond(r);
+  std::lock_guard<std::mutex> lock(r.mutex);
+
+  /// Names are interned by content, the same literal may have several
+  /// addresses
+  std::map<std::string, uint32_t> names;
+  std::map<char const*, uint32_t> name_ids;
+  SpanLogHeader h;
+  std::memset(&h, 0, sizeof(h));
+  std::vector<size_t> counts;
+  for(auto &b : r.buffers){
+    counts.push_back(b->count.load(std::memory_order_acquire));
+    for(size_t i=0; i<counts.back(); ++i){
+      char const *name = b->at(i).name;
+      if(name_ids.count(name)) continue;
+      auto it = names.insert(
+          std::make_pair(std::string(name),
+                         static_cast<uint32_t>(names.size()))).first;
+      name_ids[name] = it->second;
+    }
+    h.n_spans += counts.back();
+    h.dropped += b->dropped.load(std::memory_order_relaxed);
+  }
+  std::memcpy(h.magic, kMagic, sizeof(kMagic));
+  h.version = kVersion;
+  h.pid = pid;
+  h.ticks_per_us = ticks_per_us;
+  h.base = r.base_ticks;
+  h.n_names = static_cast<uint32_t>(names.size());
+  h.n_threads = static_cast<uint32_t>(r.buffers.size());
+
+  std::ofstream out(path, std::ios::binary);
+  CheckStream(out, path);
+  auto write_entry = [&out](uint32_t id, std::string const &s){
+    uint32_t len = static_cast<uint32_t>(s.size());
+    out.write(reinterpret_cast<char const*>(&id), sizeof(id));
+    out.write(reinterpret_cast<char const*>(&len), sizeof(len));
+    out.write(s.data(), len);
+  };
+  out.write(reinterpret_cast<char const*>(&h), sizeof(h));
+  for(auto &n : names) write_entry(n.second, n.first);
+  for(auto &b : r.buffers) write_entry(b->id, b->name);
+  for(size_t t=0; t<r.buffers.size(); ++t)
+    for(size_t i=0; i<counts[t]; ++i){
+      auto &b = r.buffers[t];
+      Span &s = b->at(i);
+      SpanLogRecord rec;
+      rec.beg = s.beg;
+      rec.end = s.end;
+      rec.window = s.window;
+      rec.name = name_ids[s.name];
+      rec.thread = b->id;
+      out.write(reinterpret_cast<char const*>(&rec), sizeof(rec));
+    }
+  CheckStream(out, path);
+}
@@ -1,17 +1,57 @@
 #include "trace_stream.h"
+#include "trace_span.h"
+#ifdef TRACE_USE_MPI
+#include "trace_comm.h"
+#endif
+#include <stdexcept>
+#include <cstdlib>
+#include <algorithm>
 
 TraceStream::TraceStream(
     std::string dest_ip, int dest_port,
     uint32_t window_len, 
     int comm_rank, int comm_size, 
-    std::string pub_info) :
+    std::string pub_info,
+    uint32_t recv_queue_len,
+    int group_size) :
   window_len_ {window_len},
   counter_ {0},
-  traceMQ_ {dest_ip, dest_port, comm_rank, comm_size, pub_info}
+  traceMQ_ {dest_ip, dest_port, comm_rank, comm_size, pub_info, group_size},
+  group_size_ {group_size},
+  group_member_ {comm_rank%group_size},
+  recv_done_ {false},
+  recv_stop_ {false}
 {
+  if(group_size<1 || comm_size%group_size!=0)
+    throw std::invalid_argument("Number of ranks is not a multiple of group size");
+
   traceMQ().Initialize();
+
+  /// Handshake is done, socket is handed over to the receiver thread
+  if(recv_queue_len>0){
+    recv_queue_ = new SPSCQueue<tomo_msg_t*>(recv_queue_len);
+    receiver_ = std::thread(&TraceStream::ReceiverLoop, this);
+  }
 }
 
+TraceStream::TraceStream(
+    std::string dest_ip, int dest_port,
+    uint32_t window_len, 
+    int comm_rank, int comm_size, 
+    std::string pub_info,
+    uint32_t recv_queue_len) :
+  TraceStream(dest_ip, dest_port, window_len, comm_rank, comm_size, pub_info,
+      recv_queue_len, 1)
+{ }
+
+TraceStream::TraceStream(
+    std::string dest_ip, int dest_port,
+    uint32_t window_len, 
+    int comm_rank, int comm_size, 
+    std::string pub_info) :
+  TraceStream(dest_ip, dest_port, window_len, comm_rank, comm_size, pub_info, 0)
+{ }
+
 TraceStream::TraceStream(
     std::string dest_ip, int dest_port,
     uint32_t window_len, 
@@ -19,32 +59,201 @@ TraceStream::TraceStream(
   TraceStream(dest_ip, dest_port, window_len, comm_rank, comm_size, "")
 { }
 
+TraceStream::TraceStream(
+    tomo_msg_metadata_t md,
+    std::vector<float> projs,
+    std::vector<float> theta,
+    float center,
+    uint32_t window_len,
+    int comm_rank, int comm_size,
+    std::string pub_info,
+    int group_size) :
+  window_len_ {window_len},
+  counter_ {0},
+  /// No distributor; only the publisher is set up
+  traceMQ_ {"", 0, comm_rank, comm_size, pub_info, group_size},
+  group_size_ {group_size},
+  group_member_ {comm_rank%group_size},
+  recv_done_ {false},
+  recv_stop_ {false},
+  file_mode_ {true},
+  file_projs_ {std::move(projs)},
+  file_theta_ {std::move(theta)},
+  file_center_ {center}
+{
+  if(group_size<1 || comm_size%group_size!=0)
+    throw std::invalid_argument("Number of ranks is not a multiple of group size");
+  if(file_projs_.size()!=
+     file_theta_.size()*md.n_sinograms*md.n_rays_per_proj_row)
+    throw std::invalid_argument("Projections do not match the angles");
+  traceMQ().metadata(md);
+}
+
+TraceStream::~TraceStream(){
+  if(pending_reassign_ != nullptr) traceMQ().free_msg(pending_reassign_);
+  if(receiver_.joinable()){
+    {
+      /// A receiver waiting on a full queue gives up
+      std::lock_guard<std::mutex> lock(recv_mutex_);
+      recv_stop_.store(true);
+    }
+    recv_cv_.notify_all();
+    receiver_.join();
+  }
+  if(recv_queue_ != nullptr){
+    tomo_msg_t *msg;
+    while(recv_queue_->Pop(msg)) traceMQ().free_msg(msg);
+    delete recv_queue_;
+  }
+  trace_codec_ctx_free(codec_ctx_);
+}
+
+void TraceStream::ReceiverLoop(){
+  trace_span::ThreadName("receiver");
+  trace_codec_ctx_t *ctx = trace_codec_ctx_create();
+  for(;;){
+    tomo_msg_t *msg = traceMQ().ReceiveMsg();
+    if(msg == nullptr) break;   /// Fin message
+    {
+      TRACE_SPAN("decode");
+      msg = DecodeMsg(msg, ctx);
+    }
+    /// Back-pressure: wait for the reconstruction to consume the window
+    bool pushed = recv_queue_->Push(msg);
+    if(!pushed){
+      std::unique_lock<std::mutex> lock(recv_mutex_);
+      recv_cv_.wait(lock, [&]{
+          return recv_stop_.load() || (pushed = recv_queue_->Push(msg)); });
+    }
+    if(!pushed){
+      traceMQ().free_msg(msg);
+      break;
+    }
+    {
+      /// Orders the push before a consumer that is about to wait
+      std::lock_guard<std::mutex> lock(recv_mutex_);
+    }
+    recv_cv_.notify_all();
+  }
+  trace_codec_ctx_free(ctx);
+  {
+    std::lock_guard<std::mutex> lock(recv_mutex_);
+    recv_done_.store(true, std::memory_order_release);
+  }
+  recv_cv_.notify_all();
+}
+
+tomo_msg_t* TraceStream::DecodeMsg(tomo_msg_t *msg, trace_codec_ctx_t *ctx){
+  if(msg->type != TRACEMQ_MSG_CDATA_REP) return msg;
+  tomo_msg_cdata_t *cmsg_p = traceMQ().read_cdata(msg);
+  if(cmsg_p == nullptr) return msg;   /// Reported by AddTomoMsg
+  tomo_msg_cdata_t &cmsg = *cmsg_p;
+  tomo_msg_data_t meta;
+  meta.owner = cmsg.owner;
+  if(!Owns(meta)) return msg;   /// Only the metadata is kept
+  if(cmsg.raw_size != static_cast<uint64_t>(metadata().n_sinograms)*
+                      metadata().n_rays_per_proj_row*sizeof(float))
+    return msg;   /// Reported by AddTomoMsg
+
+  /* The projection is copied once more into the window by AddTomoMsg; the
+   * decompression is what is taken off the reconstruction thread */
+  size_t size = sizeof(tomo_msg_t)+sizeof(tomo_msg_data_t)+cmsg.raw_size;
+  tomo_msg_t *dmsg_h = static_cast<tomo_msg_t*>(malloc(size));
+  if(dmsg_h == nullptr) return msg;
+  tomo_msg_data_t *dmsg = traceMQ().read_data(dmsg_h);
+  if(trace_codec_decompress_ctx(ctx, cmsg.codec, cmsg.data, cmsg.comp_size,
+                                dmsg->data, cmsg.raw_size) != 0){
+    free(dmsg_h);
+    return msg;   /// Reported by AddTomoMsg
+  }
+  dmsg_h->seq_n = msg->seq_n;
+  dmsg_h->type = TRACEMQ_MSG_DATA_REP;
+  dmsg_h->size = size;
+  dmsg->projection_id = cmsg.projection_id;
+  dmsg->theta = cmsg.theta;
+  dmsg->center = cmsg.center;
+  dmsg->owner = cmsg.owner;
+  traceMQ().free_msg(msg);
+  return dmsg_h;
+}
+
+tomo_msg_t* TraceStream::NextMsg(){
+  if(recv_queue_ == nullptr) return traceMQ().ReceiveMsg();
+
+  tomo_msg_t *msg = nullptr;
+  bool popped = recv_queue_->Pop(msg);
+  if(!popped){
+    TRACE_SPAN("wait receiver");
+    std::unique_lock<std::mutex> lock(recv_mutex_);
+    /// Receiver may have pushed its last message right before finishing
+    recv_cv_.wait(lock, [&]{
+        return (popped = recv_queue_->Pop(msg)) ||
+               recv_done_.load(std::memory_order_acquire); });
+    if(!popped) popped = recv_queue_->Pop(msg);
+  }
+  if(!popped) return nullptr;
+  {
+    /// Orders the pop before a receiver that is about to wait
+    std::lock_guard<std::mutex> lock(recv_mutex_);
+  }
+  recv_cv_.notify_all();   /// Space for the receiver
+  return msg;
+}
+
 
 DataRegionBase<float, TraceMetadata>* TraceStream::ReadSlidingWindow(
   DataRegionBareBase<float> &recon_image, 
   int step) 
 {
+  if(pending_reassign_ != nullptr)
+    throw std::logic_error("Pending sinogram reassignment, call Reassign()");
+
   // Dynamically meet sizes
   while(vtheta.size()>window_len_)
     EraseBegTraceMsg();
 
-  // Receive new message
+  // Receive new message; in file mode projections [file_beg, file_next_)
   std::vector<tomo_msg_t*> received_msgs; 
-  for(int i=0; i<step; ++i) {
-    tomo_msg_t *msg = traceMQ().ReceiveMsg();
+  size_t file_beg = file_next_;
+  if(file_mode_ && step>0)
+    file_next_ = std::min(file_theta_.size(), file_next_+step);
+  for(int i=0; !file_mode_ && i<step; ++i) {
+    tomo_msg_t *msg = NextMsg();
     if(msg == nullptr) break;
+    if(msg->type == TRACEMQ_MSG_REASSIGN_REP){
+      pending_reassign_ = msg;
+      break;
+    }
     received_msgs.push_back(msg);
   }
 
   // TODO: After receiving message corrections might need to be applied
+  size_t n_received = (file_mode_) ? file_next_-file_beg : received_msgs.size();
+  auto add_received = [&]() {
+    for(size_t p=file_beg; p<file_next_; ++p){
+      AddFileProj(p);
+      ++counter_;
+    }
+    for(auto msg : received_msgs){
+      //traceMQ().print_data(dmsg, metadata().n_sinograms*metadata().n_rays_per_proj_row);
+      AddTomoMsg(*msg);   
+      traceMQ().free_msg(msg);
+      ++counter_;
+    }
+  };
 
+  /// Reassignment arrived before new projections, window is unchanged
+  if(n_received==0 && pending_reassign_!=nullptr){
+    if(vtheta.size()==0)
+      throw std::runtime_error("Sinogram reassignment with an empty window");
+  }
   /// End of the processing
-  if(received_msgs.size()==0 && vtheta.size()==0){
+  else if(n_received==0 && vtheta.size()==0){
     //std::cout << "End of the processing: " << vtheta.size() << std::endl;
     return nullptr; 
   }
   /// End of messages, but there is data to be processed in window
-  else if(received_msgs.size()==0 && vtheta.size()>0){ 
+  else if(n_received==0 && vtheta.size()>0){ 
     for(int i=0; i<step; ++i){  // Delete step size element
       if(vtheta.size()>0) EraseBegTraceMsg();
       else break;
@@ -53,31 +262,19 @@ DataRegionBase<float, TraceMetadata>* TraceStream::ReadSlidingWindow(
     if(vtheta.size()==0) return nullptr;
   }
   /// New message(s) arrived, there is space in window
-  else if(received_msgs.size()>0 && vtheta.size()<window_len_){
+  else if(n_received>0 && vtheta.size()<window_len_){
     //std::cout << "New message(s) arrived, there is space in window: " << window_len_ - vtheta.size() << std::endl;
-    for(auto msg : received_msgs){
-      tomo_msg_data_t *dmsg = traceMQ().read_data(msg);
-      //traceMQ().print_data(dmsg, metadata().n_sinograms*metadata().n_rays_per_proj_row);
-      AddTomoMsg(*dmsg);   
-      traceMQ().free_msg(msg);
-      ++counter_;
-    }
+    add_received();
     //std::cout << "After adding # items in window: " << vtheta.size() << std::endl;
   }
   /// New message arrived, there is no space in window
-  else if(received_msgs.size()>0 && vtheta.size()>=window_len_){
+  else if(n_received>0 && vtheta.size()>=window_len_){
     //std::cout << "New message arrived, there is no space in window: " << vtheta.size() << std::endl;
     for(int i=0; i<step; ++i) {
       if(vtheta.size()>0) EraseBegTraceMsg();
       else break;
     }
-    for(auto msg : received_msgs){
-      tomo_msg_data_t *dmsg = traceMQ().read_data(msg);
-      //traceMQ().print_data(dmsg, metadata().n_sinograms*metadata().n_rays_per_proj_row);
-      AddTomoMsg(*dmsg);   
-      traceMQ().free_msg(msg);
-      ++counter_;
-    }
+    add_received();
     //std::cout << "After remove/add, new window size: " << vtheta.size() << std::endl;
   }
   else std::cerr << "Unknown state in ReadWindow!" << std::endl;
@@ -86,13 +283,44 @@ DataRegionBase<float, TraceMetadata>* TraceStream::ReadSlidingWindow(
   received_msgs.clear();
 
   /// Generate new data and metadata
+  TRACE_SPAN("window setup");
   DataRegionBase<float, TraceMetadata>* data_region = 
     SetupTraceDataRegion(recon_image);
 
   return data_region; 
 }
 
-void TraceStream::AddTomoMsg(tomo_msg_data_t &dmsg){
+void TraceStream::AddTomoMsg(tomo_msg_t &msg){
+  if(msg.type == TRACEMQ_MSG_CDATA_REP){
+    tomo_msg_cdata_t *cmsg_p = traceMQ().read_cdata(&msg);
+    if(cmsg_p == nullptr)
+      throw std::runtime_error("Truncated compressed projection");
+    tomo_msg_cdata_t &cmsg = *cmsg_p;
+    tomo_msg_data_t rdmsg;
+    rdmsg.projection_id = cmsg.projection_id;
+    rdmsg.theta = cmsg.theta;
+    rdmsg.center = cmsg.center;
+    rdmsg.owner = cmsg.owner;
+    size_t n_rays_per_proj = 
+      metadata().n_sinograms*metadata().n_rays_per_proj_row;
+    if(cmsg.raw_size != n_rays_per_proj*sizeof(float))
+      throw std::runtime_error("Unexpected size of compressed projection");
+    vmeta.push_back(rdmsg);
+    vtheta.push_back(rdmsg.theta);
+    if(!Owns(rdmsg)) return;    /// Reconstructed by another group member
+
+    /// Decompress straight into the new window slot
+    if(codec_ctx_ == nullptr) codec_ctx_ = trace_codec_ctx_create();
+    size_t offset = vproj.size();
+    vproj.resize(offset + n_rays_per_proj);
+    if(trace_codec_decompress_ctx(codec_ctx_, cmsg.codec, cmsg.data,
+                                  cmsg.comp_size, &vproj[offset],
+                                  cmsg.raw_size) != 0)
+      throw std::runtime_error("Unable to decompress projection");
+    return;
+  }
+
+  tomo_msg_data_t &dmsg = *traceMQ().read_data(&msg);
   // Convert to radian
   //dmsg.theta = dmsg.theta*3.14159265358979f/180.0;
   //std::cout << "Theta=" << dmsg.theta << std::endl;
@@ -105,32 +333,57 @@ void TraceStream::AddTomoMsg(tomo_msg_data_t &dmsg){
   */
   vmeta.push_back(rdmsg); /// Setup metadata
   vtheta.push_back(rdmsg.theta);
+  if(!Owns(rdmsg)) return;
   vproj.insert(vproj.end(), 
       dmsg.data,
       dmsg.data + metadata().n_sinograms*metadata().n_rays_per_proj_row);
 }
 
+void TraceStream::AddFileProj(size_t proj){
+  tomo_msg_data_t rdmsg;
+  rdmsg.projection_id = static_cast<int>(proj);
+  rdmsg.theta = file_theta_[proj];
+  rdmsg.center = file_center_;
+  rdmsg.owner = static_cast<int>(proj%group_size_);
+  vmeta.push_back(rdmsg);
+  vtheta.push_back(rdmsg.theta);
+  if(!Owns(rdmsg)) return;
+  size_t n_rays_per_proj =
+    metadata().n_sinograms*metadata().n_rays_per_proj_row;
+  vproj.insert(vproj.end(),
+      file_projs_.begin()+proj*n_rays_per_proj,
+      file_projs_.begin()+(proj+1)*n_rays_per_proj);
+}
+
 void TraceStream::EraseBegTraceMsg(){
   vtheta.erase(vtheta.begin());
   size_t n_rays_per_proj = metadata().n_sinograms * metadata().n_rays_per_proj_row;
-  vproj.erase(vproj.begin(),vproj.begin()+n_rays_per_proj); 
+  if(Owns(vmeta.front()))
+    vproj.erase(vproj.begin(),vproj.begin()+n_rays_per_proj); 
   vmeta.erase(vmeta.begin());
 }
 
 DataRegionBase<float, TraceMetadata>* TraceStream::SetupTraceDataRegion(
   DataRegionBareBase<float> &recon_image)
 {
+  /// Angles of the projections in vproj; a group member may own none of the
+  /// window, its (empty) region still takes part in the group combination
+  vtheta_owned_.clear();
+  for(size_t i=0; i<vmeta.size(); ++i)
+    if(Owns(vmeta[i])) vtheta_owned_.push_back(vtheta[i]);
+
   TraceMetadata *mdata = new TraceMetadata(
-    vtheta.data(),
+    (vtheta_owned_.empty()) ? vtheta.data() : vtheta_owned_.data(),
     0,                                // metadata().proj_id(),
     metadata().beg_sinogram,          // metadata().slice_id(),
     0,                                // metadata().col_id(),
     metadata().tn_sinograms,            // metadata().num_total_slices(),
-    vtheta.size(),                    // int const num_projs,
+    vtheta_owned_.size(),             // int const num_projs,
     metadata().n_sinograms,            // metadata().num_slices(),
     metadata().n_rays_per_proj_row,    // metadata().num_cols(),
     metadata().n_rays_per_proj_row, // * metadata().n_rays_per_proj_row, // metadata().num_grids(),
-    vmeta.back().center);             // use the last incoming center for recon.);
+    vmeta.back().center,              // use the last incoming center for recon.);
+    num_neighbor_slices_);
 
   mdata->recon(recon_image);
 
@@ -153,10 +406,131 @@ void TraceStream::WindowLength(int wlen){
   window_len_ = wlen;
 }
 
+void TraceStream::Reassign(MPI_Comm comm,
+                           std::vector<uint32_t> &old_ranges,
+                           std::vector<uint32_t> &new_ranges)
+{
+  if(pending_reassign_ == nullptr)
+    throw std::logic_error("No pending sinogram reassignment");
+
+  int rank = 0, size = 1;
+#ifdef TRACE_USE_MPI
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+#else
+  (void)comm;
+#endif
+  tomo_msg_reassign_t &rmsg = *traceMQ().read_reassign(pending_reassign_);
+  if(rmsg.n_ranks != static_cast<uint32_t>(size))
+    throw std::runtime_error("Reassignment does not match the number of ranks");
+  old_ranges.assign(rmsg.ranges, rmsg.ranges+2*size);
+  new_ranges.assign(rmsg.ranges+2*size, rmsg.ranges+4*size);
+  traceMQ().free_msg(pending_reassign_);
+  pending_reassign_ = nullptr;
+
+  tomo_msg_metadata_t md = metadata();
+  if(old_ranges[2*rank]!=md.beg_sinogram || old_ranges[2*rank+1]!=md.n_sinograms)
+    throw std::runtime_error("Reassignment does not match the current sinograms");
+
+  /// Every rank holds the same projections; owned ones in group mode
+  size_t num_projs = vproj.size()/(md.n_sinograms*md.n_rays_per_proj_row);
+#ifdef TRACE_USE_MPI
+  std::vector<float> nvproj(num_projs*new_ranges[2*rank+1]*md.n_rays_per_proj_row);
+  trace_comm::MigrateRows(vproj.data(), nvproj.data(), md.n_rays_per_proj_row,
+      num_projs, old_ranges, new_ranges, comm);
+  vproj.swap(nvproj);
+#else
+  /// A single process keeps all of its rows
+  if(new_ranges[0]!=old_ranges[0] || new_ranges[1]!=old_ranges[1])
+    throw std::runtime_error("Reassignment moves rows of a single process");
+  (void)num_projs;
+#endif
+
+  md.beg_sinogram = new_ranges[2*rank];
+  md.n_sinograms = new_ranges[2*rank+1];
+  traceMQ().metadata(md);
+}
+
+void TraceStream::Checkpoint(trace_io::CheckpointState &state){
+  tomo_msg_metadata_t md = metadata();
+  state.beg_sinogram = md.beg_sinogram;
+  state.n_sinograms = md.n_sinograms;
+  state.n_rays = md.n_rays_per_proj_row;
+  state.counter = counter_;
+  state.proj = vproj;
+  state.theta = vtheta;
+  state.meta = vmeta;
+}
+
+void TraceStream::Restore(trace_io::CheckpointState const &state,
+                          MPI_Comm comm,
+                          std::vector<uint32_t> &old_ranges,
+                          std::vector<uint32_t> &new_ranges)
+{
+  tomo_msg_metadata_t md = metadata();
+  if(state.n_rays!=md.n_rays_per_proj_row ||
+     state.beg_sinogram+state.n_sinograms>md.tn_sinograms)
+    throw std::runtime_error("Checkpoint does not match the sinograms");
+  if(state.theta.size()!=state.meta.size())
+    throw std::runtime_error("Inconsistent checkpoint window");
+  size_t n_owned = 0;
+  for(auto &meta : state.meta) if(Owns(meta)) ++n_owned;
+  if(state.proj.size()!=n_owned*state.n_sinograms*md.n_rays_per_proj_row)
+    throw std::runtime_error("Checkpoint window does not match the group");
+
+  /// The checkpoint may follow a reassignment, while the distributor
+  /// assigned the initial sinograms in the handshake
+  uint32_t saved[2] = {state.beg_sinogram, state.n_sinograms};
+  uint32_t assigned[2] = {md.beg_sinogram, md.n_sinograms};
+#ifdef TRACE_USE_MPI
+  int size;
+  MPI_Comm_size(comm, &size);
+  old_ranges.resize(2*size);
+  new_ranges.resize(2*size);
+  MPI_Allgather(saved, 2, MPI_UINT32_T, old_ranges.data(), 2, MPI_UINT32_T,
+      comm);
+  MPI_Allgather(assigned, 2, MPI_UINT32_T, new_ranges.data(), 2,
+      MPI_UINT32_T, comm);
+  uint64_t old_rows = 0, new_rows = 0;
+  for(int r=0; r<size; ++r){
+    old_rows += old_ranges[2*r+1];
+    new_rows += new_ranges[2*r+1];
+  }
+  if(old_rows!=new_rows)
+    throw std::runtime_error("Checkpoints do not cover the assigned sinograms");
+
+  if(old_ranges==new_ranges) vproj = state.proj;
+  else{
+    vproj.resize(n_owned*md.n_sinograms*md.n_rays_per_proj_row);
+    trace_comm::MigrateRows(state.proj.data(), vproj.data(),
+        md.n_rays_per_proj_row, static_cast<int>(n_owned), old_ranges,
+        new_ranges, comm);
+  }
+#else
+  (void)comm;
+  old_ranges.assign(saved, saved+2);
+  new_ranges.assign(assigned, assigned+2);
+  /// A single process keeps all of its rows
+  if(old_ranges!=new_ranges)
+    throw std::runtime_error("Checkpoint does not match the assigned sinograms");
+  vproj = state.proj;
+#endif
+
+  vtheta = state.theta;
+  vmeta = state.meta;
+  counter_ = static_cast<uint32_t>(state.counter);
+}
+
+void TraceStream::NeighborSlices(int nslices){
+  num_neighbor_slices_ = nslices;
+}
+
 void TraceStream::PublishImage(DataRegionBase<float, TraceMetadata> &slice){
   auto &mdata = slice.metadata();
   auto &image = mdata.recon();
-  traceMQ().PublishMsg( &image[0], 
+  size_t offset = static_cast<size_t>(mdata.num_neighbor_recon_slices())*
+    mdata.num_grids()*mdata.num_grids();
+  traceMQ().PublishMsg( &image[offset], 
                           {mdata.num_slices(), mdata.num_cols(), mdata.num_cols()});
 }
 
@@ -0,0 +1,202 @@
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include "trace_writer.h"
+#include "trace_span.h"
+
+trace_io::AsyncReconWriter::AsyncReconWriter(MPI_Comm comm, int num_buffers)
+{
+#ifdef TRACE_USE_MPI
+  int provided = MPI_THREAD_SINGLE;
+  MPI_Query_thread(&provided);
+
+  if(num_buffers>0 && provided<MPI_THREAD_MULTIPLE){
+    int rank; MPI_Comm_rank(comm, &rank);
+    if(rank==0)
+      std::cerr << "MPI does not provide MPI_THREAD_MULTIPLE; " <<
+        "reconstructed images will be written synchronously." << std::endl;
+    num_buffers = 0;
+  }
+
+  /// Writes are issued from another thread, keep them in their own context
+  MPI_Comm_dup(comm, &comm_);
+#else
+  comm_ = comm;   /// Serial writes, nothing to isolate
+#endif
+  async_ = (num_buffers>0);
+  if(!async_) return;
+
+  buffers_.resize(num_buffers);
+  for(int i=0; i<num_buffers; ++i) free_buffers_.push_back(i);
+  io_thread_ = std::thread(&AsyncReconWriter::IOLoop, this);
+}
+
+trace_io::AsyncReconWriter::~AsyncReconWriter()
+{
+  if(async_){
+    Flush();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    pending_cv_.notify_all();
+    io_thread_.join();
+  }
+  if(series_!=nullptr) CloseSeries(series_);
+#ifdef TRACE_USE_MPI
+  MPI_Comm_free(&comm_);
+#endif
+}
+
+void trace_io::AsyncReconWriter::WriteRecon(
+    TraceMetadata &rank_metadata,
+    H5Metadata &dataset_metadata,
+    std::string const output_path,
+    std::string const dataset_path)
+{
+  Submit(rank_metadata, dataset_metadata, false, 0,
+      output_path, dataset_path);
+}
+
+void trace_io::AsyncReconWriter::EnableSeries(
+    std::string const output_path,
+    std::string const dataset_path,
+    int filter_id, unsigned int filter_level)
+{
+  series_enabled_ = true;
+  series_path_ = output_path;
+  series_dataset_ = dataset_path;
+  series_filter_id_ = filter_id;
+  series_filter_level_ = filter_level;
+}
+
+void trace_io::AsyncReconWriter::AppendRecon(
+    TraceMetadata &rank_metadata,
+    H5Metadata &dataset_metadata,
+    int64_t step)
+{
+  if(!series_enabled_)
+    throw std::runtime_error("AppendRecon requires EnableSeries");
+  Submit(rank_metadata, dataset_metadata, true, step,
+      series_path_, series_dataset_);
+}
+
+void trace_io::AsyncReconWriter::Submit(
+    TraceMetadata &rank_metadata,
+    H5Metadata &dataset_metadata,
+    bool append, int64_t step,
+    std::string const output_path,
+    std::string const dataset_path)
+{
+  int id = -1;
+  WriteJob sync_job;
+  if(async_){
+    /// Wait for a free buffer, i.e. back-pressure if the I/O thread lags
+    std::unique_lock<std::mutex> lock(mutex_);
+    free_cv_.wait(lock, [this]{ return !free_buffers_.empty(); });
+    id = free_buffers_.front();
+    free_buffers_.pop_front();
+  }
+  WriteJob &job = (async_) ? buffers_[id] : sync_job;
+
+  job.rank_dims[0] = static_cast<hsize_t>(rank_metadata.num_slices());
+  job.rank_dims[1] = static_cast<hsize_t>(rank_metadata.num_cols());
+  job.rank_dims[2] = static_cast<hsize_t>(rank_metadata.num_cols());
+  job.app_dims[0] = static_cast<hsize_t>(dataset_metadata.dims[1]);
+  job.app_dims[1] = static_cast<hsize_t>(dataset_metadata.dims[2]);
+  job.app_dims[2] = static_cast<hsize_t>(dataset_metadata.dims[2]);
+  job.slice_id = rank_metadata.slice_id();
+  job.append = append;
+  job.step = step;
+  job.output_path = output_path;
+  job.dataset_path = dataset_path;
+
+  /// Snapshot; reconstruction may modify recon as soon as we return
+  ADataRegion<float> &recon = rank_metadata.recon();
+  size_t beg = static_cast<size_t>(rank_metadata.num_neighbor_recon_slices())*
+    rank_metadata.num_grids() * rank_metadata.num_grids();
+  size_t count = job.rank_dims[0]*job.rank_dims[1]*job.rank_dims[2];
+  job.data.resize(count);
+  std::copy(&recon[beg], &recon[beg]+count, job.data.begin());
+
+  if(!async_){
+    Write(job, comm_);
+    ++submitted_; ++completed_;
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_buffers_.push_back(id);
+    ++submitted_;
+  }
+  pending_cv_.notify_one();
+}
+
+void trace_io::AsyncReconWriter::Write(WriteJob &job, MPI_Comm comm)
+{
+  TRACE_SPAN("h5 write");
+  if(job.append){
+    if(series_==nullptr)
+      series_ = CreateSeries(
+          job.output_path.c_str(), job.dataset_path.c_str(),
+          job.app_dims, series_filter_id_, series_filter_level_,
+          comm, MPI_INFO_NULL);
+    AppendSeries(series_, job.data.data(), job.rank_dims, job.slice_id,
+        job.step, H5FD_MPIO_COLLECTIVE);
+    return;
+  }
+
+  WriteData(
+      job.data.data(),
+      3, job.rank_dims,
+      job.slice_id,
+      3, job.app_dims,
+      0,
+      job.output_path.c_str(), job.dataset_path.c_str(),
+      comm, MPI_INFO_NULL, H5FD_MPIO_COLLECTIVE);
+}
+
+void trace_io::AsyncReconWriter::IOLoop()
+{
+  trace_span::ThreadName("writer");
+  for(;;){
+    int id;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      pending_cv_.wait(lock,
+          [this]{ return stop_ || !pending_buffers_.empty(); });
+      if(pending_buffers_.empty()) return;  /// stop_ and nothing left
+      id = pending_buffers_.front();
+    }
+
+    Write(buffers_[id], comm_);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_buffers_.pop_front();
+      free_buffers_.push_back(id);
+      ++completed_;
+    }
+    free_cv_.notify_all();
+  }
+}
+
+void trace_io::AsyncReconWriter::Flush()
+{
+  if(!async_) return;
+  std::unique_lock<std::mutex> lock(mutex_);
+  free_cv_.wait(lock, [this]{ return completed_==submitted_; });
+}
+
+uint64_t trace_io::AsyncReconWriter::submitted()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return submitted_;
+}
+
+uint64_t trace_io::AsyncReconWriter::completed()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return completed_;
+}
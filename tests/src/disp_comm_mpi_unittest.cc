@@ -0,0 +1,89 @@
+#include <vector>
+#include "gtest/gtest.h"
+#include "disp_comm_mpi.h"
+
+/// Run with several ranks, e.g. mpirun -np 4 ./disp_comm_mpi_unittest
+static DISPCommMPI<float> *comm = nullptr;
+
+/// Replica of rank with (value, length) pairs; sums stay exact in bf16
+static void Fill(DataRegion2DBareBase<float> &dr, int rank, int iter)
+{
+  for(size_t i=0; i<dr.num_rows(); ++i)
+    for(size_t j=0; j<dr.num_cols(); ++j)
+      dr[i][j] = (j%2==0) ? static_cast<float>((rank+1+iter)*((i+j)%5)) :
+                            static_cast<float>((rank+1)*((i+j)%4));
+}
+
+static void Pipelined(DataRegion2DBareBase<float> &dr, size_t block_rows)
+{
+  std::vector<DISPCommHandle> handles;
+  for(size_t beg=0; beg<dr.num_rows(); beg+=block_rows)
+    handles.push_back(comm->GlobalInPlaceCombinationStart(dr, beg,
+          std::min(block_rows, dr.num_rows()-beg)));
+  for(auto handle : handles)
+    comm->GlobalInPlaceCombinationWait(handle);
+}
+
+static void ExpectEqual(DataRegion2DBareBase<float> &a,
+                        DataRegion2DBareBase<float> &b)
+{
+  for(size_t i=0; i<a.num_rows(); ++i)
+    for(size_t j=0; j<a.num_cols(); ++j)
+      ASSERT_EQ(a[i][j], b[i][j]) << i << ", " << j;
+}
+
+struct Mode {
+  bool shm;
+  DISPCommPrecision precision;
+  bool cache_lengths;
+};
+
+class PipelinedCombinationTest : public ::testing::TestWithParam<Mode> {
+  protected:
+    void SetUp() override {
+      comm->SharedMemoryCombination(GetParam().shm);
+      comm->CombinationPrecision(GetParam().precision);
+      comm->CacheLengths(GetParam().cache_lengths);
+      comm->ChunkSize(64*sizeof(float));  /// Several requests per block
+    }
+    void TearDown() override {
+      comm->SharedMemoryCombination(false);
+      comm->CombinationPrecision(kDISPCommFP32);
+      comm->CacheLengths(false);
+    }
+};
+
+TEST_P(PipelinedCombinationTest, MatchesBlockingCombination)
+{
+  DataRegion2DBareBase<float> blocking(7, 2*45), pipelined(7, 2*45);
+  /// Second iteration reuses the lengths cached by the first one
+  for(int iter=0; iter<2; ++iter){
+    Fill(blocking, comm->rank(), iter);
+    Fill(pipelined, comm->rank(), iter);
+    if(iter==0) comm->NewWindow();
+    comm->GlobalInPlaceCombination(blocking);
+    if(iter==0) comm->NewWindow();
+    Pipelined(pipelined, 3);
+    ExpectEqual(blocking, pipelined);
+  }
+
+  int size = comm->size();
+  EXPECT_EQ(size*(size+1)/2.f, blocking[0][5]);   /// Length of pair (0, 2)
+}
+
+INSTANTIATE_TEST_CASE_P(Modes, PipelinedCombinationTest, ::testing::Values(
+      Mode{false, kDISPCommFP32, false},
+      Mode{false, kDISPCommBF16, false},
+      Mode{false, kDISPCommFP16, true},
+      Mode{false, kDISPCommFP32, true},
+      Mode{true, kDISPCommFP32, false},
+      Mode{true, kDISPCommBF16, false}));
+
+int main(int argc, char **argv)
+{
+  comm = new DISPCommMPI<float>(&argc, &argv);
+  ::testing::InitGoogleTest(&argc, argv);
+  int rc = RUN_ALL_TESTS();
+  delete comm;
+  return rc;
+}
@@ -0,0 +1,168 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "trace_checkpoint.h"
+
+static const char *kPath = "trace_checkpoint_unittest.bin";
+
+/// 2 sinograms of 3 rays; 4 projections in the window, 3 of them owned
+static trace_io::CheckpointState State()
+{
+  trace_io::CheckpointState state;
+  state.rank = 1;
+  state.size = 4;
+  state.beg_sinogram = 5;
+  state.n_sinograms = 2;
+  state.n_rays = 3;
+  state.passes = 7;
+  state.counter = 42;
+  for(int i=0; i<2*3*3; ++i) state.image.push_back(0.5f*i);
+  for(int i=0; i<3*2*3; ++i) state.proj.push_back(100.f+i);
+  for(int p=0; p<4; ++p){
+    tomo_msg_data_t meta;
+    std::memset(&meta, 0, sizeof(meta));
+    meta.projection_id = p;
+    meta.theta = 0.1f*p;
+    meta.center = 1.5f;
+    meta.owner = (p==2);
+    state.meta.push_back(meta);
+    state.theta.push_back(meta.theta);
+  }
+  return state;
+}
+
+static std::vector<char> ReadFile(char const *path)
+{
+  std::ifstream in(path, std::ios::binary);
+  return std::vector<char>(std::istreambuf_iterator<char>(in),
+                           std::istreambuf_iterator<char>());
+}
+
+static void WriteFile(char const *path, std::vector<char> const &bytes)
+{
+  std::ofstream out(path, std::ios::binary|std::ios::trunc);
+  out.write(bytes.data(), bytes.size());
+}
+
+/// Checkpoint file with the header changed by edit
+template <typename F>
+static void WriteEdited(F edit)
+{
+  trace_io::WriteCheckpoint(kPath, State());
+  std::vector<char> bytes = ReadFile(kPath);
+  trace_io::CheckpointHeader h;
+  std::memcpy(&h, bytes.data(), sizeof(h));
+  edit(h, bytes);
+  std::memcpy(bytes.data(), &h, sizeof(h));
+  WriteFile(kPath, bytes);
+}
+
+TEST(CheckpointTest, RoundTrip)
+{
+  trace_io::CheckpointState in = State(), out;
+  trace_io::WriteCheckpoint(kPath, in);
+  trace_io::ReadCheckpoint(kPath, out);
+  std::remove(kPath);
+
+  EXPECT_EQ(in.rank, out.rank);
+  EXPECT_EQ(in.size, out.size);
+  EXPECT_EQ(in.beg_sinogram, out.beg_sinogram);
+  EXPECT_EQ(in.n_sinograms, out.n_sinograms);
+  EXPECT_EQ(in.n_rays, out.n_rays);
+  EXPECT_EQ(in.passes, out.passes);
+  EXPECT_EQ(in.counter, out.counter);
+  EXPECT_EQ(in.image, out.image);
+  EXPECT_EQ(in.proj, out.proj);
+  EXPECT_EQ(in.theta, out.theta);
+  ASSERT_EQ(in.meta.size(), out.meta.size());
+  for(size_t i=0; i<in.meta.size(); ++i){
+    EXPECT_EQ(in.meta[i].projection_id, out.meta[i].projection_id);
+    EXPECT_EQ(in.meta[i].theta, out.meta[i].theta);
+    EXPECT_EQ(in.meta[i].owner, out.meta[i].owner);
+  }
+}
+
+TEST(CheckpointTest, EmptyWindow)
+{
+  trace_io::CheckpointState in = State(), out;
+  in.proj.clear();
+  in.theta.clear();
+  in.meta.clear();
+  trace_io::WriteCheckpoint(kPath, in);
+  trace_io::ReadCheckpoint(kPath, out);
+  std::remove(kPath);
+  EXPECT_EQ(in.image, out.image);
+  EXPECT_TRUE(out.proj.empty());
+  EXPECT_TRUE(out.meta.empty());
+}
+
+TEST(CheckpointTest, RejectsMissingAndTruncatedFiles)
+{
+  trace_io::CheckpointState out;
+  std::remove(kPath);
+  EXPECT_THROW(trace_io::ReadCheckpoint(kPath, out), std::runtime_error);
+
+  trace_io::WriteCheckpoint(kPath, State());
+  std::vector<char> bytes = ReadFile(kPath);
+  bytes.resize(bytes.size()-1);
+  WriteFile(kPath, bytes);
+  EXPECT_THROW(trace_io::ReadCheckpoint(kPath, out), std::runtime_error);
+
+  bytes.resize(sizeof(trace_io::CheckpointHeader)/2);
+  WriteFile(kPath, bytes);
+  EXPECT_THROW(trace_io::ReadCheckpoint(kPath, out), std::runtime_error);
+  std::remove(kPath);
+}
+
+TEST(CheckpointTest, RejectsMismatchedHeaders)
+{
+  typedef trace_io::CheckpointHeader H;
+  typedef std::vector<char> B;
+  std::vector<void (*)(H&, B&)> edits = {
+    [](H &h, B &) { h.magic[0] = 'X'; },
+    [](H &h, B &) { h.version += 1; },
+    [](H &h, B &) { h.meta_size += 4; },
+    /// Arrays outside of the file
+    [](H &h, B &b) { h.offsets[1] = b.size(); },
+    [](H &h, B &) { h.offsets[3] += 64*1024; },
+    [](H &h, B &) { h.counts[1] += 1024; },
+    [](H &h, B &) { h.counts[3] = ~0ull/2; },
+    [](H &h, B &) { h.offsets[0] += 4; },           /// Misaligned
+    /// Counts do not match the sinograms
+    [](H &h, B &) { h.n_rays = 4; },
+    [](H &h, B &) { h.n_sinograms = 1; },
+    [](H &h, B &) { h.counts[2] -= 1; },
+    [](H &h, B &) { h.counts[1] -= 1; },
+    [](H &h, B &) { h.counts[3] = 2; },             /// More owned than window
+  };
+  for(size_t i=0; i<edits.size(); ++i){
+    WriteEdited(edits[i]);
+    trace_io::CheckpointState out;
+    EXPECT_THROW(trace_io::ReadCheckpoint(kPath, out), std::runtime_error)
+      << "edit " << i;
+  }
+  std::remove(kPath);
+}
+
+TEST(CheckpointTest, AsyncCheckpointerWritesLatest)
+{
+  {
+    trace_io::AsyncCheckpointer ckpt(".", 3);
+    for(int i=0; i<5; ++i){
+      std::unique_ptr<trace_io::CheckpointState> state(
+          new trace_io::CheckpointState(State()));
+      state->passes = i;
+      ckpt.Submit(std::move(state));
+    }
+  }
+  std::string path = trace_io::CheckpointPath(".", 3);
+  trace_io::CheckpointState out;
+  trace_io::ReadCheckpoint(path, out);
+  std::remove(path.c_str());
+  EXPECT_EQ(4, out.passes);
+}
@@ -0,0 +1,253 @@
+/*
+ * Loopback benchmark for the projection codecs (trace_codec.h).
+ *
+ * A sender thread compresses synthetic projections (detector counts stored
+ * as float32, like the distributor forwards them) with n persistent threads,
+ * each with its own codec state, like the distributor does, and pushes
+ * them over a local ZeroMQ TCP socket; the receiver decompresses them into a
+ * projection buffer. An optional link rate (MB/s) paces the sender to model
+ * the DAQ-to-distributor link.
+ *
+ * Usage: trace_codec_bench [n_proj=200] [rows=64] [cols=2048] [threads=4]
+ *                          [link_MBps=0 (unlimited)]
+ */
+#include <random>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include "zmq.h"
+#include "trace_codec.h"
+
+struct chunk_h {
+  uint32_t codec;
+  uint32_t proj;
+  uint64_t offset;      /// Byte offset in the projection
+  uint64_t raw_size;
+  uint64_t comp_size;
+};
+
+static double thread_cpu_seconds()
+{
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/// Smooth object profile plus Poisson-like noise, quantized like uint16 counts
+static std::vector<float> generate_projection(int rows, int cols, int id)
+{
+  std::mt19937 gen(id);
+  std::normal_distribution<float> noise(0.f, 1.f);
+  std::vector<float> proj(static_cast<size_t>(rows)*cols);
+  for(int r=0; r<rows; ++r)
+    for(int c=0; c<cols; ++c){
+      float x = (c-cols/2.f)/(cols/2.f);
+      float counts = 40000.f*(1.f-0.6f*std::exp(-8.f*x*x)) +
+                     3000.f*std::sin(0.05f*r+0.01f*id);
+      counts += std::sqrt(counts)*noise(gen);
+      proj[static_cast<size_t>(r)*cols+c] = std::floor(std::max(0.f, counts));
+    }
+  return proj;
+}
+
+struct result_t {
+  double wall;
+  double comp_cpu;
+  double decomp_cpu;
+  uint64_t raw_bytes;
+  uint64_t wire_bytes;
+  bool valid;
+};
+
+static result_t run(uint32_t codec, std::vector<std::vector<float>> &projs,
+                    int rows, int cols, int n_threads, double link_MBps,
+                    int port)
+{
+  void *ctx = zmq_ctx_new();
+  void *pull = zmq_socket(ctx, ZMQ_PULL);
+  void *push = zmq_socket(ctx, ZMQ_PUSH);
+  std::string addr = "tcp://127.0.0.1:" + std::to_string(port);
+  zmq_bind(pull, addr.c_str());
+  zmq_connect(push, addr.c_str());
+
+  size_t proj_bytes = static_cast<size_t>(rows)*cols*sizeof(float);
+  int rows_per_chunk = (rows+n_threads-1)/n_threads;
+  int n_chunks = (rows+rows_per_chunk-1)/rows_per_chunk;
+  std::atomic<uint64_t> comp_ns {0};
+  std::atomic<uint64_t> wire_bytes {0};
+
+  auto beg = std::chrono::steady_clock::now();
+  std::thread sender([&]{
+    std::vector<std::vector<char>> bufs(n_chunks);
+    std::vector<trace_codec_ctx_t*> cctxs(n_chunks);
+    for(auto &c : cctxs) c = trace_codec_ctx_create();
+    size_t p = 0;
+
+    /// Compresses row block t of projection p
+    auto compress = [&](int t){
+      double c0 = thread_cpu_seconds();
+      int beg_row = t*rows_per_chunk;
+      int n_rows = std::min(rows_per_chunk, rows-beg_row);
+      size_t raw = static_cast<size_t>(n_rows)*cols*sizeof(float);
+      size_t bound = std::max(trace_codec_bound(codec, raw), raw);
+      bufs[t].resize(sizeof(chunk_h)+bound);
+      chunk_h *h = reinterpret_cast<chunk_h*>(bufs[t].data());
+      h->codec = codec;
+      h->proj = static_cast<uint32_t>(p);
+      h->offset = static_cast<uint64_t>(beg_row)*cols*sizeof(float);
+      h->raw_size = raw;
+      h->comp_size = trace_codec_compress_ctx(cctxs[t], codec,
+          &projs[p][static_cast<size_t>(beg_row)*cols], raw,
+          bufs[t].data()+sizeof(chunk_h), bound, 0);
+      comp_ns += static_cast<uint64_t>((thread_cpu_seconds()-c0)*1e9);
+    };
+
+    /// Workers for blocks 1..n_chunks-1, woken up for every projection;
+    /// the sender compresses block 0
+    std::mutex m;
+    std::condition_variable start, done;
+    size_t generation = 0;
+    int pending = 0;
+    bool quit = false;
+    std::vector<std::thread> workers;
+    for(int t=1; t<n_chunks; ++t){
+      workers.emplace_back([&, t]{
+        size_t seen = 0;
+        for(;;){
+          {
+            std::unique_lock<std::mutex> lock(m);
+            start.wait(lock, [&]{ return generation!=seen || quit; });
+            if(quit) return;
+            seen = generation;
+          }
+          compress(t);
+          std::lock_guard<std::mutex> lock(m);
+          if(--pending==0) done.notify_one();
+        }
+      });
+    }
+
+    double sent = 0.;
+    for(p=0; p<projs.size(); ++p){
+      /// Compress the row blocks of a projection in parallel
+      {
+        std::lock_guard<std::mutex> lock(m);
+        pending = n_chunks-1;
+        ++generation;
+      }
+      start.notify_all();
+      compress(0);
+      {
+        std::unique_lock<std::mutex> lock(m);
+        done.wait(lock, [&]{ return pending==0; });
+      }
+
+      for(int t=0; t<n_chunks; ++t){
+        chunk_h *h = reinterpret_cast<chunk_h*>(bufs[t].data());
+        size_t msg_size = sizeof(chunk_h)+h->comp_size;
+        zmq_send(push, bufs[t].data(), msg_size, 0);
+        wire_bytes += msg_size;
+        sent += msg_size;
+      }
+
+      /// Pace to the link rate
+      if(link_MBps>0.){
+        auto due = beg + std::chrono::duration<double>(sent/(link_MBps*1e6));
+        std::this_thread::sleep_until(due);
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m);
+      quit = true;
+    }
+    start.notify_all();
+    for(auto &th : workers) th.join();
+    for(auto &c : cctxs) trace_codec_ctx_free(c);
+  });
+
+  std::vector<char> dst(proj_bytes);
+  trace_codec_ctx_t *dctx = trace_codec_ctx_create();
+  bool valid = true;
+  double decomp_cpu = 0.;
+  for(size_t i=0; i<projs.size()*n_chunks; ++i){
+    zmq_msg_t msg;
+    zmq_msg_init(&msg);
+    zmq_msg_recv(&msg, pull, 0);
+    double c0 = thread_cpu_seconds();
+    chunk_h *h = reinterpret_cast<chunk_h*>(zmq_msg_data(&msg));
+    if(zmq_msg_size(&msg)<sizeof(chunk_h) ||
+       h->comp_size>zmq_msg_size(&msg)-sizeof(chunk_h))
+      valid = false;
+    else if(trace_codec_decompress_ctx(dctx, h->codec,
+          reinterpret_cast<char*>(zmq_msg_data(&msg))+sizeof(chunk_h),
+          h->comp_size, dst.data()+h->offset, h->raw_size)!=0)
+      valid = false;
+    else if(std::memcmp(dst.data()+h->offset,
+                        reinterpret_cast<char*>(projs[h->proj].data())+h->offset,
+                        h->raw_size)!=0)
+      valid = false;
+    decomp_cpu += thread_cpu_seconds()-c0;
+    zmq_msg_close(&msg);
+  }
+  sender.join();
+  trace_codec_ctx_free(dctx);
+  double wall = std::chrono::duration<double>(
+      std::chrono::steady_clock::now()-beg).count();
+
+  zmq_close(push);
+  zmq_close(pull);
+  zmq_ctx_destroy(ctx);
+
+  return result_t {wall, comp_ns*1e-9, decomp_cpu,
+                   projs.size()*proj_bytes, wire_bytes, valid};
+}
+
+int main(int argc, char **argv)
+{
+  int n_proj = (argc>1) ? atoi(argv[1]) : 200;
+  int rows = (argc>2) ? atoi(argv[2]) : 64;
+  int cols = (argc>3) ? atoi(argv[3]) : 2048;
+  int n_threads = (argc>4) ? atoi(argv[4]) : 4;
+  double link_MBps = (argc>5) ? atof(argv[5]) : 0.;
+
+  std::vector<std::vector<float>> projs;
+  for(int i=0; i<n_proj; ++i) projs.push_back(generate_projection(rows, cols, i));
+
+  std::cout << "projections=" << n_proj << "; rows=" << rows << "; cols=" <<
+    cols << "; threads=" << n_threads << "; link=" <<
+    ((link_MBps>0.) ? std::to_string(link_MBps)+" MB/s" : "unlimited") <<
+    std::endl;
+  std::cout << std::setw(10) << "codec" << std::setw(8) << "ratio" <<
+    std::setw(14) << "raw MB/s" << std::setw(14) << "wire MB/s" <<
+    std::setw(16) << "comp cpu s/GB" << std::setw(18) << "decomp cpu s/GB" <<
+    std::endl;
+
+  int port = 52600;
+  uint32_t supported = trace_codec_supported();
+  for(uint32_t codec=0; codec<TRACE_CODEC_COUNT; ++codec){
+    if(!(supported & (1u<<codec))) continue;
+    result_t r = run(codec, projs, rows, cols, n_threads, link_MBps, port++);
+    double gb = r.raw_bytes/1e9;
+    std::cout << std::setw(10) << trace_codec_name(codec) <<
+      std::setw(8) << std::setprecision(3) <<
+        static_cast<double>(r.raw_bytes)/r.wire_bytes <<
+      std::setw(14) << std::setprecision(5) << r.raw_bytes/1e6/r.wall <<
+      std::setw(14) << r.wire_bytes/1e6/r.wall <<
+      std::setw(16) << r.comp_cpu/gb <<
+      std::setw(18) << r.decomp_cpu/gb <<
+      (r.valid ? "" : "  MISMATCH") << std::endl;
+  }
+
+  return 0;
+}
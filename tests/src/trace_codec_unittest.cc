@@ -0,0 +1,116 @@
+#include <cstring>
+#include <random>
+#include <vector>
+#include "gtest/gtest.h"
+#include "trace_codec.h"
+
+/// Detector-like counts stored as float32, as bytes; size need not be a
+/// multiple of 4
+static std::vector<char> Counts(size_t raw_size, unsigned seed)
+{
+  std::mt19937 gen(seed);
+  std::poisson_distribution<int> counts(200);
+  std::vector<float> values(raw_size/4+1);
+  for(auto &v : values) v = static_cast<float>(counts(gen));
+  std::vector<char> raw(raw_size);
+  std::memcpy(raw.data(), values.data(), raw_size);
+  for(size_t i=raw_size/4*4; i<raw_size; ++i)
+    raw[i] = static_cast<char>(0x5a+i);
+  return raw;
+}
+
+/// Codecs that are not built in are not tested
+class CodecTest : public ::testing::TestWithParam<uint32_t> {
+  protected:
+    bool Supported() const {
+      return trace_codec_supported() & (1u<<GetParam());
+    }
+};
+
+TEST_P(CodecTest, RoundTrip)
+{
+  uint32_t codec = GetParam();
+  if(!Supported()) return;
+  trace_codec_ctx_t *ctx = trace_codec_ctx_create();
+  ASSERT_NE(nullptr, ctx);
+  /// Partial elements, partial bitshuffle groups and a reused context
+  for(size_t raw_size : {4ul, 7ul, 33ul, 1021ul, 4096ul, 4099ul, 65538ul}){
+    std::vector<char> raw = Counts(raw_size, static_cast<unsigned>(raw_size));
+    size_t bound = trace_codec_bound(codec, raw_size);
+    ASSERT_GE(bound, raw_size);
+    std::vector<char> comp(bound), out(raw_size, 0);
+
+    size_t comp_size = trace_codec_compress_ctx(ctx, codec, raw.data(),
+        raw_size, comp.data(), bound, 0);
+    ASSERT_GT(comp_size, 0u) << raw_size;
+    ASSERT_LE(comp_size, bound);
+    ASSERT_EQ(0, trace_codec_decompress_ctx(ctx, codec, comp.data(),
+          comp_size, out.data(), raw_size)) << raw_size;
+    EXPECT_EQ(raw, out) << raw_size;
+
+    /// Same result without a context
+    std::fill(out.begin(), out.end(), 0);
+    ASSERT_EQ(0, trace_codec_decompress(codec, comp.data(), comp_size,
+          out.data(), raw_size)) << raw_size;
+    EXPECT_EQ(raw, out) << raw_size;
+  }
+  trace_codec_ctx_free(ctx);
+}
+
+TEST_P(CodecTest, RejectsWrongSizes)
+{
+  uint32_t codec = GetParam();
+  if(!Supported()) return;
+  size_t raw_size = 4099;
+  std::vector<char> raw = Counts(raw_size, 1);
+  size_t bound = trace_codec_bound(codec, raw_size);
+  std::vector<char> comp(bound), out(raw_size+8);
+  size_t comp_size = trace_codec_compress(codec, raw.data(), raw_size,
+      comp.data(), bound, 0);
+  ASSERT_GT(comp_size, 0u);
+
+  EXPECT_NE(0, trace_codec_decompress(codec, comp.data(), comp_size/2,
+        out.data(), raw_size));
+  EXPECT_NE(0, trace_codec_decompress(codec, comp.data(), comp_size,
+        out.data(), raw_size-1));
+  EXPECT_NE(0, trace_codec_decompress(codec, comp.data(), comp_size,
+        out.data(), raw_size+8));
+  /// Destination too small for the compressed data
+  EXPECT_EQ(0u, trace_codec_compress(codec, raw.data(), raw_size,
+        comp.data(), 16, 0));
+}
+
+INSTANTIATE_TEST_CASE_P(Codecs, CodecTest, ::testing::Values(
+      static_cast<uint32_t>(TRACE_CODEC_NONE),
+      static_cast<uint32_t>(TRACE_CODEC_LZ4),
+      static_cast<uint32_t>(TRACE_CODEC_ZSTD),
+      static_cast<uint32_t>(TRACE_CODEC_BSHUF_LZ4)));
+
+TEST(BitshuffleTest, InverseAndPlaneLayout)
+{
+  for(size_t n : {1ul, 8ul, 13ul, 64ul}){
+    std::vector<char> raw = Counts(4*n, static_cast<unsigned>(n));
+    std::vector<char> shuf(4*n), out(4*n);
+    trace_bitshuffle4(raw.data(), shuf.data(), n);
+    trace_bitunshuffle4(shuf.data(), out.data(), n);
+    EXPECT_EQ(raw, out) << n;
+  }
+
+  /// Bit 0 of byte 0 of 8 elements lands in the first plane byte
+  std::vector<uint32_t> elems(8, 0);
+  elems[0] = 1;
+  elems[3] = 1;
+  std::vector<uint8_t> shuf(32);
+  trace_bitshuffle4(elems.data(), shuf.data(), 8);
+  EXPECT_EQ(0x09, shuf[0]);
+  for(size_t i=1; i<shuf.size(); ++i) EXPECT_EQ(0, shuf[i]) << i;
+}
+
+TEST(CodecNameTest, NamesRoundTrip)
+{
+  for(uint32_t c=0; c<TRACE_CODEC_COUNT; ++c)
+    EXPECT_EQ(static_cast<int>(c),
+        trace_codec_from_name(trace_codec_name(c)));
+  EXPECT_EQ(-1, trace_codec_from_name("snappy"));
+  EXPECT_TRUE(trace_codec_supported() & (1u<<TRACE_CODEC_NONE));
+}
@@ -0,0 +1,93 @@
+#include <vector>
+#include "gtest/gtest.h"
+#include "trace_comm.h"
+
+/// Run with several ranks, e.g. mpirun -np 4 ./trace_comm_mpi_unittest
+static const int kSlices = 3;         /// Own slices of every rank
+static const size_t kSliceSize = 5;
+
+static float Value(int slice, size_t j)
+{
+  return static_cast<float>((slice*slice+3*j)%7);
+}
+
+/// Image of rank with depth halo slices on both sides, halos set to -1
+static std::vector<float> Image(int rank, int depth)
+{
+  std::vector<float> image((kSlices+2*depth)*kSliceSize, -1.f);
+  for(int s=0; s<kSlices; ++s)
+    for(size_t j=0; j<kSliceSize; ++j)
+      image[(depth+s)*kSliceSize+j] = Value(rank*kSlices+s, j);
+  return image;
+}
+
+TEST(HaloExchangeTest, ReceivesNeighborSlices)
+{
+  int rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  const int depth = 2;
+  auto image = Image(rank, depth);
+
+  trace_comm::HaloExchange halo(image.data(), kSlices, kSliceSize, depth,
+      MPI_COMM_WORLD);
+  EXPECT_EQ(rank>0, halo.has_top());
+  EXPECT_EQ(rank<size-1, halo.has_bottom());
+  halo.Start();
+  halo.Wait();
+
+  for(int h=0; h<depth; ++h)
+    for(size_t j=0; j<kSliceSize; ++j){
+      float top = (rank>0) ? Value(rank*kSlices-depth+h, j) : -1.f;
+      float bottom = (rank<size-1) ? Value((rank+1)*kSlices+h, j) : -1.f;
+      EXPECT_EQ(top, image[h*kSliceSize+j]) << h << ", " << j;
+      EXPECT_EQ(bottom, image[(depth+kSlices+h)*kSliceSize+j]) << h << ", " << j;
+    }
+}
+
+TEST(HaloExchangeTest, SmoothingMatchesWholeVolume)
+{
+  int rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  const float beta = 0.25f;
+  auto image = Image(rank, 1);
+
+  trace_comm::HaloExchange halo(image.data(), kSlices, kSliceSize, 1,
+      MPI_COMM_WORLD);
+  for(int iter=0; iter<3; ++iter){
+    halo.Start();
+    halo.Wait();
+    trace_comm::SmoothSlices(image.data(), kSlices, kSliceSize, halo, beta);
+  }
+
+  /// Same steps on the whole volume, ends use the slice itself
+  int n = size*kSlices;
+  std::vector<float> volume(n*kSliceSize), old;
+  for(int s=0; s<n; ++s)
+    for(size_t j=0; j<kSliceSize; ++j) volume[s*kSliceSize+j] = Value(s, j);
+  for(int iter=0; iter<3; ++iter){
+    old = volume;
+    for(int s=0; s<n; ++s)
+      for(size_t j=0; j<kSliceSize; ++j){
+        float above = old[((s>0) ? s-1 : s)*kSliceSize+j];
+        float below = old[((s<n-1) ? s+1 : s)*kSliceSize+j];
+        volume[s*kSliceSize+j] +=
+          beta*(above - 2.f*old[s*kSliceSize+j] + below);
+      }
+  }
+
+  for(int s=0; s<kSlices; ++s)
+    for(size_t j=0; j<kSliceSize; ++j)
+      EXPECT_FLOAT_EQ(volume[(rank*kSlices+s)*kSliceSize+j],
+                      image[(1+s)*kSliceSize+j]) << s << ", " << j;
+}
+
+int main(int argc, char **argv)
+{
+  MPI_Init(&argc, &argv);
+  ::testing::InitGoogleTest(&argc, argv);
+  int rc = RUN_ALL_TESTS();
+  MPI_Finalize();
+  return rc;
+}
@@ -0,0 +1,62 @@
+#include <cmath>
+#include <complex>
+#include <vector>
+#include <stdexcept>
+#include "gtest/gtest.h"
+#include "trace_fft.h"
+
+/// Direct DFT of the first n/2+1 coefficients
+static std::vector<std::complex<double>> ReferenceDFT(
+    std::vector<float> const &x)
+{
+  size_t n = x.size();
+  double pi = std::acos(-1.);
+  std::vector<std::complex<double>> out(n/2+1);
+  for(size_t k=0; k<=n/2; ++k)
+    for(size_t j=0; j<n; ++j)
+      out[k] += static_cast<double>(x[j])*
+        std::polar(1., -2.*pi*static_cast<double>(k*j%n)/n);
+  return out;
+}
+
+class RealFFTTest : public ::testing::TestWithParam<size_t> {};
+
+TEST_P(RealFFTTest, ForwardMatchesDFT)
+{
+  size_t n = GetParam();
+  trace_utils::RealFFT fft(n);
+  std::vector<float> x(n);
+  for(size_t i=0; i<n; ++i) x[i] = std::sin(0.37*i) + 0.01f*(i%7);
+  std::copy(x.begin(), x.end(), fft.real());
+  fft.Forward();
+
+  auto ref = ReferenceDFT(x);
+  for(size_t k=0; k<=n/2; ++k){
+    EXPECT_NEAR(ref[k].real(), fft.spectrum()[k].real(), 1e-3*n) << k;
+    EXPECT_NEAR(ref[k].imag(), fft.spectrum()[k].imag(), 1e-3*n) << k;
+  }
+}
+
+TEST_P(RealFFTTest, InverseRestoresInput)
+{
+  size_t n = GetParam();
+  trace_utils::RealFFT fft(n);
+  std::vector<float> x(n);
+  for(size_t i=0; i<n; ++i) x[i] = std::cos(1.3*i) - 0.5f*(i%3);
+  std::copy(x.begin(), x.end(), fft.real());
+  fft.Forward();
+  fft.Inverse();
+  for(size_t i=0; i<n; ++i)
+    EXPECT_NEAR(x[i], fft.real()[i], 1e-4) << i;
+}
+
+INSTANTIATE_TEST_CASE_P(Lengths, RealFFTTest,
+    ::testing::Values(4, 8, 64, 1024));
+
+TEST(RealFFT, InvalidLength)
+{
+  EXPECT_THROW(trace_utils::RealFFT fft(12), std::invalid_argument);
+  EXPECT_THROW(trace_utils::RealFFT fft(2), std::invalid_argument);
+  EXPECT_EQ(1024u, trace_utils::NextPowerOfTwo(640));
+  EXPECT_EQ(512u, trace_utils::NextPowerOfTwo(512));
+}
@@ -0,0 +1,200 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include "gtest/gtest.h"
+#include "trace_half.h"
+
+static float Bits(uint32_t x)
+{
+  float f; std::memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+static bool IsBF16NaN(uint16_t h) { return (h & 0x7fffu) > 0x7f80u; }
+static bool IsFP16NaN(uint16_t h) { return (h & 0x7fffu) > 0x7c00u; }
+
+TEST(BF16Test, RoundTripsEveryValue)
+{
+  for(uint32_t h=0; h<=0xffffu; ++h){
+    uint16_t b = static_cast<uint16_t>(h);
+    if(IsBF16NaN(b)) continue;
+    ASSERT_EQ(b, trace_half::FloatToBF16(trace_half::BF16ToFloat(b))) << h;
+  }
+}
+
+TEST(BF16Test, RoundsToNearestEven)
+{
+  /// Spacing of bf16 in [1, 2) is 2^-7
+  float ulp = std::ldexp(1.f, -7);
+  EXPECT_EQ(0x3f80u, trace_half::FloatToBF16(1.f + ulp/2));      /// Tie, even
+  EXPECT_EQ(0x3f82u, trace_half::FloatToBF16(1.f + 3*ulp/2));    /// Tie, up
+  EXPECT_EQ(0x3f81u, trace_half::FloatToBF16(1.f + ulp/2 + ulp/64));
+  EXPECT_EQ(0x3f80u, trace_half::FloatToBF16(1.f + ulp/2 - ulp/64));
+  EXPECT_EQ(0xbf82u, trace_half::FloatToBF16(-1.f - 3*ulp/2));
+}
+
+TEST(BF16Test, SpecialValues)
+{
+  float inf = std::numeric_limits<float>::infinity();
+  EXPECT_EQ(0x0000u, trace_half::FloatToBF16(0.f));
+  EXPECT_EQ(0x8000u, trace_half::FloatToBF16(-0.f));
+  EXPECT_EQ(0x7f80u, trace_half::FloatToBF16(inf));
+  EXPECT_EQ(0xff80u, trace_half::FloatToBF16(-inf));
+  /// Largest float rounds past the largest bf16
+  EXPECT_EQ(0x7f80u,
+      trace_half::FloatToBF16(std::numeric_limits<float>::max()));
+
+  EXPECT_TRUE(IsBF16NaN(trace_half::FloatToBF16(
+          std::numeric_limits<float>::quiet_NaN())));
+  /// Payload only in the dropped bits must not turn into infinity
+  uint16_t h = trace_half::FloatToBF16(Bits(0x7f800001u));
+  EXPECT_TRUE(IsBF16NaN(h));
+  EXPECT_TRUE(std::isnan(trace_half::BF16ToFloat(h)));
+  EXPECT_TRUE(IsBF16NaN(trace_half::FloatToBF16(Bits(0xff800001u))));
+
+  /// Float subnormals keep their upper bits
+  EXPECT_EQ(0x0001u, trace_half::FloatToBF16(Bits(0x00010000u)));
+  EXPECT_EQ(Bits(0x00010000u), trace_half::BF16ToFloat(0x0001u));
+}
+
+TEST(FP16Test, RoundTripsEveryValue)
+{
+  for(uint32_t h=0; h<=0xffffu; ++h){
+    uint16_t b = static_cast<uint16_t>(h);
+    if(IsFP16NaN(b)) continue;
+    ASSERT_EQ(b, trace_half::FloatToFP16(trace_half::FP16ToFloat(b))) << h;
+  }
+}
+
+TEST(FP16Test, ConvertsKnownValues)
+{
+  EXPECT_EQ(0x3c00u, trace_half::FloatToFP16(1.f));
+  EXPECT_EQ(0xc000u, trace_half::FloatToFP16(-2.f));
+  EXPECT_EQ(0x3555u, trace_half::FloatToFP16(1.f/3));
+  EXPECT_EQ(0x7bffu, trace_half::FloatToFP16(65504.f));
+  EXPECT_EQ(65504.f, trace_half::FP16ToFloat(0x7bffu));
+  EXPECT_EQ(0.5f, trace_half::FP16ToFloat(0x3800u));
+}
+
+TEST(FP16Test, RoundsToNearestEven)
+{
+  /// Spacing of fp16 in [1, 2) is 2^-10
+  float ulp = std::ldexp(1.f, -10);
+  EXPECT_EQ(0x3c00u, trace_half::FloatToFP16(1.f + ulp/2));      /// Tie, even
+  EXPECT_EQ(0x3c02u, trace_half::FloatToFP16(1.f + 3*ulp/2));    /// Tie, up
+  EXPECT_EQ(0x3c01u, trace_half::FloatToFP16(1.f + ulp/2 + ulp/64));
+  EXPECT_EQ(0x3c00u, trace_half::FloatToFP16(1.f + ulp/2 - ulp/64));
+  /// Rounding up the largest mantissa carries into the exponent
+  EXPECT_EQ(0x4000u, trace_half::FloatToFP16(2.f - ulp/2));
+}
+
+TEST(FP16Test, Overflow)
+{
+  float inf = std::numeric_limits<float>::infinity();
+  EXPECT_EQ(0x7bffu, trace_half::FloatToFP16(65519.f));   /// Below the tie
+  EXPECT_EQ(0x7c00u, trace_half::FloatToFP16(65520.f));   /// Tie, odd
+  EXPECT_EQ(0x7c00u, trace_half::FloatToFP16(1e6f));
+  EXPECT_EQ(0xfc00u, trace_half::FloatToFP16(-1e6f));
+  EXPECT_EQ(0x7c00u, trace_half::FloatToFP16(inf));
+  EXPECT_EQ(0xfc00u, trace_half::FloatToFP16(-inf));
+  EXPECT_EQ(inf, trace_half::FP16ToFloat(0x7c00u));
+}
+
+TEST(FP16Test, Subnormals)
+{
+  float min_sub = std::ldexp(1.f, -24);       /// Smallest fp16 subnormal
+  EXPECT_EQ(0x0001u, trace_half::FloatToFP16(min_sub));
+  EXPECT_EQ(min_sub, trace_half::FP16ToFloat(0x0001u));
+  EXPECT_EQ(0x03ffu, trace_half::FloatToFP16(1023*min_sub));
+  EXPECT_EQ(0x0400u, trace_half::FloatToFP16(std::ldexp(1.f, -14)));
+  EXPECT_EQ(0x8001u, trace_half::FloatToFP16(-min_sub));
+
+  EXPECT_EQ(0x0000u, trace_half::FloatToFP16(min_sub/2));     /// Tie, even
+  EXPECT_EQ(0x0002u, trace_half::FloatToFP16(3*min_sub/2));   /// Tie, up
+  EXPECT_EQ(0x0001u, trace_half::FloatToFP16(0.75f*min_sub));
+  EXPECT_EQ(0x0000u, trace_half::FloatToFP16(0.25f*min_sub));
+  EXPECT_EQ(0x8000u, trace_half::FloatToFP16(-0.25f*min_sub));
+  EXPECT_EQ(0x0000u, trace_half::FloatToFP16(std::ldexp(1.f, -40)));
+  /// Largest subnormal rounds up to the smallest normal
+  EXPECT_EQ(0x0400u, trace_half::FloatToFP16(1023.5f*min_sub));
+}
+
+TEST(FP16Test, NaN)
+{
+  uint16_t h = trace_half::FloatToFP16(
+      std::numeric_limits<float>::quiet_NaN());
+  EXPECT_TRUE(IsFP16NaN(h));
+  EXPECT_TRUE(std::isnan(trace_half::FP16ToFloat(h)));
+  /// Payload only in the dropped bits must not turn into infinity
+  EXPECT_TRUE(IsFP16NaN(trace_half::FloatToFP16(Bits(0x7f800001u))));
+  EXPECT_TRUE(std::isnan(trace_half::FP16ToFloat(0x7e00u)));
+}
+
+/// Folds the values of every rank with the op kernel, as an MPI_Allreduce
+/// would on a linear reduction
+static uint16_t Reduce(std::vector<float> const &values, bool bf16)
+{
+  uint16_t acc = 0;
+  for(float v : values){
+    uint16_t in = (bf16) ? trace_half::FloatToBF16(v) :
+                           trace_half::FloatToFP16(v);
+    if(bf16) trace_half::SumBF16(&in, &acc, 1);
+    else trace_half::SumFP16(&in, &acc, 1);
+  }
+  return acc;
+}
+
+TEST(HalfSumTest, ExactSums)
+{
+  std::vector<uint16_t> a(4), b(4);
+  float in[4] = {1.f, -2.5f, 0.125f, 96.f};
+  float inout[4] = {3.f, 0.5f, 0.25f, -32.f};
+  for(int i=0; i<4; ++i){
+    a[i] = trace_half::FloatToBF16(in[i]);
+    b[i] = trace_half::FloatToBF16(inout[i]);
+  }
+  trace_half::SumBF16(a.data(), b.data(), 4);
+  for(int i=0; i<4; ++i)
+    EXPECT_EQ(in[i]+inout[i], trace_half::BF16ToFloat(b[i])) << i;
+
+  for(int i=0; i<4; ++i){
+    a[i] = trace_half::FloatToFP16(in[i]);
+    b[i] = trace_half::FloatToFP16(inout[i]);
+  }
+  trace_half::SumFP16(a.data(), b.data(), 4);
+  for(int i=0; i<4; ++i)
+    EXPECT_EQ(in[i]+inout[i], trace_half::FP16ToFloat(b[i])) << i;
+
+  EXPECT_EQ(36.f, trace_half::BF16ToFloat(Reduce({1, 2, 3, 4, 5, 6, 7, 8},
+          true)));
+  EXPECT_EQ(36.f, trace_half::FP16ToFloat(Reduce({1, 2, 3, 4, 5, 6, 7, 8},
+          false)));
+}
+
+TEST(HalfSumTest, RoundsEveryPartialSum)
+{
+  /// 256+1 ties back to 256 in bf16, so the ones are lost one by one
+  std::vector<float> values(1, 256.f);
+  values.resize(9, 1.f);
+  EXPECT_EQ(256.f, trace_half::BF16ToFloat(Reduce(values, true)));
+  /// Same for 2048 in fp16; 2048+3 ties up to 2052
+  values.assign(1, 2048.f);
+  values.resize(9, 1.f);
+  EXPECT_EQ(2048.f, trace_half::FP16ToFloat(Reduce(values, false)));
+  EXPECT_EQ(2052.f, trace_half::FP16ToFloat(Reduce({2048.f, 3.f}, false)));
+}
+
+TEST(HalfSumTest, SpecialValues)
+{
+  /// fp16 sums overflow where bf16 sums do not
+  EXPECT_EQ(0x7c00u, Reduce({60000.f, 60000.f}, false));
+  EXPECT_EQ(119808.f, trace_half::BF16ToFloat(Reduce({60000.f, 60000.f},
+          true)));
+  float inf = std::numeric_limits<float>::infinity();
+  EXPECT_EQ(0x7c00u, Reduce({inf, 1.f}, false));
+  EXPECT_TRUE(IsFP16NaN(Reduce({inf, -inf}, false)));
+  EXPECT_TRUE(IsBF16NaN(Reduce({inf, -inf}, true)));
+  EXPECT_TRUE(IsBF16NaN(Reduce({std::nanf(""), 1.f}, true)));
+}
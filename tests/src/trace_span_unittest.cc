@@ -0,0 +1,121 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "trace_span.h"
+
+/// Tracing is process-wide; the tests run in order and this one first
+TEST(TraceSpanTest, DisabledRecordsNothing)
+{
+  EXPECT_FALSE(trace_span::Enabled(trace_span::kPhases));
+  {
+    TRACE_SPAN("disabled");
+  }
+  EXPECT_EQ(0., trace_span::TotalSeconds("disabled"));
+}
+
+TEST(TraceSpanTest, ScopesAreTimedUpToLevel)
+{
+  trace_span::Enable(trace_span::kPhases);
+  {
+    TRACE_SPAN("sleep");
+    TRACE_SPAN_DETAIL("sleep detail");
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  double t = trace_span::TotalSeconds("sleep");
+  EXPECT_GT(t, 0.015);
+  EXPECT_LT(t, 1.);
+  EXPECT_EQ(0., trace_span::TotalSeconds("sleep detail"));
+}
+
+TEST(TraceSpanTest, ExitedThreadsHandBackTheirBuffers)
+{
+  trace_span::Enable(trace_span::kPhases);
+  for(int i=0; i<8; ++i)
+    std::thread([]{
+      trace_span::ThreadName("worker");
+      TRACE_SPAN("worker span");
+    }).join();
+
+  std::string path = "trace_span_unittest.bin";
+  trace_span::WriteBinaryLog(path, 3);
+  std::ifstream in(path, std::ios::binary);
+  trace_span::SpanLogHeader h;
+  in.read(reinterpret_cast<char*>(&h), sizeof(h));
+  ASSERT_TRUE(in.good());
+  EXPECT_EQ(0, std::memcmp(h.magic, "TRCSPAN", 8));
+  EXPECT_EQ(3, h.pid);
+  EXPECT_EQ(2u, h.n_threads);   /// This thread and one reused worker buffer
+  std::remove(path.c_str());
+}
+
+TEST(TraceSpanTest, BinaryLogHasTheSpansOfEveryThread)
+{
+  trace_span::Enable(trace_span::kDetail);
+  trace_span::Window(7);
+  std::thread worker([]{
+    TRACE_SPAN_DETAIL("detail span");
+  });
+  worker.join();
+  {
+    TRACE_SPAN("window span");
+  }
+
+  std::string path = "trace_span_unittest.bin";
+  trace_span::WriteBinaryLog(path, 0);
+  std::ifstream in(path, std::ios::binary);
+  trace_span::SpanLogHeader h;
+  in.read(reinterpret_cast<char*>(&h), sizeof(h));
+  ASSERT_TRUE(in.good());
+  EXPECT_EQ(0u, h.dropped);
+  EXPECT_GT(h.ticks_per_us, 0.);
+
+  std::vector<std::string> names(h.n_names);
+  for(uint32_t i=0; i<h.n_names+h.n_threads; ++i){
+    uint32_t id, len;
+    in.read(reinterpret_cast<char*>(&id), sizeof(id));
+    in.read(reinterpret_cast<char*>(&len), sizeof(len));
+    std::string s(len, '\0');
+    in.read(&s[0], len);
+    if(i<h.n_names) names.at(id) = s;
+  }
+  int found = 0;
+  for(uint64_t i=0; i<h.n_spans; ++i){
+    trace_span::SpanLogRecord rec;
+    in.read(reinterpret_cast<char*>(&rec), sizeof(rec));
+    ASSERT_TRUE(in.good());
+    EXPECT_LE(rec.beg, rec.end);
+    EXPECT_GE(rec.beg, h.base);
+    std::string const &name = names.at(rec.name);
+    if(name=="detail span" || name=="window span"){
+      EXPECT_EQ(7, rec.window);
+      ++found;
+    }
+  }
+  EXPECT_EQ(2, found);
+  std::remove(path.c_str());
+}
+
+TEST(TraceSpanTest, ChromeTraceHasCompleteEvents)
+{
+  trace_span::Enable(trace_span::kPhases);
+  {
+    TRACE_SPAN("chrome span");
+  }
+  std::string path = "trace_span_unittest.json";
+  trace_span::WriteChromeTrace(path, 5);
+  std::ifstream in(path);
+  std::string json((std::istreambuf_iterator<char>(in)),
+      std::istreambuf_iterator<char>());
+  EXPECT_EQ(0u, json.find("{\"traceEvents\":["));
+  EXPECT_NE(std::string::npos, json.find(
+        "{\"name\":\"chrome span\",\"ph\":\"X\",\"pid\":5,"));
+  EXPECT_NE(std::string::npos, json.find("\"thread_name\""));
+  EXPECT_EQ("]}\n", json.substr(json.size()-3));
+  std::remove(path.c_str());
+}
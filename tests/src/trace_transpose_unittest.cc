@@ -0,0 +1,57 @@
+#include <vector>
+#include <tuple>
+#include "gtest/gtest.h"
+#include "trace_transpose.h"
+
+/// Reference swap: dims of the output are dims with axes a and b exchanged
+static std::vector<int> ReferenceSwap(std::vector<int> const &in,
+                                      size_t const dims[3], int a, int b)
+{
+  size_t odims[3] = { dims[0], dims[1], dims[2] };
+  std::swap(odims[a], odims[b]);
+  std::vector<int> out(in.size());
+  for(size_t i=0; i<dims[0]; ++i)
+    for(size_t j=0; j<dims[1]; ++j)
+      for(size_t k=0; k<dims[2]; ++k){
+        size_t idx[3] = { i, j, k };
+        std::swap(idx[a], idx[b]);
+        out[(idx[0]*odims[1]+idx[1])*odims[2]+idx[2]] =
+          in[(i*dims[1]+j)*dims[2]+k];
+      }
+  return out;
+}
+
+class SwapAxesTest :
+  public ::testing::TestWithParam<std::tuple<int, int, int>> {};
+
+TEST_P(SwapAxesTest, MatchesReference)
+{
+  int a = std::get<0>(GetParam());
+  int b = std::get<1>(GetParam());
+  int n_threads = std::get<2>(GetParam());
+  /// Sizes that are not multiples of the tile size
+  size_t dims[3] = { 37, 18, 53 };
+  std::vector<int> in(dims[0]*dims[1]*dims[2]);
+  for(size_t i=0; i<in.size(); ++i) in[i] = static_cast<int>(i);
+
+  std::vector<int> out(in.size(), -1);
+  trace_utils::SwapAxes(in.data(), out.data(), dims[0], dims[1], dims[2],
+                        a, b, n_threads);
+  EXPECT_EQ(ReferenceSwap(in, dims, a, b), out);
+}
+
+INSTANTIATE_TEST_CASE_P(AxisPairs, SwapAxesTest,
+    ::testing::Combine(::testing::Values(0, 1), ::testing::Values(2),
+                       ::testing::Values(1, 3)));
+INSTANTIATE_TEST_CASE_P(OuterAxes, SwapAxesTest,
+    ::testing::Combine(::testing::Values(0), ::testing::Values(1),
+                       ::testing::Values(1, 3)));
+
+TEST(SwapAxes, InvalidAxes)
+{
+  float x = 0.f, y = 0.f;
+  EXPECT_THROW(trace_utils::SwapAxes(&x, &y, 1, 1, 1, 1, 1),
+               std::invalid_argument);
+  EXPECT_THROW(trace_utils::SwapAxes(&x, &y, 1, 1, 1, 0, 3),
+               std::invalid_argument);
+}